@@ -0,0 +1,100 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 堆分配计数：统计进程内malloc族函数的调用次数和字节数（operator new、cv::fastMalloc最终都走到这里）
+// 计数本身默认不开启：在且仅在一个翻译单元（通常是主程序所在的.cpp）包含本头文件前定义
+// MEMORYROBOT_COUNT_ALLOCATIONS，才会替换malloc/calloc/realloc/memalign系列（glibc，通过__libc_*转发）
+// 未开启时installed()为false，各计数恒为0；不要与ASan/TSan等自带分配器的sanitizer同时开启
+namespace alloc_stats {
+
+inline std::atomic<uint64_t> allocation_count{0};
+inline std::atomic<uint64_t> allocation_bytes{0};
+inline std::atomic<bool> counter_installed{false};
+
+inline bool installed() { return counter_installed.load(std::memory_order_relaxed); }
+inline uint64_t allocations() { return allocation_count.load(std::memory_order_relaxed); }
+inline uint64_t bytes() { return allocation_bytes.load(std::memory_order_relaxed); }
+
+inline void note(size_t n) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+} // namespace alloc_stats
+
+#if defined(MEMORYROBOT_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+
+#include <cerrno>
+#include <cstdlib>
+#include <malloc.h>
+
+// 以下定义覆盖glibc的同名函数（声明来自上面的系统头文件，故带noexcept）
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void* __libc_pvalloc(size_t size);
+
+void* malloc(size_t size) noexcept {
+    alloc_stats::note(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+    alloc_stats::note(n * size);
+    return __libc_calloc(n, size);
+}
+
+// 原地扩缩也计一次：调用方每次realloc都可能搬迁数据
+void* realloc(void* ptr, size_t size) noexcept {
+    if (size > 0) alloc_stats::note(size);
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+    alloc_stats::note(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    alloc_stats::note(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) noexcept {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    alloc_stats::note(size);
+    void* p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void* valloc(size_t size) noexcept {
+    alloc_stats::note(size);
+    return __libc_valloc(size);
+}
+
+void* pvalloc(size_t size) noexcept {
+    alloc_stats::note(size);
+    return __libc_pvalloc(size);
+}
+} // extern "C"
+
+namespace alloc_stats {
+// 本翻译单元被链接进程序即表示计数已替换
+struct CounterInstaller {
+    CounterInstaller() { counter_installed.store(true, std::memory_order_relaxed); }
+};
+static CounterInstaller counter_installer;
+} // namespace alloc_stats
+
+#endif // MEMORYROBOT_COUNT_ALLOCATIONS && __GLIBC__
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,334 @@
+// 记忆库基准测试：合成N个用户、M条对话，测getUserUID / saveConversationMem / getUserContextMem的吞吐和延迟
+// 用法：bench_memory_db [--users N] [--convs M] [--queries Q] [--top-k K] [--mode memory|disk|hybrid]
+//                       [--async] [--pool 读连接数] [--threads 读线程数] [--read-bound-us 微秒] [--db 路径]
+//                       [--seed 种子] [--out 结果.json]
+// 工作负载由种子完全确定（特征、对话文本、访问顺序），同一参数在不同机器、不同提交上可直接对比
+// --threads大于0时最后再测并发：threads个线程查上下文（关缓存，都走SQL）的同时一个线程持续写对话；
+// disk模式下--pool开启读连接池（MemoryDB::enableReadPool），对比--pool 0可看出读是否随核数扩展
+// 并发阶段总是开启异步写（与部署时相同：交互线程只入队），不带--async时到这一阶段才开启；
+// 读不应等写线程提交，并发读的p99超过--read-bound-us（默认20000，0为不检查）时返回非0
+// 结果写成JSON（格式见bench_report.h），不带--out时输出到标准输出；过程信息打印到标准错误
+// 编译时需定义MEMORYROBOT_NO_TEST_MAIN，去掉memory_db.cpp自带的测试主函数
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench_report.h"
+#include "memory_db.h"
+
+namespace {
+
+struct BenchOptions {
+    int users = 200;
+    int convs = 5000;
+    int queries = 2000;
+    int top_k = 5;
+    std::string mode = "memory";
+    bool async = false;
+    int pool = 4;
+    int threads = 4;
+    double read_bound_us = 20000.0;
+    std::string db_path = "./bench_memory.db";
+    unsigned seed = 20240601;
+    std::string out;
+};
+
+// 同一人不同帧的特征：单位向量加每维sigma=0.02的噪声（距离约0.23，远小于匹配阈值0.6）
+// 不同人之间的随机单位向量距离约1.4
+void random_descriptor(std::mt19937& rng, FaceDescriptor& d) {
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    float norm = 0.0f;
+    for (float& v : d) {
+        v = gauss(rng);
+        norm += v * v;
+    }
+    norm = std::sqrt(norm);
+    for (float& v : d) v /= norm;
+}
+
+void jitter(std::mt19937& rng, const FaceDescriptor& in, FaceDescriptor& out) {
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    for (int i = 0; i < kFaceDescriptorDim; ++i) out[i] = in[i] + noise(rng);
+}
+
+const char* const kPhrases[] = {
+    "今天天气不错", "我想听个故事", "明天要去医院复查", "孙子下周回来看我", "晚饭吃了饺子",
+    "帮我记一下吃药时间", "最近睡得不太好", "公园里的花开了", "给我讲讲新闻", "下午打算去散步",
+    "膝盖有点疼", "想给女儿打个电话", "这首歌很好听", "记得提醒我浇花", "周末有家庭聚会",
+};
+const char* const kReplies[] = {
+    "好的，我记住了", "听起来很不错", "要注意身体哦", "需要我提醒您吗", "我陪您聊聊吧", "祝您开心",
+};
+const char* const kScenes[] = {"home", "living_room", "kitchen", "garden", "bedroom"};
+
+template <size_t N>
+const char* pick(std::mt19937& rng, const char* const (&items)[N]) {
+    return items[rng() % N];
+}
+
+void random_conversation(std::mt19937& rng, const std::string& uid, time_t timestamp, ConversationMem& mem) {
+    mem.uid = uid;
+    mem.user_text.clear();
+    int phrases = 1 + static_cast<int>(rng() % 4);
+    for (int i = 0; i < phrases; ++i) {
+        if (i) mem.user_text += "，";
+        mem.user_text += pick(rng, kPhrases);
+    }
+    mem.robot_text = pick(rng, kReplies);
+    mem.timestamp = timestamp;
+    mem.scene_tag = pick(rng, kScenes);
+    mem.is_core = rng() % 10 == 0 ? 1 : 0;
+    mem.image_path.clear();
+}
+
+void remove_db_files(const std::string& path) {
+    const char* suffixes[] = {"", "-wal", "-shm", "-journal"};
+    for (const char* s : suffixes) unlink((path + s).c_str());
+}
+
+int run(const BenchOptions& opt) {
+    StorageMode mode = StorageMode::Memory;
+    if (opt.mode == "disk") {
+        mode = StorageMode::Disk;
+    } else if (opt.mode == "hybrid") {
+        mode = StorageMode::Hybrid;
+    } else if (opt.mode != "memory") {
+        std::cerr << "未知存储模式：" << opt.mode << std::endl;
+        return 1;
+    }
+    if (opt.users <= 0 || opt.convs < 0 || opt.queries < 0) {
+        std::cerr << "参数无效" << std::endl;
+        return 1;
+    }
+    remove_db_files(opt.db_path);
+
+    bench::Report report("memory_db");
+    report.param("users", opt.users);
+    report.param("convs", opt.convs);
+    report.param("queries", opt.queries);
+    report.param("top_k", opt.top_k);
+    report.param("mode", opt.mode);
+    report.param("async", opt.async ? "true" : "false");
+    report.param("read_bound_us", opt.read_bound_us);
+    report.param("pool", mode == StorageMode::Disk ? opt.pool : 0);
+    report.param("threads", opt.threads);
+    report.param("seed", opt.seed);
+
+    std::mt19937 rng(opt.seed);
+    std::vector<FaceDescriptor> faces(opt.users);
+    for (FaceDescriptor& f : faces) random_descriptor(rng, f);
+    std::vector<std::string> uids(opt.users);
+    bool ok = true;
+    {
+        // 库自身的日志也打印到标准输出，整个生命周期内关掉，标准输出只留JSON结果
+        bench::MuteStdout mute;
+        MemoryDB db(opt.db_path, mode);
+        bench::LatencySamples init;
+        auto t0 = std::chrono::steady_clock::now();
+        if (!db.is_open() || !db.init_db()) {
+            std::cerr << "数据库初始化失败" << std::endl;
+            return 1;
+        }
+        init.add(bench::elapsed_us(t0));
+        report.result("init_db", init);
+        if (opt.async && !db.enableAsyncWrites()) {
+            std::cerr << "异步写开启失败" << std::endl;
+            return 1;
+        }
+        if (mode == StorageMode::Disk && opt.pool > 0 && !db.enableReadPool(opt.pool)) {
+            std::cerr << "读连接池开启失败" << std::endl;
+            return 1;
+        }
+
+        // 1. 建用户：全部走未命中 -> 插入user_profile的路径
+        bench::LatencySamples create;
+        create.reserve(opt.users);
+        for (int u = 0; u < opt.users; ++u) {
+            t0 = std::chrono::steady_clock::now();
+            uids[u] = db.getUserUID(faces[u]);
+            create.add(bench::elapsed_us(t0));
+        }
+        report.result("get_user_uid_new", create);
+        std::cerr << "建用户：" << opt.users << " 个，平均 " << create.total() / opt.users << " us" << std::endl;
+
+        // 2. 写对话：用户均匀随机，时间戳递增；整段耗时含flush（异步写时等全部提交）
+        bench::LatencySamples save;
+        save.reserve(opt.convs);
+        ConversationMem mem;
+        time_t base_time = 1700000000;
+        auto phase = std::chrono::steady_clock::now();
+        for (int i = 0; i < opt.convs; ++i) {
+            random_conversation(rng, uids[rng() % opt.users], base_time + i * 37, mem);
+            t0 = std::chrono::steady_clock::now();
+            ok = db.saveConversationMem(mem) && ok;
+            save.add(bench::elapsed_us(t0));
+        }
+        db.flush();
+        double save_ms = bench::elapsed_us(phase) / 1000.0;
+        report.result("save_conversation_mem", save, save_ms);
+        std::cerr << "写对话：" << opt.convs << " 条，" << save_ms << " ms（含flush）" << std::endl;
+
+        // 3. 认人：已知用户的新一帧特征（加噪声），应全部匹配回原UID
+        bench::LatencySamples lookup;
+        lookup.reserve(opt.queries);
+        int correct = 0;
+        FaceDescriptor probe;
+        for (int i = 0; i < opt.queries; ++i) {
+            int u = static_cast<int>(rng() % opt.users);
+            jitter(rng, faces[u], probe);
+            t0 = std::chrono::steady_clock::now();
+            std::string uid = db.getUserUID(probe);
+            lookup.add(bench::elapsed_us(t0));
+            correct += uid == uids[u];
+        }
+        report.result("get_user_uid_known", lookup);
+        report.value("lookup_accuracy", opt.queries ? static_cast<double>(correct) / opt.queries : 1.0);
+        std::cerr << "认人：" << opt.queries << " 次，命中原UID " << correct << " 次" << std::endl;
+
+        // 4. 上下文：先关缓存测SQL路径，再开默认缓存测稳态（每个用户第一次查询仍走SQL）
+        std::vector<ConversationMem> context;
+        size_t rows = 0;
+        const size_t ring = static_cast<size_t>(std::max(16, opt.top_k));
+        const int passes = 2;
+        ContextCacheStats cs = ContextCacheStats();
+        for (int pass = 0; pass < passes; ++pass) {
+            db.configureContextCache(pass == 0 ? 0 : ring, 4 * 1024 * 1024);
+            ContextCacheStats before = db.contextCacheStats();
+            bench::LatencySamples query;
+            query.reserve(opt.queries);
+            std::mt19937 order(opt.seed + 1);  // 两轮访问顺序相同
+            for (int i = 0; i < opt.queries; ++i) {
+                const std::string& uid = uids[order() % opt.users];
+                t0 = std::chrono::steady_clock::now();
+                ok = db.getUserContextMem(uid, opt.top_k, context) && ok;
+                query.add(bench::elapsed_us(t0));
+                rows += context.size();
+            }
+            report.result(pass == 0 ? "get_user_context_mem_nocache" : "get_user_context_mem", query);
+            cs = db.contextCacheStats();
+            cs.hits -= before.hits;
+            cs.misses -= before.misses;
+        }
+        report.value("context_rows_avg", opt.queries ? static_cast<double>(rows) / (passes * opt.queries) : 0.0);
+        report.value("context_cache_hit_rate",
+                     cs.hits + cs.misses ? static_cast<double>(cs.hits) / (cs.hits + cs.misses) : 0.0);
+
+        // 5. 并发：threads个读线程各查queries次，同时一个写线程不停写入，直到读线程全部结束
+        if (opt.threads > 0) {
+            db.configureContextCache(0, 0);
+            if (!opt.async && !db.enableAsyncWrites()) {
+                std::cerr << "异步写开启失败" << std::endl;
+                return 1;
+            }
+            std::vector<bench::LatencySamples> per_thread(opt.threads);
+            std::vector<int> thread_ok(opt.threads, 1);
+            bench::LatencySamples writes;
+            std::atomic<int> readers_left(opt.threads);
+            phase = std::chrono::steady_clock::now();
+            std::thread writer([&] {
+                std::mt19937 wrng(opt.seed + 2);
+                ConversationMem row;
+                for (int i = 0; readers_left.load() > 0; ++i) {
+                    random_conversation(wrng, uids[wrng() % opt.users], base_time + (opt.convs + i) * 37, row);
+                    auto w0 = std::chrono::steady_clock::now();
+                    db.saveConversationMem(row);
+                    writes.add(bench::elapsed_us(w0));
+                }
+            });
+            std::vector<std::thread> readers;
+            for (int r = 0; r < opt.threads; ++r) {
+                readers.emplace_back([&, r] {
+                    std::mt19937 order(opt.seed + 10 + r);
+                    std::vector<ConversationMem> out;
+                    per_thread[r].reserve(opt.queries);
+                    for (int i = 0; i < opt.queries; ++i) {
+                        auto r0 = std::chrono::steady_clock::now();
+                        if (!db.getUserContextMem(uids[order() % opt.users], opt.top_k, out)) thread_ok[r] = 0;
+                        per_thread[r].add(bench::elapsed_us(r0));
+                    }
+                    --readers_left;
+                });
+            }
+            for (std::thread& t : readers) t.join();
+            double read_ms = bench::elapsed_us(phase) / 1000.0;
+            writer.join();
+            db.flush();
+            bench::LatencySamples reads;
+            for (int r = 0; r < opt.threads; ++r) {
+                reads.merge(per_thread[r]);
+                ok = ok && thread_ok[r];
+            }
+            report.result("get_user_context_mem_concurrent", reads, read_ms);
+            report.result("save_conversation_mem_concurrent", writes, read_ms);
+            const double read_p99 = reads.quantile(0.99);
+            std::cerr << "并发：" << opt.threads << "个线程读 " << reads.count() << " 次（"
+                      << reads.count() * 1000.0 / read_ms << " 次/秒，p99 " << read_p99 << " us），同时异步写 "
+                      << writes.count() << " 条" << std::endl;
+            if (opt.read_bound_us > 0 && read_p99 > opt.read_bound_us) {
+                std::cerr << "并发读p99超过上限" << opt.read_bound_us << " us：读路径在等写入" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    struct stat st;
+    if (mode != StorageMode::Memory && stat(opt.db_path.c_str(), &st) == 0) {
+        report.value("db_bytes", static_cast<double>(st.st_size));
+    }
+    remove_db_files(opt.db_path);
+
+    if (!ok) std::cerr << "部分操作失败，结果仅供参考" << std::endl;
+    if (!report.write(opt.out)) {
+        std::cerr << "结果写入失败：" << opt.out << std::endl;
+        return 1;
+    }
+    if (!opt.out.empty()) std::cerr << "结果已写入" << opt.out << std::endl;
+    return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--users" && i + 1 < argc) {
+            opt.users = std::atoi(argv[++i]);
+        } else if (arg == "--convs" && i + 1 < argc) {
+            opt.convs = std::atoi(argv[++i]);
+        } else if (arg == "--queries" && i + 1 < argc) {
+            opt.queries = std::atoi(argv[++i]);
+        } else if (arg == "--top-k" && i + 1 < argc) {
+            opt.top_k = std::atoi(argv[++i]);
+        } else if (arg == "--mode" && i + 1 < argc) {
+            opt.mode = argv[++i];
+        } else if (arg == "--async") {
+            opt.async = true;
+        } else if (arg == "--pool" && i + 1 < argc) {
+            opt.pool = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            opt.threads = std::atoi(argv[++i]);
+        } else if (arg == "--read-bound-us" && i + 1 < argc) {
+            opt.read_bound_us = std::atof(argv[++i]);
+        } else if (arg == "--db" && i + 1 < argc) {
+            opt.db_path = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            opt.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--out" && i + 1 < argc) {
+            opt.out = argv[++i];
+        } else {
+            std::cerr << "用法：" << argv[0] << " [--users N] [--convs M] [--queries Q] [--top-k K]"
+                      << " [--mode memory|disk|hybrid] [--async] [--pool 读连接数] [--threads 读线程数] [--read-bound-us 微秒]"
+                      << " [--db 路径] [--seed 种子] [--out 结果.json]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    return run(opt);
+}
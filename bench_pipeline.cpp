@@ -0,0 +1,207 @@
+// 交互流水线基准测试：用按配置耗时睡眠的桩服务（识别用户、录音、ASR、大模型、TTS）跑完整交互，
+// 对比main_loop式的串行执行与InteractionPipeline的重叠执行，主要看端到端首音延迟（first_audio）
+// 用法：bench_pipeline [--runs N] [--mode serial|overlap|both] [--workers 线程数] [--history 条数]
+//                      [--identify-ms 毫秒] [--record-ms 毫秒] [--asr-ms 毫秒] [--connect-ms 毫秒]
+//                      [--first-token-ms 毫秒] [--token-ms 毫秒] [--tts-first-ms 毫秒] [--tts-char-ms 毫秒]
+//                      [--out 结果.json]
+// 记忆库为内存模式的真实MemoryDB（预先写入--history条历史记忆），上下文预取、检索和存储都是真实耗时
+// 桩服务只有睡眠，不占CPU，单核机器上测得的重叠收益与多核一致
+// 结果写成JSON（格式见bench_report.h），不带--out时输出到标准输出；过程信息打印到标准错误
+// 编译时需定义MEMORYROBOT_NO_TEST_MAIN，去掉memory_db.cpp自带的测试主函数
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+#include "bench_report.h"
+#include "interaction_pipeline.h"
+#include "memory_db.h"
+
+namespace {
+
+struct BenchOptions {
+    int runs = 5;
+    std::string mode = "both";
+    int workers = 2;
+    int history = 200;
+    double identify_ms = 400.0;
+    double record_ms = 3000.0;
+    double asr_ms = 300.0;
+    double connect_ms = 150.0;
+    double first_token_ms = 600.0;
+    double token_ms = 40.0;
+    double tts_first_ms = 200.0;
+    double tts_char_ms = 60.0;
+    std::string out;
+};
+
+// 一种执行方式的各阶段时间点（均从交互开始计）
+struct ModeSamples {
+    bench::LatencySamples identified, recognized, first_delta, answered, first_audio, spoken, saved, total;
+    int failures = 0;
+
+    void add(const InteractionResult& r) {
+        identified.add(r.identified_ms * 1000.0);
+        recognized.add(r.recognized_ms * 1000.0);
+        first_delta.add(r.first_delta_ms * 1000.0);
+        answered.add(r.answered_ms * 1000.0);
+        first_audio.add(r.first_audio_ms * 1000.0);
+        spoken.add(r.spoken_ms * 1000.0);
+        saved.add(r.saved_ms * 1000.0);
+        total.add(r.total_ms * 1000.0);
+    }
+
+    void report_to(bench::Report& report, const std::string& prefix) const {
+        report.result(prefix + "_identified", identified);
+        report.result(prefix + "_recognized", recognized);
+        report.result(prefix + "_first_delta", first_delta);
+        report.result(prefix + "_answered", answered);
+        report.result(prefix + "_first_audio", first_audio);
+        report.result(prefix + "_spoken", spoken);
+        report.result(prefix + "_saved", saved);
+        report.result(prefix + "_total", total);
+    }
+};
+
+bool run_mode(const BenchOptions& opt, MemoryDB& db, bool overlap, ModeSamples& samples) {
+    StubIdentifier identifier(opt.identify_ms, "bench_user");
+    StubRecorder recorder(opt.record_ms);
+    StubRecognizer recognizer(opt.asr_ms);
+    StubChatModel chat(opt.connect_ms, opt.first_token_ms, opt.token_ms);
+    StubSynthesizer synthesizer(opt.tts_first_ms, opt.tts_char_ms);
+    InteractionServices services;
+    services.identifier = &identifier;
+    services.recorder = &recorder;
+    services.recognizer = &recognizer;
+    services.chat = &chat;
+    services.synthesizer = &synthesizer;
+    PipelineOptions popt;
+    popt.overlap = overlap;
+    popt.workers = static_cast<size_t>(opt.workers);
+    InteractionPipeline pipeline(db, services, popt);
+
+    for (int i = 0; i < opt.runs; ++i) {
+        InteractionResult r;
+        if (!pipeline.runOnce(r)) {
+            ++samples.failures;
+            continue;
+        }
+        if (overlap && r.saved_ms < r.first_audio_ms) {
+            std::cerr << "重叠 第" << i + 1 << "次：记忆在首音之前写入（" << r.saved_ms << " < " << r.first_audio_ms
+                      << " ms）" << std::endl;
+            ++samples.failures;
+            continue;
+        }
+        samples.add(r);
+        std::cerr << (overlap ? "重叠" : "串行") << " 第" << i + 1 << "次：首音 " << r.first_audio_ms << " ms，总计 "
+                  << r.total_ms << " ms（" << r.sentences << "句）" << std::endl;
+    }
+    return samples.failures == 0;
+}
+
+int run(const BenchOptions& opt) {
+    const bool serial = opt.mode != "overlap", overlap = opt.mode != "serial";
+    if (opt.mode != "serial" && opt.mode != "overlap" && opt.mode != "both") {
+        std::cerr << "未知模式：" << opt.mode << std::endl;
+        return 1;
+    }
+
+    bench::Report report("pipeline");
+    report.param("runs", opt.runs);
+    report.param("mode", opt.mode);
+    report.param("workers", opt.workers);
+    report.param("history", opt.history);
+    report.param("identify_ms", opt.identify_ms);
+    report.param("record_ms", opt.record_ms);
+    report.param("asr_ms", opt.asr_ms);
+    report.param("connect_ms", opt.connect_ms);
+    report.param("first_token_ms", opt.first_token_ms);
+    report.param("token_ms", opt.token_ms);
+    report.param("tts_first_ms", opt.tts_first_ms);
+    report.param("tts_char_ms", opt.tts_char_ms);
+
+    ModeSamples serial_samples, overlap_samples;
+    bool ok = true;
+    {
+        // 记忆库的日志打印到标准输出，整个生命周期内关掉，标准输出只留JSON结果
+        bench::MuteStdout mute;
+        MemoryDB db("", StorageMode::Memory);
+        if (!db.is_open() || !db.init_db()) {
+            std::cerr << "数据库初始化失败！" << std::endl;
+            return 1;
+        }
+        ConversationMem mem;
+        mem.uid = "bench_user";
+        mem.scene_tag = "日常对话";
+        mem.is_core = 0;
+        for (int i = 0; i < opt.history; ++i) {
+            mem.user_text = "第" + std::to_string(i) + "次聊天，我们说到了绘本和小狗";
+            mem.robot_text = "好呀，我记住了";
+            mem.timestamp = time(nullptr) - (opt.history - i) * 60;
+            db.saveConversationMem(mem);
+        }
+        if (serial) ok = run_mode(opt, db, false, serial_samples) && ok;
+        if (overlap) ok = run_mode(opt, db, true, overlap_samples) && ok;
+    }
+
+    if (serial) serial_samples.report_to(report, "serial");
+    if (overlap) overlap_samples.report_to(report, "overlap");
+    if (serial && overlap && serial_samples.first_audio.count() && overlap_samples.first_audio.count()) {
+        const double s = serial_samples.first_audio.quantile(0.5), o = overlap_samples.first_audio.quantile(0.5);
+        report.value("first_audio_saving_ms", (s - o) / 1000.0);
+        report.value("first_audio_speedup", o > 0 ? s / o : 0.0);
+        std::cerr << "首音延迟中位数：串行 " << s / 1000.0 << " ms，重叠 " << o / 1000.0 << " ms" << std::endl;
+    }
+    report.value("failures", serial_samples.failures + overlap_samples.failures);
+    if (!ok) std::cerr << "有交互未完成" << std::endl;
+    if (!report.write(opt.out)) {
+        std::cerr << "结果写入失败：" << opt.out << std::endl;
+        return 1;
+    }
+    if (!opt.out.empty()) std::cerr << "结果已写入" << opt.out << std::endl;
+    return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) {
+            opt.runs = std::atoi(argv[++i]);
+        } else if (arg == "--mode" && i + 1 < argc) {
+            opt.mode = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            opt.workers = std::atoi(argv[++i]);
+        } else if (arg == "--history" && i + 1 < argc) {
+            opt.history = std::atoi(argv[++i]);
+        } else if (arg == "--identify-ms" && i + 1 < argc) {
+            opt.identify_ms = std::atof(argv[++i]);
+        } else if (arg == "--record-ms" && i + 1 < argc) {
+            opt.record_ms = std::atof(argv[++i]);
+        } else if (arg == "--asr-ms" && i + 1 < argc) {
+            opt.asr_ms = std::atof(argv[++i]);
+        } else if (arg == "--connect-ms" && i + 1 < argc) {
+            opt.connect_ms = std::atof(argv[++i]);
+        } else if (arg == "--first-token-ms" && i + 1 < argc) {
+            opt.first_token_ms = std::atof(argv[++i]);
+        } else if (arg == "--token-ms" && i + 1 < argc) {
+            opt.token_ms = std::atof(argv[++i]);
+        } else if (arg == "--tts-first-ms" && i + 1 < argc) {
+            opt.tts_first_ms = std::atof(argv[++i]);
+        } else if (arg == "--tts-char-ms" && i + 1 < argc) {
+            opt.tts_char_ms = std::atof(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            opt.out = argv[++i];
+        } else {
+            std::cerr << "未知参数：" << arg << "（用法见bench_pipeline.cpp开头）" << std::endl;
+            return 1;
+        }
+    }
+    if (opt.runs <= 0 || opt.workers < 2 || opt.history < 0) {
+        std::cerr << "参数无效（--workers至少为2：TTS等待大模型的句子时占用一个线程）" << std::endl;
+        return 1;
+    }
+    return run(opt);
+}
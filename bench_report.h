@@ -0,0 +1,198 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "metrics.h"
+
+// 基准测试公用部分：逐次耗时样本的统计，以及带平台信息的JSON报告
+// 报告格式（一个对象，便于不同机器、不同提交之间直接diff或导入表格）：
+//   {"bench": 名称, "platform": {...}, "params": {...}, "results": {名称: {count, total_ms, ops_per_sec,
+//    mean_us, p50_us, p90_us, p99_us, max_us}, ...}, "values": {名称: 数值, ...}}
+namespace bench {
+
+inline double elapsed_us(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - since).count();
+}
+
+// 计时期间关掉标准输出：被测代码的日志（如"新建用户成功"、打开/关闭数据库）会混进标准输出上的JSON结果
+class MuteStdout {
+public:
+    MuteStdout() : saved(std::cout.rdbuf(nullptr)) {}
+    ~MuteStdout() {
+        std::cout.rdbuf(saved);
+        std::cout.clear();
+    }
+    MuteStdout(const MuteStdout&) = delete;
+    MuteStdout& operator=(const MuteStdout&) = delete;
+
+private:
+    std::streambuf* saved;
+};
+
+// 每次操作的耗时样本（微秒）；分位数按排序后精确取值，不做分桶近似
+class LatencySamples {
+public:
+    void add(double us) { samples.push_back(us); }
+    void reserve(size_t n) { samples.reserve(n); }
+    void merge(const LatencySamples& other) { samples.insert(samples.end(), other.samples.begin(), other.samples.end()); }
+    size_t count() const { return samples.size(); }
+
+    double total() const {
+        double sum = 0.0;
+        for (double s : samples) sum += s;
+        return sum;
+    }
+
+    double quantile(double q) const {
+        if (samples.empty()) return 0.0;
+        std::vector<double> sorted(samples);
+        size_t rank = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+    double max() const { return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end()); }
+
+private:
+    std::vector<double> samples;
+};
+
+inline const char* arch_name() {
+#if defined(__aarch64__)
+    return "aarch64";
+#elif defined(__arm__)
+    return "arm";
+#elif defined(__x86_64__)
+    return "x86_64";
+#elif defined(__i386__)
+    return "x86";
+#else
+    return "unknown";
+#endif
+}
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+class Report {
+public:
+    explicit Report(const std::string& bench_name) : name(bench_name) {}
+
+    void param(const std::string& key, const std::string& value) {
+        params.push_back({key, "\"" + json_escape(value) + "\""});
+    }
+    void param(const std::string& key, double value) { params.push_back({key, number(value)}); }
+
+    // total_ms为整段耗时（可含逐次计时之外的收尾，如异步写的flush），吞吐按它计算；<0时取样本之和
+    void result(const std::string& key, const LatencySamples& s, double total_ms = -1.0) {
+        if (total_ms < 0) total_ms = s.total() / 1000.0;
+        std::ostringstream out;
+        out << "{\"count\":" << s.count() << ",\"total_ms\":" << number(total_ms)
+            << ",\"ops_per_sec\":" << number(total_ms > 0 ? s.count() * 1000.0 / total_ms : 0.0)
+            << ",\"mean_us\":" << number(s.count() ? s.total() / s.count() : 0.0)
+            << ",\"p50_us\":" << number(s.quantile(0.5)) << ",\"p90_us\":" << number(s.quantile(0.9))
+            << ",\"p99_us\":" << number(s.quantile(0.99)) << ",\"max_us\":" << number(s.max()) << "}";
+        results.push_back({key, out.str()});
+    }
+
+    // 检测、关键点、特征等内部阶段直接取metrics直方图（对数线性分桶，分位数为桶上界）
+    void stage(const std::string& key, const metrics::StageSnapshot& st) {
+        std::ostringstream out;
+        out << "{\"count\":" << st.count << ",\"total_ms\":" << number(st.sum_us / 1000.0)
+            << ",\"mean_us\":" << (st.count ? st.sum_us / st.count : 0) << ",\"p50_us\":" << st.quantile(0.5)
+            << ",\"p90_us\":" << st.quantile(0.9) << ",\"p99_us\":" << st.quantile(0.99)
+            << ",\"max_us\":" << st.max_us << "}";
+        results.push_back({key, out.str()});
+    }
+
+    void value(const std::string& key, double v) { values.push_back({key, number(v)}); }
+
+    std::string json() const {
+        std::ostringstream out;
+        char host[256] = {0};
+        if (gethostname(host, sizeof(host) - 1) != 0) host[0] = '\0';
+        out << "{\"bench\":\"" << json_escape(name) << "\",\"timestamp\":" << static_cast<int64_t>(time(nullptr));
+        out << ",\"platform\":{\"arch\":\"" << arch_name() << "\",\"host\":\"" << json_escape(host)
+            << "\",\"cpus\":" << sysconf(_SC_NPROCESSORS_ONLN) << ",\"compiler\":\""
+#if defined(__VERSION__)
+            << json_escape(__VERSION__)
+#endif
+            << "\",\"optimized\":"
+#if defined(__OPTIMIZE__)
+            << "true"
+#else
+            << "false"
+#endif
+            << ",\"metrics\":"
+#ifdef MEMORYROBOT_NO_METRICS
+            << "false"
+#else
+            << "true"
+#endif
+            << "}";
+        object(out, "params", params);
+        object(out, "results", results);
+        object(out, "values", values);
+        out << "}\n";
+        return out.str();
+    }
+
+    // path为空或"-"时写到标准输出
+    bool write(const std::string& path) const {
+        if (path.empty() || path == "-") {
+            std::cout << json();
+            return true;
+        }
+        return metrics::write_file_atomic(path, json());
+    }
+
+private:
+    typedef std::vector<std::pair<std::string, std::string>> Fields;
+    std::string name;
+    Fields params, results, values;
+
+    static std::string number(double v) {
+        std::ostringstream out;
+        out.precision(10);
+        out << v;
+        return out.str();
+    }
+
+    static void object(std::ostringstream& out, const char* key, const Fields& fields) {
+        out << ",\"" << key << "\":{";
+        for (size_t i = 0; i < fields.size(); ++i) {
+            out << (i ? "," : "") << "\"" << json_escape(fields[i].first) << "\":" << fields[i].second;
+        }
+        out << "}";
+    }
+};
+
+} // namespace bench
+
+#endif // BENCH_REPORT_H
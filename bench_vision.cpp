@@ -0,0 +1,238 @@
+// 视觉流水线基准测试：在固定的图片集（或视频文件）上逐帧跑检测/关键点/特征，不需要摄像头
+// 用法：bench_vision [--images 目录 | --video 文件] [--repeat 轮数] [--warmup 轮数] [--mode describe|track|watch]
+//                    [--int8 [--calib 校准文件]] [--landmarks5 [5点模型]] [--downscale 倍数] [--min-face 像素]
+//                    [--model-68 文件] [--model-5 文件] [--rec-model 文件] [--save 目录] [--out 结果.json]
+// 默认图片目录为bench_data/faces（按文件名排序依次作为帧；人脸图片需自备，不随代码提交）
+// 全部帧先解码进内存，计时只含VisionModule的处理；检测、关键点、特征各阶段的分布取自metrics直方图，
+// 所以编译时不能定义MEMORYROBOT_NO_METRICS（否则只有逐帧总耗时）
+// 结果写成JSON（格式见bench_report.h），不带--out时输出到标准输出；过程信息打印到标准错误
+// 本程序开启了alloc_counter.h的堆分配计数，另外报告稳态下每帧的分配次数和字节数（预热轮之后）
+// 编译时需定义MEMORYROBOT_NO_TEST_MAIN，去掉vision_module.cpp自带的测试主函数
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define MEMORYROBOT_COUNT_ALLOCATIONS
+#include "alloc_counter.h"
+#include "bench_report.h"
+#include "vision_module.h"
+
+namespace {
+
+struct BenchOptions {
+    std::string images = "bench_data/faces";
+    std::string video;
+    int repeat = 3;
+    int warmup = 1;
+    std::string mode = "describe";
+    bool int8 = false;
+    std::string calib;
+    bool landmarks5 = false;
+    std::string model5;
+    FaceDetectOptions detect;
+    VisionModelPaths models;
+    std::string save;
+    std::string out;
+};
+
+// 读出全部帧并深拷贝（帧源可能复用缓冲）
+bool load_frames(FrameSource& source, std::vector<Frame>& frames, bench::LatencySamples& decode) {
+    Frame frame;
+    for (;;) {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!source.read(frame)) break;
+        decode.add(bench::elapsed_us(t0));
+        Frame copy;
+        copy.id = frames.size() + 1;
+        copy.format = frame.format;
+        copy.image = frame.image.clone();
+        copy.raw = frame.raw.clone();
+        frames.push_back(copy);
+    }
+    return !frames.empty();
+}
+
+int run(const BenchOptions& opt) {
+    std::unique_ptr<FrameSource> source;
+    if (!opt.video.empty()) {
+        source.reset(new VideoFileSource(opt.video));
+    } else {
+        source.reset(new ImageDirSource(opt.images));
+    }
+    std::vector<Frame> frames;
+    bench::LatencySamples decode;
+    if (!source->isOpened() || !load_frames(*source, frames, decode)) {
+        std::cerr << "没有可用的帧：" << source->name() << "（用--images指定人脸图片目录或--video指定视频）"
+                  << std::endl;
+        return 1;
+    }
+    const bool track = opt.mode == "track", watch = opt.mode == "watch";
+    if (!track && !watch && opt.mode != "describe") {
+        std::cerr << "未知模式：" << opt.mode << std::endl;
+        return 1;
+    }
+
+    bench::Report report("vision");
+    report.param("source", source->name());
+    report.param("frames", static_cast<double>(frames.size()));
+    report.param("width", frames[0].image.empty() ? 0.0 : frames[0].image.cols);
+    report.param("height", frames[0].image.empty() ? 0.0 : frames[0].image.rows);
+    report.param("repeat", opt.repeat);
+    report.param("mode", opt.mode);
+    report.param("int8", opt.int8 ? "true" : "false");
+    report.param("landmarks", opt.landmarks5 ? "5" : "68");
+    report.param("downscale", opt.detect.downscale);
+    report.param("min_face", opt.detect.min_face_size);
+    report.result("decode", decode);
+
+    bench::LatencySamples init, per_frame, hash, capture;
+    size_t faces_per_pass = 0, faces_first_pass = 0;
+    bool stable = true;
+    metrics::MetricsSnapshot before, after;
+    FrameArenaStats arena = FrameArenaStats();
+    {
+        // 模块自身的日志也打印到标准输出，整个生命周期内关掉，标准输出只留JSON结果
+        bench::MuteStdout mute;
+        VisionModule vm(std::unique_ptr<FrameSource>(), opt.save.empty() ? "." : opt.save);
+        vm.setModelPaths(opt.models);
+        if (opt.landmarks5) vm.setLandmarkMode(LandmarkMode::Points5, opt.model5);
+        auto t0 = std::chrono::steady_clock::now();
+        if (!vm.init() || (opt.int8 && !vm.enableQuantizedInference(opt.calib))) {
+            std::cerr << "VisionModule初始化失败！" << std::endl;
+            return 1;
+        }
+        init.add(bench::elapsed_us(t0));
+        vm.setDetectOptions(opt.detect);
+        if (track) vm.enableTracking();
+
+        std::vector<DetectedFace> detected;
+        TrackedFace tracked;
+        for (int pass = 0; pass < opt.warmup + opt.repeat; ++pass) {
+            const bool measured = pass >= opt.warmup;
+            if (pass == opt.warmup) {
+                before = metrics::snapshot();
+                vm.resetArenaStats();  // 预热轮里缓冲扩容的分配不计入
+            }
+            if (track) vm.resetTracking();  // 每轮从头跟踪，各轮工作量相同
+            size_t faces = 0;
+            for (const Frame& frame : frames) {
+                t0 = std::chrono::steady_clock::now();
+                if (track) {
+                    faces += vm.trackFace(frame, tracked) ? 1 : 0;
+                } else if (watch) {
+                    faces += vm.watch(frame, detected);
+                } else {
+                    faces += vm.getFaceDescriptors(frame, detected);
+                }
+                if (measured) per_frame.add(bench::elapsed_us(t0));
+            }
+            if (pass == 0) faces_first_pass = faces;
+            stable = stable && faces == faces_first_pass;
+            faces_per_pass = faces;
+        }
+        after = metrics::snapshot();
+        arena = vm.arenaStats();
+
+        // 拍照相关：画面指纹（去重用）和同步存图（编码+写盘）各测一轮
+        uint64_t h = 0;
+        for (const Frame& frame : frames) {
+            t0 = std::chrono::steady_clock::now();
+            vm.imageHash(frame, h);
+            hash.add(bench::elapsed_us(t0));
+        }
+        if (!opt.save.empty()) {
+            for (const Frame& frame : frames) {
+                t0 = std::chrono::steady_clock::now();
+                vm.captureImage(frame);
+                capture.add(bench::elapsed_us(t0));
+            }
+        }
+    }
+
+    report.result("init", init);
+    report.result("frame", per_frame);
+    report.result("image_hash", hash);
+    if (!opt.save.empty()) report.result("capture_image", capture);
+    metrics::MetricsSnapshot window = after.since(before);
+    const metrics::Stage stages[] = {metrics::Stage::FaceDetect, metrics::Stage::ShapePredict,
+                                     metrics::Stage::FaceDescriptor, metrics::Stage::FaceTrack};
+    for (metrics::Stage s : stages) {
+        const metrics::StageSnapshot& st = window.stages[static_cast<int>(s)];
+        if (st.count > 0) report.stage(metrics::stage_name(s), st);
+    }
+    // 各轮人脸数应相同：不同平台、不同提交之间对比时，人脸数变了说明结果也变了，耗时不可直接比较
+    report.value("faces_per_pass", static_cast<double>(faces_per_pass));
+    report.value("faces_stable", stable ? 1.0 : 0.0);
+    double frame_ms = per_frame.total() / 1000.0;
+    report.value("fps", frame_ms > 0 ? per_frame.count() * 1000.0 / frame_ms : 0.0);
+    if (alloc_stats::installed() && arena.frames > 0) {
+        // 剩下的分配来自dlib内部（HOG检测器、.dat关键点模型等），见frame_arena.h
+        report.value("allocs_per_frame", static_cast<double>(arena.allocations) / arena.frames);
+        report.value("alloc_bytes_per_frame", static_cast<double>(arena.bytes) / arena.frames);
+        report.value("max_allocs_per_frame", static_cast<double>(arena.max_allocations));
+        report.value("zero_alloc_frames", static_cast<double>(arena.zero_alloc_frames));
+        std::cerr << "平均每帧堆分配 " << static_cast<double>(arena.allocations) / arena.frames << " 次，单帧最多 "
+                  << arena.max_allocations << " 次" << std::endl;
+    }
+
+    std::cerr << "帧数 " << frames.size() << " x " << opt.repeat << " 轮，每轮人脸 " << faces_per_pass << " 张，平均每帧 "
+              << (per_frame.count() ? per_frame.total() / per_frame.count() / 1000.0 : 0.0) << " ms" << std::endl;
+    if (!stable) std::cerr << "各轮检测到的人脸数不一致" << std::endl;
+    if (!report.write(opt.out)) {
+        std::cerr << "结果写入失败：" << opt.out << std::endl;
+        return 1;
+    }
+    if (!opt.out.empty()) std::cerr << "结果已写入" << opt.out << std::endl;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--images" && i + 1 < argc) {
+            opt.images = argv[++i];
+        } else if (arg == "--video" && i + 1 < argc) {
+            opt.video = argv[++i];
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            opt.repeat = std::atoi(argv[++i]);
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            opt.warmup = std::atoi(argv[++i]);
+        } else if (arg == "--mode" && i + 1 < argc) {
+            opt.mode = argv[++i];
+        } else if (arg == "--int8") {
+            opt.int8 = true;
+        } else if (arg == "--calib" && i + 1 < argc) {
+            opt.calib = argv[++i];
+        } else if (arg == "--landmarks5") {
+            opt.landmarks5 = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') opt.model5 = argv[++i];
+        } else if (arg == "--downscale" && i + 1 < argc) {
+            opt.detect.downscale = std::atof(argv[++i]);
+        } else if (arg == "--min-face" && i + 1 < argc) {
+            opt.detect.min_face_size = std::atoi(argv[++i]);
+        } else if (arg == "--model-68" && i + 1 < argc) {
+            opt.models.landmarks68 = argv[++i];
+        } else if (arg == "--model-5" && i + 1 < argc) {
+            opt.models.landmarks5 = argv[++i];
+        } else if (arg == "--rec-model" && i + 1 < argc) {
+            opt.models.recognition = argv[++i];
+        } else if (arg == "--save" && i + 1 < argc) {
+            opt.save = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            opt.out = argv[++i];
+        } else {
+            std::cerr << "未知参数：" << arg << "（用法见bench_vision.cpp开头）" << std::endl;
+            return 1;
+        }
+    }
+    if (opt.repeat <= 0 || opt.warmup < 0) {
+        std::cerr << "参数无效" << std::endl;
+        return 1;
+    }
+    return run(opt);
+}
@@ -0,0 +1,250 @@
+#ifndef CONTEXT_CACHE_H
+#define CONTEXT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <utility>
+
+#include "memory_types.h"
+
+// 缓存统计
+struct ContextCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t users;
+    size_t bytes;
+};
+
+// 按用户缓存最近N条对话记忆的环形缓冲区，内存预算下按LRU淘汰
+// 首次查询时由SQL结果填充，saveConversationMem写入时原地更新
+// 环内按时间排序（同一时间戳按写入先后），与SQL的ORDER BY timestamp DESC, mem_id DESC一致：
+// 补录的旧记忆插到对应位置，比环内最旧一条还旧时不放入，命中与未命中返回的顺序相同
+// 多线程下未命中的查询先取writeStamp，读完SQL后带着它回填；期间该用户有新写入、或有同步写入
+// 尚未写穿（beginAppend之后、append之前）则放弃回填，以免旧快照覆盖新记忆或同一条被写穿两次
+// 按uid哈希分成kShards个分片，各有自己的锁、LRU和1/kShards的内存预算，并发读不同用户时互不等待
+class ContextCache {
+private:
+    static const size_t kStampStripes = 64;  // 写入戳按uid哈希分条，不同用户的写入互不影响回填
+    static const size_t kShards = 16;        // kStampStripes的约数：同一写入戳分条总在同一分片内
+
+    struct Entry {
+        std::vector<ConversationMem> ring;  // 固定ring_size个槽位，槽位内字符串复用容量
+        size_t head;       // 下一个写入位置（环满时即最旧一条）
+        size_t count;      // 有效条数
+        bool complete;     // 环内是否包含该用户的全部记忆
+        size_t bytes;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru;  // 表头为最近使用
+        size_t total_bytes;
+        ContextCacheStats stats;
+        Shard() : total_bytes(0), stats() {}
+    };
+
+    size_t ring_size;
+    size_t budget_bytes;  // 每个分片的预算为budget_bytes / kShards
+    Shard shards[kShards];
+    std::atomic<uint64_t> stamps[kStampStripes];
+    int pending[kStampStripes];  // 进行中的同步写入数（持所在分片的mutex修改和读取）
+
+    static size_t stripe(const std::string& uid) { return std::hash<std::string>()(uid) % kStampStripes; }
+    std::atomic<uint64_t>& stamp_of(const std::string& uid) { return stamps[stripe(uid)]; }
+    Shard& shard_of(const std::string& uid) { return shards[stripe(uid) % kShards]; }
+
+    static size_t mem_bytes(const ConversationMem& mem) {
+        return sizeof(ConversationMem) + mem.uid.capacity() + mem.user_text.capacity() +
+               mem.robot_text.capacity() + mem.scene_tag.capacity() + mem.image_path.capacity();
+    }
+
+    static void recount(Shard& sh, Entry& e) {
+        size_t bytes = sizeof(Entry);
+        for (const ConversationMem& mem : e.ring) bytes += mem_bytes(mem);
+        sh.total_bytes = sh.total_bytes - e.bytes + bytes;
+        e.bytes = bytes;
+    }
+
+    // 按时间插入：新记忆写到head，再向前换到不早于前一条的位置（通常一步都不用换）
+    void push(Entry& e, const ConversationMem& mem) {
+        if (e.count == ring_size && mem.timestamp < e.ring[e.head].timestamp) {
+            e.complete = false;  // 比环内最旧一条还旧：不在最近ring_size条之内
+            return;
+        }
+        size_t pos = e.head;
+        e.ring[pos] = mem;  // 拷贝赋值复用槽位已有的字符串容量
+        e.head = (e.head + 1) % ring_size;
+        if (e.count < ring_size) {
+            ++e.count;
+        } else {
+            e.complete = false;  // 覆盖了最旧一条
+        }
+        for (size_t i = 1; i < e.count; ++i) {
+            size_t prev = (pos + ring_size - 1) % ring_size;
+            if (e.ring[prev].timestamp <= e.ring[pos].timestamp) break;
+            std::swap(e.ring[prev], e.ring[pos]);  // 交换只移动字符串缓冲，不分配
+            pos = prev;
+        }
+    }
+
+    void evict_over_budget(Shard& sh, const std::string* keep) {
+        const size_t budget = budget_bytes / kShards;
+        while (sh.total_bytes > budget && !sh.lru.empty()) {
+            const std::string& victim = sh.lru.back();
+            if (keep && victim == *keep) break;
+            auto it = sh.entries.find(victim);
+            sh.total_bytes -= it->second.bytes;
+            sh.entries.erase(it);
+            sh.lru.pop_back();
+            ++sh.stats.evictions;
+        }
+    }
+
+public:
+    ContextCache(size_t ring = 16, size_t budget = 4 * 1024 * 1024)
+        : ring_size(ring), budget_bytes(budget) {
+        for (size_t i = 0; i < kStampStripes; ++i) {
+            stamps[i].store(0);
+            pending[i] = 0;
+        }
+    }
+
+    // 启动阶段调用（与查询并发时ring_size的读取不加锁）
+    void configure(size_t ring, size_t budget) {
+        for (Shard& sh : shards) sh.mutex.lock();
+        ring_size = ring;
+        budget_bytes = budget;
+        for (Shard& sh : shards) {
+            sh.entries.clear();
+            sh.lru.clear();
+            sh.total_bytes = 0;
+            sh.mutex.unlock();
+        }
+    }
+
+    bool enabled() const { return ring_size > 0; }
+    size_t ringSize() const { return ring_size; }
+
+    // 命中时把最新的top_k条（时间倒序）写入out并返回true；out中的字符串复用已有容量
+    bool get(const std::string& uid, int top_k, std::vector<ConversationMem>& out) {
+        Shard& sh = shard_of(uid);
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        auto it = sh.entries.find(uid);
+        if (it == sh.entries.end() || top_k < 0) {
+            ++sh.stats.misses;
+            return false;
+        }
+        Entry& e = it->second;
+        size_t want = static_cast<size_t>(top_k);
+        if (want > e.count && !e.complete) {
+            ++sh.stats.misses;
+            return false;
+        }
+        size_t n = want < e.count ? want : e.count;
+        out.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = e.ring[(e.head + ring_size - 1 - i) % ring_size];
+        }
+        sh.lru.splice(sh.lru.begin(), sh.lru, e.lru_pos);
+        ++sh.stats.hits;
+        return true;
+    }
+
+    // 查询SQL前取得的写入戳，回填时传给fill
+    uint64_t writeStamp(const std::string& uid) { return stamp_of(uid).load(); }
+
+    // SQL未命中后填充：newest_first为时间倒序结果，complete表示已取到该用户全部记忆
+    // stamp为查询前的writeStamp，之后该用户有过append/invalidate时不回填（返回false）
+    bool fill(const std::string& uid, const std::vector<ConversationMem>& newest_first, bool complete,
+              uint64_t stamp) {
+        if (ring_size == 0) return false;
+        Shard& sh = shard_of(uid);
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        if (stamp_of(uid).load() != stamp || pending[stripe(uid)] != 0) return false;
+        auto it = sh.entries.find(uid);
+        if (it == sh.entries.end()) {
+            sh.lru.push_front(uid);
+            Entry fresh;
+            fresh.ring.resize(ring_size);
+            fresh.bytes = 0;
+            fresh.lru_pos = sh.lru.begin();
+            it = sh.entries.emplace(uid, std::move(fresh)).first;
+        } else {
+            sh.lru.splice(sh.lru.begin(), sh.lru, it->second.lru_pos);
+        }
+        Entry& e = it->second;
+        e.head = 0;
+        e.count = 0;
+        size_t n = newest_first.size() < ring_size ? newest_first.size() : ring_size;
+        for (size_t i = n; i-- > 0;) {
+            push(e, newest_first[i]);
+        }
+        e.complete = complete && newest_first.size() <= ring_size;
+        recount(sh, e);
+        evict_over_budget(sh, &uid);
+        return true;
+    }
+
+    // 同步写入先beginAppend再写库，提交后append(mem, true)，失败时cancelAppend
+    // （先写库后写穿之间，并发的未命中查询可能已从SQL读到这一条，这段时间内不能回填）
+    void beginAppend(const std::string& uid) {
+        std::lock_guard<std::mutex> lock(shard_of(uid).mutex);
+        ++pending[stripe(uid)];
+    }
+
+    void cancelAppend(const std::string& uid) {
+        std::lock_guard<std::mutex> lock(shard_of(uid).mutex);
+        --pending[stripe(uid)];
+        ++stamp_of(uid);
+    }
+
+    // 写穿：只更新已缓存的用户（未缓存的用户下次查询时再从SQL填充）
+    void append(const ConversationMem& mem, bool begun = false) {
+        Shard& sh = shard_of(mem.uid);
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        if (begun) --pending[stripe(mem.uid)];
+        ++stamp_of(mem.uid);
+        if (ring_size == 0) return;
+        auto it = sh.entries.find(mem.uid);
+        if (it == sh.entries.end()) return;
+        push(it->second, mem);
+        recount(sh, it->second);
+        evict_over_budget(sh, &mem.uid);
+    }
+
+    // 丢弃某用户的缓存（记忆被归档、删除或异步写入失败后，下次查询重新从SQL填充）
+    void invalidate(const std::string& uid) {
+        Shard& sh = shard_of(uid);
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        ++stamp_of(uid);
+        auto it = sh.entries.find(uid);
+        if (it == sh.entries.end()) return;
+        sh.total_bytes -= it->second.bytes;
+        sh.lru.erase(it->second.lru_pos);
+        sh.entries.erase(it);
+    }
+
+    ContextCacheStats snapshot() {
+        ContextCacheStats s = ContextCacheStats();
+        for (Shard& sh : shards) {
+            std::lock_guard<std::mutex> lock(sh.mutex);
+            s.hits += sh.stats.hits;
+            s.misses += sh.stats.misses;
+            s.evictions += sh.stats.evictions;
+            s.users += sh.entries.size();
+            s.bytes += sh.total_bytes;
+        }
+        return s;
+    }
+};
+
+#endif // CONTEXT_CACHE_H
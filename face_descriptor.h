@@ -0,0 +1,148 @@
+#ifndef FACE_DESCRIPTOR_H
+#define FACE_DESCRIPTOR_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+// dlib人脸识别模型输出的特征维度
+const int kFaceDescriptorDim = 128;
+
+// 定长人脸特征（VisionModule与MemoryDB之间直接传递，无需字符串格式化/解析）
+typedef std::array<float, kFaceDescriptorDim> FaceDescriptor;
+
+// 特征BLOB的存储编码，按BLOB长度即可区分，无需额外头部
+enum class DescriptorEncoding {
+    Float32,  // 512字节，无损
+    Float16,  // 256字节
+    Int8      // 4字节缩放系数 + 128字节，按向量最大绝对值对称量化
+};
+
+const size_t kFloat32BlobSize = kFaceDescriptorDim * sizeof(float);
+const size_t kFloat16BlobSize = kFaceDescriptorDim * sizeof(uint16_t);
+const size_t kInt8BlobSize = sizeof(float) + kFaceDescriptorDim;
+
+// float32 -> IEEE半精度（就近舍入，不依赖F16C/NEON扩展）
+inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exp = static_cast<int32_t>((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffff;
+
+    if (exp <= 0) {
+        if (exp < -10) return static_cast<uint16_t>(sign);
+        mant |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exp);
+        uint32_t half = mant >> shift;
+        if ((mant >> (shift - 1)) & 1) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    if (exp >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+
+    uint32_t half = sign | (static_cast<uint32_t>(exp) << 10) | (mant >> 13);
+    if (mant & 0x1000) ++half;  // 进位可能溢出到指数位，结果仍正确
+    return static_cast<uint16_t>(half);
+}
+
+inline float half_to_float(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t x;
+
+    if (exp == 0) {
+        if (mant == 0) {
+            x = sign;
+        } else {
+            // 非规格化数：归一化尾数
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                --exp;
+            }
+            mant &= 0x3ff;
+            x = sign | (exp << 23) | (mant << 13);
+        }
+    } else if (exp == 31) {
+        x = sign | 0x7f800000 | (mant << 13);
+    } else {
+        x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+// 特征编码为BLOB字节
+inline void encode_descriptor(const FaceDescriptor& desc, DescriptorEncoding enc, std::vector<uint8_t>& blob) {
+    switch (enc) {
+    case DescriptorEncoding::Float32:
+        blob.resize(kFloat32BlobSize);
+        std::memcpy(blob.data(), desc.data(), kFloat32BlobSize);
+        break;
+    case DescriptorEncoding::Float16: {
+        blob.resize(kFloat16BlobSize);
+        uint16_t* out = reinterpret_cast<uint16_t*>(blob.data());
+        for (int i = 0; i < kFaceDescriptorDim; ++i) out[i] = float_to_half(desc[i]);
+        break;
+    }
+    case DescriptorEncoding::Int8: {
+        blob.resize(kInt8BlobSize);
+        float max_abs = 0.0f;
+        for (float v : desc) max_abs = std::max(max_abs, std::fabs(v));
+        float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+        std::memcpy(blob.data(), &scale, sizeof(scale));
+        int8_t* out = reinterpret_cast<int8_t*>(blob.data() + sizeof(float));
+        for (int i = 0; i < kFaceDescriptorDim; ++i) {
+            long q = std::lround(desc[i] / scale);
+            out[i] = static_cast<int8_t>(std::max(-127L, std::min(127L, q)));
+        }
+        break;
+    }
+    }
+}
+
+// 从BLOB解码特征，按长度识别编码；长度不符返回false
+inline bool decode_descriptor(const void* data, size_t size, FaceDescriptor& desc) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (size == kFloat32BlobSize) {
+        std::memcpy(desc.data(), bytes, kFloat32BlobSize);
+    } else if (size == kFloat16BlobSize) {
+        for (int i = 0; i < kFaceDescriptorDim; ++i) {
+            uint16_t h;
+            std::memcpy(&h, bytes + i * sizeof(uint16_t), sizeof(h));
+            desc[i] = half_to_float(h);
+        }
+    } else if (size == kInt8BlobSize) {
+        float scale;
+        std::memcpy(&scale, bytes, sizeof(scale));
+        const int8_t* q = reinterpret_cast<const int8_t*>(bytes + sizeof(float));
+        for (int i = 0; i < kFaceDescriptorDim; ++i) desc[i] = q[i] * scale;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 兼容旧格式：解析逗号分隔的特征文本
+inline bool parse_descriptor_text(const std::string& text, FaceDescriptor& desc) {
+    const char* p = text.c_str();
+    int n = 0;
+    while (*p) {
+        char* end = nullptr;
+        float v = std::strtof(p, &end);
+        if (end == p || n >= kFaceDescriptorDim) return false;
+        desc[n++] = v;
+        p = end;
+        if (*p == ',') ++p;
+    }
+    return n == kFaceDescriptorDim;
+}
+
+#endif // FACE_DESCRIPTOR_H
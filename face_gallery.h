@@ -0,0 +1,240 @@
+#ifndef FACE_GALLERY_H
+#define FACE_GALLERY_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <unordered_set>
+
+#include "face_descriptor.h"
+
+// SIMD头文件：按编译目标自动选择（x86: AVX/SSE，ARM: NEON）
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// 两个特征向量的欧氏距离平方（向量化实现）
+inline float l2_distance_sq(const float* a, const float* b, int dim) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(d, d));
+    }
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    sum = _mm_cvtss_f32(lo);
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= dim; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= dim; i += 4) {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        acc = vmlaq_f32(acc, d, d);
+    }
+    float32x2_t half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+    for (; i < dim; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+// 常驻内存的人脸特征库：小规模时SIMD暴力扫描，超过阈值后切换为HNSW近似索引
+class FaceGallery {
+private:
+    std::vector<float> features;     // 所有特征连续存放（size * kFaceDescriptorDim）
+    std::vector<std::string> uids;   // 与features逐行对应
+    float match_threshold;           // 欧氏距离阈值（dlib推荐0.6）
+    size_t hnsw_min_size;            // 超过该数量才建立HNSW索引
+
+    // HNSW图结构：links[node][level]为该层的邻居列表
+    std::vector<std::vector<std::vector<int>>> links;
+    int entry_point;
+    int max_level;
+    size_t hnsw_m;
+    size_t ef_construction;
+    size_t ef_search;
+    std::mt19937 rng;
+
+    const float* row(int idx) const { return &features[static_cast<size_t>(idx) * kFaceDescriptorDim]; }
+
+    float dist(const float* q, int idx) const { return l2_distance_sq(q, row(idx), kFaceDescriptorDim); }
+
+    int random_level() {
+        std::uniform_real_distribution<double> uni(0.0, 1.0);
+        double ml = 1.0 / std::log(static_cast<double>(hnsw_m));
+        return static_cast<int>(-std::log(std::max(uni(rng), 1e-12)) * ml);
+    }
+
+    // 单层贪心+候选集搜索，返回按距离升序的最多ef个结果
+    std::vector<std::pair<float, int>> search_layer(const float* q, int ep, size_t ef, int level) const {
+        typedef std::pair<float, int> Item;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> candidates;
+        std::priority_queue<Item> best;
+        std::unordered_set<int> visited;
+
+        float d0 = dist(q, ep);
+        candidates.push(Item(d0, ep));
+        best.push(Item(d0, ep));
+        visited.insert(ep);
+
+        while (!candidates.empty()) {
+            Item cur = candidates.top();
+            if (cur.first > best.top().first && best.size() >= ef) break;
+            candidates.pop();
+            for (int nb : links[cur.second][level]) {
+                if (!visited.insert(nb).second) continue;
+                float d = dist(q, nb);
+                if (best.size() < ef || d < best.top().first) {
+                    candidates.push(Item(d, nb));
+                    best.push(Item(d, nb));
+                    if (best.size() > ef) best.pop();
+                }
+            }
+        }
+
+        std::vector<Item> result;
+        result.reserve(best.size());
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    void hnsw_insert(int idx) {
+        int level = random_level();
+        links[idx].assign(level + 1, std::vector<int>());
+        if (entry_point < 0) {
+            entry_point = idx;
+            max_level = level;
+            return;
+        }
+
+        const float* q = row(idx);
+        int ep = entry_point;
+        for (int l = max_level; l > level; --l) {
+            ep = search_layer(q, ep, 1, l).front().second;
+        }
+        for (int l = std::min(level, max_level); l >= 0; --l) {
+            std::vector<std::pair<float, int>> found = search_layer(q, ep, ef_construction, l);
+            size_t max_links = (l == 0) ? hnsw_m * 2 : hnsw_m;
+            for (size_t i = 0; i < found.size() && i < hnsw_m; ++i) {
+                int nb = found[i].second;
+                links[idx][l].push_back(nb);
+                std::vector<int>& back = links[nb][l];
+                back.push_back(idx);
+                if (back.size() > max_links) {
+                    // 邻居过多时只保留最近的max_links个
+                    const float* nq = row(nb);
+                    std::sort(back.begin(), back.end(), [&](int x, int y) {
+                        return dist(nq, x) < dist(nq, y);
+                    });
+                    back.resize(max_links);
+                }
+            }
+            ep = found.front().second;
+        }
+        if (level > max_level) {
+            max_level = level;
+            entry_point = idx;
+        }
+    }
+
+    void build_index() {
+        links.assign(uids.size(), std::vector<std::vector<int>>());
+        entry_point = -1;
+        max_level = 0;
+        for (size_t i = 0; i < uids.size(); ++i) {
+            hnsw_insert(static_cast<int>(i));
+        }
+    }
+
+public:
+    FaceGallery(float threshold = 0.6f, size_t index_min_size = 4096)
+        : match_threshold(threshold), hnsw_min_size(index_min_size),
+          entry_point(-1), max_level(0), hnsw_m(16), ef_construction(100), ef_search(64), rng(42) {}
+
+    void setMatchThreshold(float threshold) { match_threshold = threshold; }
+    float matchThreshold() const { return match_threshold; }
+    void setIndexMinSize(size_t n) { hnsw_min_size = n; }
+    size_t size() const { return uids.size(); }
+    bool indexed() const { return !links.empty(); }
+
+    void clear() {
+        features.clear();
+        uids.clear();
+        links.clear();
+        entry_point = -1;
+        max_level = 0;
+    }
+
+    // 加入一个人脸特征（desc长度必须为kFaceDescriptorDim）
+    void addFace(const std::string& uid, const float* desc) {
+        features.insert(features.end(), desc, desc + kFaceDescriptorDim);
+        uids.push_back(uid);
+        int idx = static_cast<int>(uids.size()) - 1;
+        if (indexed()) {
+            links.push_back(std::vector<std::vector<int>>());
+            hnsw_insert(idx);
+        } else if (uids.size() >= hnsw_min_size) {
+            build_index();
+        }
+    }
+
+    // 查找最近的已知人脸；距离小于阈值返回true，并输出UID和欧氏距离
+    bool findNearest(const float* desc, std::string& uid, float& distance) const {
+        if (uids.empty()) return false;
+
+        int best_idx = -1;
+        float best_sq = std::numeric_limits<float>::max();
+        if (indexed()) {
+            int ep = entry_point;
+            for (int l = max_level; l > 0; --l) {
+                ep = search_layer(desc, ep, 1, l).front().second;
+            }
+            std::vector<std::pair<float, int>> found = search_layer(desc, ep, ef_search, 0);
+            best_sq = found.front().first;
+            best_idx = found.front().second;
+        } else {
+            const size_t n = uids.size();
+            for (size_t i = 0; i < n; ++i) {
+                float d = l2_distance_sq(desc, &features[i * kFaceDescriptorDim], kFaceDescriptorDim);
+                if (d < best_sq) {
+                    best_sq = d;
+                    best_idx = static_cast<int>(i);
+                }
+            }
+        }
+
+        distance = std::sqrt(best_sq);
+        if (distance >= match_threshold) return false;
+        uid = uids[best_idx];
+        return true;
+    }
+};
+
+#endif // FACE_GALLERY_H
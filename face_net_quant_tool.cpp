@@ -0,0 +1,166 @@
+// int8人脸特征网络的校准与精度报告工具
+// 用法：face_net_quant_tool <关键点模型> <识别模型> <人脸图片目录> [校准文件输出路径]
+// 1. 从图片中检测人脸、对齐裁剪成150x150人脸块
+// 2. 用前一半人脸块统计各层激活范围，写出校准文件（供VisionModule::enableQuantizedInference加载）
+// 3. 在全部人脸块上对比float参考（dlib）与int8后端：特征误差、两两比对的匹配结论（阈值0.6）、单张耗时
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_processing.h>
+
+#include "face_recognition_model_v1.h"
+#include "frame_source.h"
+
+namespace {
+
+const float kMatchThreshold = 0.6f;  // 与FaceGallery默认阈值一致
+const size_t kMaxChips = 400;
+
+double elapsed_ms(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+float distance(const dlib::matrix<float, 0, 1>& a, const dlib::matrix<float, 0, 1>& b) {
+    return dlib::length(a - b);
+}
+
+bool load_chips(const std::string& dir, const std::string& landmark_model,
+                std::vector<dlib::matrix<dlib::rgb_pixel>>& chips) {
+    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+    dlib::shape_predictor predictor;
+    try {
+        dlib::deserialize(landmark_model) >> predictor;
+    } catch (std::exception& e) {
+        std::cerr << "关键点模型加载失败：" << e.what() << std::endl;
+        return false;
+    }
+
+    ImageDirSource images(dir);
+    if (!images.isOpened()) {
+        std::cerr << "图片目录打开失败：" << dir << std::endl;
+        return false;
+    }
+    Frame frame;
+    cv::Mat bgr;
+    while (chips.size() < kMaxChips && images.read(frame)) {
+        if (!frame_to_bgr(frame, bgr)) continue;
+        dlib::cv_image<dlib::bgr_pixel> img(bgr);
+        for (const dlib::rectangle& face : detector(img)) {
+            dlib::matrix<dlib::rgb_pixel> chip;
+            dlib::extract_image_chip(img, dlib::get_face_chip_details(predictor(img, face), 150, 0.25), chip);
+            chips.push_back(chip);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "用法：" << argv[0] << " <关键点模型> <识别模型> <人脸图片目录> [校准文件输出路径]" << std::endl;
+        return 1;
+    }
+    const std::string calib_path = argc > 4 ? argv[4] : "face_net_calib.txt";
+
+    dlib::face_recognition_model_v1 model;
+    try {
+        dlib::deserialize(argv[2]) >> model;
+    } catch (std::exception& e) {
+        std::cerr << "识别模型加载失败：" << e.what() << std::endl;
+        return 1;
+    }
+    if (!model.enable_quantized_backend()) {
+        std::cerr << "int8后端构建失败：网络结构与dlib_face_recognition_resnet_model_v1不符" << std::endl;
+        return 1;
+    }
+    QuantizedFaceNet& qnet = *model.quantized_backend();
+
+    std::vector<dlib::matrix<dlib::rgb_pixel>> chips;
+    if (!load_chips(argv[3], argv[1], chips)) return 1;
+    if (chips.size() < 2) {
+        std::cerr << "人脸数不足（" << chips.size() << "张），至少需要2张" << std::endl;
+        return 1;
+    }
+    std::cout << "人脸块：" << chips.size() << "张" << std::endl;
+
+    // ---- 校准 ----
+    const size_t calib_count = (chips.size() + 1) / 2;
+    qnet.resetCalibration();
+    for (size_t i = 0; i < calib_count; ++i) {
+        qnet.calibrate(reinterpret_cast<const uint8_t*>(&chips[i](0, 0)));
+    }
+    if (!qnet.saveCalibration(calib_path)) {
+        std::cerr << "校准文件写入失败：" << calib_path << std::endl;
+        return 1;
+    }
+    std::cout << "校准：" << calib_count << "张，已写入" << calib_path << std::endl;
+
+    // ---- 特征对比 ----
+    const size_t n = chips.size();
+    std::vector<dlib::matrix<float, 0, 1>> ref(n), own(n), q8(n);
+    double ref_ms = 0.0, own_ms = 0.0, q8_ms = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* rgb = reinterpret_cast<const uint8_t*>(&chips[i](0, 0));
+        own[i].set_size(QuantizedFaceNet::kDescriptorDim);
+        q8[i].set_size(QuantizedFaceNet::kDescriptorDim);
+
+        auto t0 = std::chrono::steady_clock::now();
+        ref[i] = model(chips[i]);
+        ref_ms += elapsed_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        qnet.forwardFloat(rgb, &own[i](0));
+        own_ms += elapsed_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        qnet.forward(rgb, &q8[i](0));
+        q8_ms += elapsed_ms(t0);
+    }
+
+    // 权重导入正确时，同一套权重的float实现与dlib只差浮点舍入
+    float import_err = 0.0f, max_dist = 0.0f, max_dim_err = 0.0f;
+    double sum_dist = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        import_err = std::max(import_err, dlib::max(dlib::abs(ref[i] - own[i])));
+        max_dim_err = std::max(max_dim_err, dlib::max(dlib::abs(ref[i] - q8[i])));
+        float d = distance(ref[i], q8[i]);
+        sum_dist += d;
+        max_dist = std::max(max_dist, d);
+    }
+
+    // 两两比对：int8与float的"是否同一人"结论是否一致
+    size_t pairs = 0, flips = 0, ref_matches = 0;
+    float max_pair_delta = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+            float dr = distance(ref[i], ref[j]), dq = distance(q8[i], q8[j]);
+            bool mr = dr < kMatchThreshold, mq = dq < kMatchThreshold;
+            ++pairs;
+            if (mr) ++ref_matches;
+            if (mr != mq) ++flips;
+            max_pair_delta = std::max(max_pair_delta, std::fabs(dr - dq));
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(5);
+    std::cout << "权重导入校验：float实现与dlib最大逐维误差 " << import_err << std::endl;
+    std::cout << "int8特征误差：与dlib的欧氏距离 平均 " << sum_dist / n << " 最大 " << max_dist
+              << "，最大逐维误差 " << max_dim_err << std::endl;
+    std::cout << "匹配结论（阈值" << kMatchThreshold << "）：" << pairs << "对，float判为同一人 " << ref_matches
+              << " 对，int8结论不同 " << flips << " 对（" << (100.0 * flips / pairs) << "%），"
+              << "距离最大偏差 " << max_pair_delta << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "单张耗时：dlib float " << ref_ms / n << " ms，本实现float " << own_ms / n
+              << " ms，int8 " << q8_ms / n << " ms（相对dlib加速 " << (q8_ms > 0 ? ref_ms / q8_ms : 0.0)
+              << " 倍）" << std::endl;
+
+    if (import_err > 1e-3f) {
+        std::cerr << "权重导入有误：float实现与dlib结果不一致" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -6,9 +6,15 @@
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/image_processing/shape_predictor.h>
 #include <dlib/matrix.h>
-#include <dlib/convert_image.h>    // 新增：to_grayscale
+#include <dlib/image_transforms.h>  // extract_image_chips / get_face_chip_details
+#include <dlib/opencv.h>            // cv_image
 #include <dlib/geometry.h>         // 新增：vector/point转换
 #include <vector>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+
+#include "quantized_face_net.h"
 
 // 定义ResNet残差块结构
 template <template <int,template<typename>class,int,typename> class block, int N, template<typename>class BN, typename SUBNET>
@@ -41,26 +47,72 @@ using anet_type = dlib::loss_metric<dlib::fc_no_bias<128,dlib::avg_pool_everythi
                             dlib::input_rgb_image_sized<150>
                             >>>>>>>>>>>>;
 
+// 按层收集anet_type的卷积/affine/全连接参数，供QuantizedFaceNet使用
+// visit_computational_layers从输出层向输入层访问，收集结果为倒序
+struct quantized_weight_collector {
+    struct conv_layer {
+        long filters, rows, cols;
+        std::vector<float> params;  // filters个[输入][行][列]卷积核，之后可能跟filters个偏置
+    };
+    std::vector<conv_layer> convs;
+    std::vector<std::vector<float>> affines;  // 每层[gamma(k), beta(k)]
+    std::vector<float> fc;
+    bool ok = true;
+
+    template <long F, long NR, long NC, int SY, int SX, int PY, int PX>
+    void operator()(dlib::con_<F, NR, NC, SY, SX, PY, PX>& l) {
+        const dlib::tensor& p = l.get_layer_params();
+        convs.push_back(conv_layer{F, NR, NC, std::vector<float>(p.host(), p.host() + p.size())});
+    }
+
+    // affine_不公开gamma/beta，从其序列化数据中取回：版本串之后的params即[gamma, beta]
+    void operator()(dlib::affine_& l) {
+        std::ostringstream out;
+        serialize(l, out);
+        std::istringstream in(out.str());
+        std::string version;
+        dlib::resizable_tensor params;
+        try {
+            dlib::deserialize(version, in);
+            dlib::deserialize(params, in);
+        } catch (std::exception&) {
+            ok = false;
+            return;
+        }
+        if (version.compare(0, 7, "affine_") != 0) ok = false;
+        affines.push_back(std::vector<float>(params.host(), params.host() + params.size()));
+    }
+
+    template <unsigned long N, dlib::fc_bias_mode B>
+    void operator()(dlib::fc_<N, B>& l) {
+        const dlib::tensor& p = l.get_layer_params();
+        fc.assign(p.host(), p.host() + p.size());
+    }
+
+    template <typename T>
+    void operator()(T&) {}  // relu、池化、add_prev等无参数层
+};
+
 // 修复face_recognition_model_v1类
 class face_recognition_model_v1 : public anet_type {
 public:
-    face_recognition_model_v1() = default;
+    face_recognition_model_v1() : quantized_int8(true), mapped_weights(false) {}
     
     template <typename SUBNET>
-    face_recognition_model_v1(const dlib::loss_metric<SUBNET>& net) : anet_type(net) {}
+    face_recognition_model_v1(const dlib::loss_metric<SUBNET>& net)
+        : anet_type(net), quantized_int8(true), mapped_weights(false) {}
 
-    // ========== 修复核心方法：compute_face_descriptor ==========
+    // ========== 单人脸特征 ==========
     // 支持cv_image和matrix输入（兼容vision_module.cpp的调用）
+    // cv_image直接从OpenCV缓冲采样人脸块，不再把整帧拷贝成matrix
     template <typename T>
     dlib::matrix<float, 0, 1> compute_face_descriptor(
         const dlib::cv_image<T>& img,  // 新增：支持cv_image输入
         const dlib::full_object_detection& shape,
         const int num_jitters = 0
-    ) const {
-        // 转换cv_image到matrix（解决参数类型不匹配）
-        dlib::matrix<T> img_mat;
-        dlib::assign_image(img_mat, img);
-        return compute_face_descriptor(img_mat, shape, num_jitters);
+    ) {
+        std::vector<dlib::full_object_detection> shapes(1, shape);
+        return compute_face_descriptors(img, shapes, num_jitters).front();
     }
 
     // 原matrix版本保留（兼容通用场景）
@@ -69,78 +121,212 @@ public:
         const dlib::matrix<T>& img,
         const dlib::full_object_detection& shape,
         const int num_jitters = 0
-    ) const {
-        dlib::matrix<T> face_img;
-        extract_image_chip(img, get_face_chip_details(shape, 150, 0.25), face_img);
-        
-        if (num_jitters == 0) {
-            // 修复to_grayscale调用（移除多余模板参数，适配dlib API）
-            dlib::matrix<dlib::uint8> gray_img;
-            dlib::to_grayscale(face_img, gray_img);  // 正确调用方式
-            return (*this)(dlib::mean(gray_img));
-        } else {
-            dlib::matrix<float, 0, 1> desc;
-            desc.set_size(128, 1);
-            desc = 0;
-            for (int i = 0; i < num_jitters; ++i) {
-                for (int j = 0; j < num_jitters; ++j) {
-                    dlib::matrix<T> temp;
-                    extract_image_chip(img, get_face_chip_details(shape, 150, 0.25, dlib::vector<double,2>(i-num_jitters/2, j-num_jitters/2)), temp);
-                    // 修复to_grayscale调用
-                    dlib::matrix<dlib::uint8> gray_temp;
-                    dlib::to_grayscale(temp, gray_temp);
-                    desc += (*this)(dlib::mean(gray_temp));
-                }
-            }
-            desc /= (num_jitters * num_jitters);
-            return desc;
-        }
+    ) {
+        std::vector<dlib::full_object_detection> shapes(1, shape);
+        return compute_face_descriptors(img, shapes, num_jitters).front();
+    }
+
+    // ========== 多人脸特征（走批量路径）==========
+    template <typename T>
+    std::vector<dlib::matrix<float, 0, 1>> compute_face_descriptor(
+        const dlib::cv_image<T>& img,
+        const std::vector<dlib::full_object_detection>& shapes,
+        const int num_jitters = 0
+    ) {
+        return compute_face_descriptors(img, shapes, num_jitters);
     }
 
-    // 重载：多人脸特征计算
     template <typename T>
     std::vector<dlib::matrix<float, 0, 1>> compute_face_descriptor(
         const dlib::matrix<T>& img,
         const std::vector<dlib::full_object_detection>& shapes,
         const int num_jitters = 0
-    ) const {
+    ) {
+        return compute_face_descriptors(img, shapes, num_jitters);
+    }
+
+    // 批量路径：所有人脸、所有抖动偏移的150x150 RGB人脸块放进同一个vector，一次批量前向
+    // num_jitters为n（n>1）时每张人脸取n*n个像素偏移（-n/2 ~ n-1-n/2）的人脸块，特征取平均
+    // image_type可以是cv_image<bgr_pixel>：按对齐变换直接从原图采样，BGR->RGB在采样时完成
+    template <typename image_type>
+    std::vector<dlib::matrix<float, 0, 1>> compute_face_descriptors(
+        const image_type& img,
+        const std::vector<dlib::full_object_detection>& shapes,
+        const int num_jitters = 0,
+        const size_t batch_size = 16
+    ) {
         std::vector<dlib::matrix<float, 0, 1>> descriptors;
+        compute_face_descriptors(img, shapes, descriptors, num_jitters, batch_size);
+        return descriptors;
+    }
+
+    // 同上，结果写入调用方的缓冲：descriptors已有shapes.size()个同维特征时原地覆盖，
+    // 人脸块、前向输出也在成员缓冲中复用，逐帧调用稳态下不分配；关键点数不支持时返回false且descriptors为空
+    template <typename image_type>
+    bool compute_face_descriptors(
+        const image_type& img,
+        const std::vector<dlib::full_object_detection>& shapes,
+        std::vector<dlib::matrix<float, 0, 1>>& descriptors,
+        const int num_jitters = 0,
+        const size_t batch_size = 16
+    ) {
         for (const auto& shape : shapes) {
-            descriptors.push_back(compute_face_descriptor(img, shape, num_jitters));
+            if (!supports_shape(shape)) {  // 关键点数不对时不出结果，由调用方报错
+                descriptors.clear();
+                return false;
+            }
         }
-        return descriptors;
+        if (shapes.empty()) {
+            descriptors.clear();
+            return true;
+        }
+
+        const int per_face = num_jitters > 1 ? num_jitters * num_jitters : 1;
+        std::vector<dlib::chip_details>& dets = chip_dets;
+        dets.clear();
+        for (const auto& shape : shapes) {
+            // 按关键点对齐（支持68点和5点模型）
+            dlib::chip_details base = dlib::get_face_chip_details(shape, 150, 0.25);
+            if (per_face == 1) {
+                dets.push_back(base);
+                continue;
+            }
+            for (int i = 0; i < num_jitters; ++i) {
+                for (int j = 0; j < num_jitters; ++j) {
+                    dlib::chip_details jittered = base;
+                    jittered.rect = dlib::translate_rect(base.rect, dlib::dpoint(i - num_jitters / 2, j - num_jitters / 2));
+                    dets.push_back(jittered);
+                }
+            }
+        }
+
+        // 人脸块缓冲跨调用复用：尺寸不变时set_size不会重新分配
+        dlib::extract_image_chips(img, dets, chip_buffer);
+        const size_t chips = chip_buffer.size();
+        std::vector<dlib::matrix<float, 0, 1>>& outputs = output_buffer;
+        if (outputs.size() < chips) outputs.resize(chips);  // 只增不减，人脸数波动时不反复释放
+        if (quantized) {
+            static_assert(sizeof(dlib::rgb_pixel) == 3, "rgb_pixel须为紧凑的3字节");
+            for (size_t i = 0; i < chips; ++i) {
+                outputs[i].set_size(QuantizedFaceNet::kDescriptorDim);
+                const uint8_t* rgb = reinterpret_cast<const uint8_t*>(&chip_buffer[i](0, 0));
+                if (quantized_int8) {
+                    quantized->forward(rgb, &outputs[i](0));
+                } else {
+                    quantized->forwardFloat(rgb, &outputs[i](0));
+                }
+            }
+        } else {
+            // 按批前向，输出直接写进复用的特征缓冲（网络的输入张量是成员，也跨调用复用）
+            const size_t step = batch_size > 0 ? batch_size : chips;
+            for (size_t b = 0; b < chips; b += step) {
+                const size_t e = std::min(chips, b + step);
+                (*this)(chip_buffer.begin() + b, chip_buffer.begin() + e, outputs.begin() + b);
+            }
+        }
+
+        if (descriptors.size() != shapes.size()) descriptors.resize(shapes.size());
+        for (size_t f = 0; f < shapes.size(); ++f) {
+            descriptors[f] = outputs[f * per_face];
+            for (int k = 1; k < per_face; ++k) {
+                descriptors[f] += outputs[f * per_face + k];
+            }
+            if (per_face > 1) descriptors[f] /= static_cast<float>(per_face);
+        }
+        return true;
     }
 
-private:
-    // 修复get_face_chip_details（移除cast，改用手动类型转换）
-    template <typename T>
-    dlib::chip_details get_face_chip_details(
-        const dlib::full_object_detection& shape,
-        const int size = 150,
-        const T padding = 0.25,
-        const dlib::vector<T, 2>& offset = dlib::vector<T, 2>(0, 0)
-    ) const {
-        DLIB_CASSERT(shape.num_parts() == 68, "必须是68点人脸关键点");
-        dlib::rectangle r = shape.get_rect();
-        
-        // 修复：手动转换point到vector<T,2>（替代cast）
-        dlib::vector<T, 2> tl(r.tl_corner().x(), r.tl_corner().y());
-        dlib::vector<T, 2> br(r.br_corner().x(), r.br_corner().y());
-        dlib::vector<T, 2> center = (tl + br) / T(2.0);
-        center += offset;
-        
-        // 计算人脸尺寸（带padding）
-        T width = static_cast<T>(r.width()) * (T(1) + padding);
-        T height = static_cast<T>(r.height()) * (T(1) + padding);
-        
-        // 生成chip细节（统一类型）
-        return dlib::chip_details(
-            dlib::point(static_cast<long>(center.x()), static_cast<long>(center.y())),
-            size, size,
-            static_cast<double>(width)/size, 
-            static_cast<double>(height)/size
-        );
+    // 对齐支持dlib的68点和5点关键点模型（5点模型更小更快，对齐精度略低）
+    static bool supports_shape(const dlib::full_object_detection& shape) {
+        return shape.num_parts() == 68 || shape.num_parts() == 5;
+    }
+
+    // ========== 可选int8推理后端 ==========
+    // 用当前已加载的权重构建QuantizedFaceNet，之后compute_face_descriptor(s)改走int8路径
+    // calib_path为face_net_quant_tool生成的校准文件，为空时每层按实际激活范围动态量化
+    // （映射模型文件带有校准范围时沿用文件中的）
+    bool enable_quantized_backend(const std::string& calib_path = "") {
+        if (mapped_weights) {
+            if (!calib_path.empty() && !quantized->loadCalibration(calib_path)) return false;
+            quantized_int8 = true;
+            return true;
+        }
+        quantized_weight_collector collector;
+        dlib::visit_computational_layers(static_cast<anet_type&>(*this), collector);
+        std::reverse(collector.convs.begin(), collector.convs.end());
+        std::reverse(collector.affines.begin(), collector.affines.end());
+        if (!collector.ok || collector.convs.size() != QuantizedFaceNet::kConvCount ||
+            collector.affines.size() != collector.convs.size()) {
+            return false;
+        }
+
+        // 卷积后的affine（推理态BN）折进卷积：w' = gamma * w，b' = gamma * b + beta
+        std::vector<QuantizedFaceNet::ConvParams> params(collector.convs.size());
+        for (size_t i = 0; i < collector.convs.size(); ++i) {
+            const quantized_weight_collector::conv_layer& c = collector.convs[i];
+            const std::vector<float>& aff = collector.affines[i];
+            const size_t F = static_cast<size_t>(c.filters);
+            const size_t taps = static_cast<size_t>(c.rows * c.cols);
+            if (aff.size() != 2 * F) return false;
+            const bool has_bias = c.params.size() % (F * taps) != 0;
+            const size_t per_filter = (c.params.size() - (has_bias ? F : 0)) / F;
+            params[i].weight.resize(F * per_filter);
+            params[i].bias.resize(F);
+            for (size_t f = 0; f < F; ++f) {
+                const float gamma = aff[f], beta = aff[F + f];
+                for (size_t j = 0; j < per_filter; ++j) {
+                    params[i].weight[f * per_filter + j] = gamma * c.params[f * per_filter + j];
+                }
+                params[i].bias[f] = gamma * (has_bias ? c.params[F * per_filter + f] : 0.0f) + beta;
+            }
+        }
+
+        std::shared_ptr<QuantizedFaceNet> net = std::make_shared<QuantizedFaceNet>();
+        if (!net->setWeights(params, collector.fc)) return false;
+        if (!calib_path.empty() && !net->loadCalibration(calib_path)) return false;
+        quantized = net;
+        quantized_int8 = true;
+        return true;
+    }
+
+    void disable_quantized_backend() {
+        if (mapped_weights) {
+            quantized_int8 = false;  // 权重只在映射文件中，退回同一套权重的float实现
+        } else {
+            quantized.reset();
+        }
+    }
+    QuantizedFaceNet* quantized_backend() { return quantized.get(); }
+    bool quantized_active() const { return quantized && quantized_int8; }
+
+    // ========== 从.mrm模型文件加载（model_convert_tool生成） ==========
+    // 不构建dlib网络：特征由QuantizedFaceNet直接在映射的权重上计算，默认走float，enable_quantized_backend后走int8
+    bool load_mapped(const std::string& path) {
+        std::shared_ptr<MappedModelFile> file = std::make_shared<MappedModelFile>();
+        std::shared_ptr<QuantizedFaceNet> net = std::make_shared<QuantizedFaceNet>();
+        if (!file->open(path, "face_net") || !net->attach(file)) return false;
+        quantized = net;
+        quantized_int8 = false;
+        mapped_weights = true;
+        return true;
     }
+    bool mapped() const { return mapped_weights; }
+
+    // 单个150x150人脸块的float参考特征（校验采样路径用）：映射模型用float实现，否则用dlib网络
+    dlib::matrix<float, 0, 1> reference_descriptor(const dlib::matrix<dlib::rgb_pixel>& chip) {
+        if (!mapped_weights) return (*this)(chip);
+        dlib::matrix<float, 0, 1> out(QuantizedFaceNet::kDescriptorDim);
+        quantized->forwardFloat(reinterpret_cast<const uint8_t*>(&chip(0, 0)), &out(0));
+        return out;
+    }
+
+private:
+    std::shared_ptr<QuantizedFaceNet> quantized;
+    bool quantized_int8;   // quantized存在时：true走int8，false走float（仅映射模型）
+    bool mapped_weights;   // 权重来自映射文件，dlib网络为空
+    std::vector<dlib::chip_details> chip_dets;
+    std::vector<dlib::matrix<dlib::rgb_pixel>> chip_buffer;
+    std::vector<dlib::matrix<float, 0, 1>> output_buffer;  // 每个人脸块的前向输出
 };
 
 // 命名空间兼容
@@ -0,0 +1,148 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <dlib/image_processing.h>
+#include <dlib/matrix.h>
+
+#include "alloc_counter.h"
+#include "mapped_shape_predictor.h"
+#include "metrics.h"
+
+// 每帧处理的堆分配统计（需要程序开启alloc_counter.h的计数，否则各计数为0）
+// 计数是全进程的：同一时段采集线程、存图线程的分配也会算进来，离线基准（无采集线程）中最准确
+struct FrameArenaStats {
+    uint64_t frames;            // 统计过的帧数
+    uint64_t allocations;       // 这些帧处理期间的堆分配总次数
+    uint64_t bytes;             // 分配的总字节数
+    uint64_t max_allocations;   // 单帧最多的分配次数
+    uint64_t last_allocations;  // 最近一帧的分配次数
+    uint64_t zero_alloc_frames; // 处理过程中没有任何分配的帧数
+};
+
+// 一帧"检测→关键点→特征"用到的全部工作缓冲，随VisionModule长期持有：
+// 容量只增不减，Mat在尺寸不变（或不超过已有容量，见buffer_view）时复用，人脸个数波动时多出的元素
+// 移到备用池而不是析构，所以稳态下这些环节不再向堆申请内存（长期运行不产生碎片）
+// 仍会分配的：dlib HOG检测器内部的金字塔和特征图、dlib::shape_predictor（.dat关键点模型）的结果、
+// 人脸远大于150像素时extract_image_chips内部的缩小金字塔；parallel_levels>1时另有TaskPool任务队列
+// （deque）偶尔换块，以及ROI使某段层数改变时重建该段检测器（线程本身常驻，见VisionModule::level_pool）
+// 不可跨线程共享：一个VisionModule一个，和VisionModule一样只在一个线程上使用
+class FrameArena {
+public:
+    cv::Mat gray;         // 非BGR帧的整帧亮度
+    cv::Mat region;       // 人脸区域的BGR（YUYV转换或MJPEG整帧解码的缓冲）
+    std::vector<dlib::rectangle> rects;                   // 检测框（原图坐标）
+    std::vector<dlib::rectangle> found;                   // 缩小/裁剪后的检测图上的检测框
+    std::vector<dlib::rect_detection> detections;         // 检测器输出（带置信度；并行检测时为各段合并结果）
+    std::vector<dlib::full_object_detection> shapes;      // 关键点（原图坐标）
+    std::vector<dlib::full_object_detection> local_shapes;// 关键点（人脸区域坐标）
+    std::vector<dlib::full_object_detection> chosen;      // 跟踪重新检测时选中的一张脸
+    std::vector<dlib::matrix<float, 0, 1>> descriptors;
+    std::vector<float> landmark_coords;
+    MappedShapePredictor::Scratch landmark_scratch;
+
+    FrameArena() : depth(0), start_count(0), start_bytes(0), stats_() {}
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // 预先备好max_faces张人脸的容量（parts为关键点数）
+    void reserve(size_t max_faces, unsigned long parts) {
+        rects.reserve(max_faces);
+        found.reserve(max_faces);
+        detections.reserve(max_faces);
+        landmark_coords.reserve(2 * parts);
+        shapes.reserve(max_faces);
+        local_shapes.reserve(max_faces);
+        chosen.reserve(max_faces);
+        spare_shapes.reserve(3 * max_faces);
+        spare_descriptors.reserve(max_faces);
+        descriptors.reserve(max_faces);
+        while (spare_shapes.size() < 3 * max_faces) {
+            spare_shapes.emplace_back(dlib::rectangle(), std::vector<dlib::point>(parts));
+        }
+        while (spare_descriptors.size() < max_faces) {
+            spare_descriptors.emplace_back(static_cast<long>(kDescriptorReserve));
+        }
+    }
+
+    // 把v调整为n个元素：多余的移入备用池，不足的从备用池取（移动只交换内部指针，不分配）
+    void fit(std::vector<dlib::full_object_detection>& v, size_t n) { fit_pool(v, n, spare_shapes); }
+    void fit(std::vector<dlib::matrix<float, 0, 1>>& v, size_t n) { fit_pool(v, n, spare_descriptors); }
+
+    // 原地改写一组关键点：点数不变时复用其存储
+    static void assign_shape(dlib::full_object_detection& shape, const dlib::rectangle& rect, unsigned long parts) {
+        if (shape.num_parts() != parts) shape = dlib::full_object_detection(rect, std::vector<dlib::point>(parts));
+        shape.get_rect() = rect;
+    }
+
+    // 一帧处理的统计范围：在处理一帧的入口构造，嵌套的入口（如watch内再调getFaceDescriptors）只算一帧
+    class FrameScope {
+    public:
+        explicit FrameScope(FrameArena& a) : arena(a) {
+            if (arena.depth++ == 0) {
+                arena.start_count = alloc_stats::allocations();
+                arena.start_bytes = alloc_stats::bytes();
+            }
+        }
+        ~FrameScope() {
+            if (--arena.depth == 0) arena.finish_frame();
+        }
+        FrameScope(const FrameScope&) = delete;
+        FrameScope& operator=(const FrameScope&) = delete;
+
+    private:
+        FrameArena& arena;
+    };
+
+    FrameArenaStats stats() const { return stats_; }
+    void resetStats() { stats_ = FrameArenaStats(); }
+
+private:
+    static const size_t kDescriptorReserve = 128;  // 与ResNet特征维度一致
+
+    std::vector<dlib::full_object_detection> spare_shapes;
+    std::vector<dlib::matrix<float, 0, 1>> spare_descriptors;
+    int depth;
+    uint64_t start_count, start_bytes;
+    FrameArenaStats stats_;
+
+    template <typename T>
+    static void fit_pool(std::vector<T>& v, size_t n, std::vector<T>& spare) {
+        while (v.size() > n) {
+            spare.push_back(std::move(v.back()));
+            v.pop_back();
+        }
+        while (v.size() < n) {
+            if (spare.empty()) {
+                v.emplace_back();
+            } else {
+                v.push_back(std::move(spare.back()));
+                spare.pop_back();
+            }
+        }
+    }
+
+    void finish_frame() {
+        if (!alloc_stats::installed()) {
+            ++stats_.frames;
+            return;
+        }
+        const uint64_t n = alloc_stats::allocations() - start_count;
+        ++stats_.frames;
+        stats_.allocations += n;
+        stats_.bytes += alloc_stats::bytes() - start_bytes;
+        stats_.last_allocations = n;
+        if (n > stats_.max_allocations) stats_.max_allocations = n;
+        if (n == 0) ++stats_.zero_alloc_frames;
+        METRIC_COUNT(FrameAllocations, n);
+    }
+};
+
+#endif // FRAME_ARENA_H
@@ -0,0 +1,207 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+// 帧的像素格式：BGR帧的像素在image中，YUYV/MJPEG帧的原始数据在raw中（可能直接指向驱动缓冲）
+enum class PixelFormat {
+    BGR,
+    YUYV,   // raw为CV_8UC2，每两个像素共用一组UV
+    MJPEG   // raw为1xN的CV_8UC1，存放一帧JPEG码流
+};
+
+// 一帧画面：帧号从1开始单调递增，时间戳为steady_clock微秒
+// 按格式取灰度/彩色请用frame_source.h中的frame_to_gray/frame_to_bgr/frame_region_bgr
+struct Frame {
+    uint64_t id;
+    int64_t timestamp_us;
+    PixelFormat format;
+    cv::Mat image;
+    cv::Mat raw;
+    int source_buffer;  // 占用的驱动缓冲序号（-1为不占用），由帧源在复用该帧时归还
+    Frame() : id(0), timestamp_us(0), format(PixelFormat::BGR), source_buffer(-1) {}
+};
+
+// 采集线程单写、多消费者读的无锁帧环
+// 消费者通过Ref引用（pin）槽位，采集线程跳过被引用的槽位和最新一帧，
+// 所以持有Ref期间图像不会被覆盖，读取也无需拷贝像素
+class FrameRing {
+private:
+    struct Slot {
+        std::atomic<uint64_t> id;   // 0表示空槽或正在写入
+        std::atomic<int> readers;   // 持有该槽位的Ref数量
+        Frame frame;
+    };
+
+public:
+    // 对某一帧的引用，析构时释放槽位；释放后不要再使用从中浅拷贝出的cv::Mat
+    class Ref {
+    public:
+        Ref() : slot(nullptr) {}
+        Ref(Ref&& other) : slot(other.slot) { other.slot = nullptr; }
+        Ref& operator=(Ref&& other) {
+            if (this != &other) {
+                reset();
+                slot = other.slot;
+                other.slot = nullptr;
+            }
+            return *this;
+        }
+        Ref(const Ref&) = delete;
+        Ref& operator=(const Ref&) = delete;
+        ~Ref() { reset(); }
+
+        void reset() {
+            if (slot) {
+                slot->readers.fetch_sub(1, std::memory_order_release);
+                slot = nullptr;
+            }
+        }
+        explicit operator bool() const { return slot != nullptr; }
+        const Frame& operator*() const { return slot->frame; }
+        const Frame* operator->() const { return &slot->frame; }
+
+    private:
+        friend class FrameRing;
+        explicit Ref(Slot* s) : slot(s) {}
+        Slot* slot;
+    };
+
+    // capacity至少为2：最新帧之外还要有一个可写槽位；每多一个同时持有的Ref就要多一个槽位
+    explicit FrameRing(size_t capacity = 4)
+        : slots(new Slot[capacity < 2 ? 2 : capacity]), count(capacity < 2 ? 2 : capacity),
+          published(0), dropped(0), next_id(1), write_pos(0), writing(0), last_slot(count) {
+        for (size_t i = 0; i < count; ++i) {
+            slots[i].id.store(0, std::memory_order_relaxed);
+            slots[i].readers.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    size_t capacity() const { return count; }
+    uint64_t latestId() const { return published.load(std::memory_order_acquire); }
+    uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+
+    // ---- 生产者（仅采集线程调用）----
+
+    // 取一个可写槽位；所有槽位都被引用时返回nullptr（本帧丢弃）
+    // 取得后未commitWrite（如采集失败）的槽位保持为空槽，下次再用
+    Frame* beginWrite() {
+        for (size_t n = 0; n < count; ++n) {
+            size_t idx = (write_pos + n) % count;
+            if (idx == last_slot) continue;  // 保留最新一帧供消费者读取
+            Slot& s = slots[idx];
+            uint64_t old_id = s.id.load(std::memory_order_relaxed);
+            // 先标记写入再检查引用数，与Ref获取时"先加引用再检查帧号"配对，二者至少有一方看到对方
+            s.id.store(0, std::memory_order_seq_cst);
+            if (s.readers.load(std::memory_order_seq_cst) != 0) {
+                s.id.store(old_id, std::memory_order_release);
+                continue;
+            }
+            // 图像数据仍被外部cv::Mat共享时换一块新缓冲，避免覆盖别人手里的像素
+            if (s.frame.image.u && s.frame.image.u->refcount > 1) s.frame.image.release();
+            writing = idx;
+            return &s.frame;
+        }
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // 发布beginWrite取得的帧
+    void commitWrite(int64_t timestamp_us) {
+        Slot& s = slots[writing];
+        uint64_t id = next_id++;
+        s.frame.id = id;
+        s.frame.timestamp_us = timestamp_us;
+        s.id.store(id, std::memory_order_release);
+        last_slot = writing;
+        write_pos = (writing + 1) % count;
+        published.store(id, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+        }
+        wait_cv.notify_all();
+    }
+
+    // ---- 消费者 ----
+
+    // 最新一帧（帧号大于after_id）；没有时最多等待timeout_ms毫秒，超时返回空Ref
+    Ref latest(uint64_t after_id = 0, int timeout_ms = 0) {
+        Ref ref = try_latest(after_id);
+        if (ref || timeout_ms <= 0) return ref;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        while (!(ref = try_latest(after_id))) {
+            if (wait_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+                ref = try_latest(after_id);
+                break;
+            }
+        }
+        return ref;
+    }
+
+    // 指定帧号的帧；已被覆盖时返回空Ref
+    Ref get(uint64_t id) {
+        if (id == 0) return Ref();
+        for (size_t i = 0; i < count; ++i) {
+            if (slots[i].id.load(std::memory_order_acquire) == id) return pin(i, id);
+        }
+        return Ref();
+    }
+
+private:
+    std::unique_ptr<Slot[]> slots;
+    size_t count;
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> dropped;
+    std::mutex wait_mutex;  // 只用于等待首帧/新帧，读写路径不加锁
+    std::condition_variable wait_cv;
+
+    // 以下仅采集线程访问
+    uint64_t next_id;
+    size_t write_pos;
+    size_t writing;
+    size_t last_slot;
+
+    Ref pin(size_t idx, uint64_t id) {
+        Slot& s = slots[idx];
+        s.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (s.id.load(std::memory_order_seq_cst) != id) {
+            s.readers.fetch_sub(1, std::memory_order_release);
+            return Ref();
+        }
+        return Ref(&s);
+    }
+
+    Ref try_latest(uint64_t after_id) {
+        // 扫描与pin之间槽位可能被改写，失败时重扫（采集线程每帧最多改写一个槽位）
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            size_t best = count;
+            uint64_t best_id = after_id;
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t id = slots[i].id.load(std::memory_order_acquire);
+                if (id > best_id) {
+                    best_id = id;
+                    best = i;
+                }
+            }
+            if (best == count) return Ref();
+            Ref ref = pin(best, best_id);
+            if (ref) return ref;
+        }
+        return Ref();
+    }
+};
+
+#endif // FRAME_RING_H
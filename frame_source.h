@@ -0,0 +1,396 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_ring.h"
+
+// 画面来源：摄像头或回放（视频文件、图片目录）
+// read()由采集线程调用，frame可能是环中复用的槽位，实现应复用其缓冲并归还其占用的驱动缓冲
+class FrameSource {
+public:
+    virtual ~FrameSource() {}
+    virtual bool isOpened() const = 0;
+    // 读取下一帧；失败或回放结束返回false
+    virtual bool read(Frame& frame) = 0;
+    // 回放源已读完（摄像头始终为false）
+    virtual bool finished() const { return false; }
+    virtual std::string name() const = 0;
+};
+
+// ---- 按格式取像素（只在需要的地方做颜色转换）----
+// 输出Mat尺寸不变时复用其缓冲（JPEG解码也直接解到原缓冲里），逐帧调用不再分配
+
+// 输出缓冲与别的Mat（如环中的帧）共享数据时先解除共享，避免把像素写进别人的缓冲
+inline void detach_shared(cv::Mat& m) {
+    if (m.u && m.u->refcount > 1) m.release();
+}
+
+// buffer左上角size大小的子矩阵：容量不足时才扩大，尺寸逐帧变化（ROI、人脸区域）时不重新分配
+inline cv::Mat buffer_view(cv::Mat& buffer, cv::Size size, int type) {
+    if (buffer.type() != type || buffer.cols < size.width || buffer.rows < size.height) {
+        buffer.create(std::max(size.height, buffer.rows), std::max(size.width, buffer.cols), type);
+    }
+    return buffer(cv::Rect(0, 0, size.width, size.height));
+}
+
+// 整帧BGR：BGR帧直接共享缓冲，YUYV/MJPEG帧转换或解码
+inline bool frame_to_bgr(const Frame& frame, cv::Mat& bgr) {
+    switch (frame.format) {
+    case PixelFormat::BGR:
+        bgr = frame.image;
+        break;
+    case PixelFormat::YUYV:
+        if (frame.raw.empty()) return false;
+        detach_shared(bgr);
+        cv::cvtColor(frame.raw, bgr, cv::COLOR_YUV2BGR_YUYV);
+        break;
+    case PixelFormat::MJPEG:
+        if (frame.raw.empty()) return false;
+        detach_shared(bgr);
+        cv::imdecode(frame.raw, cv::IMREAD_COLOR, &bgr);
+        break;
+    }
+    return !bgr.empty();
+}
+
+// 整帧灰度（人脸检测和关键点只需要亮度）：YUYV直接取Y分量，MJPEG只解码亮度
+inline bool frame_to_gray(const Frame& frame, cv::Mat& gray) {
+    switch (frame.format) {
+    case PixelFormat::BGR:
+        if (frame.image.empty()) return false;
+        cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
+        break;
+    case PixelFormat::YUYV:
+        if (frame.raw.empty()) return false;
+        cv::extractChannel(frame.raw, gray, 0);
+        break;
+    case PixelFormat::MJPEG:
+        if (frame.raw.empty()) return false;
+        detach_shared(gray);
+        cv::imdecode(frame.raw, cv::IMREAD_GRAYSCALE, &gray);
+        break;
+    }
+    return !gray.empty();
+}
+
+inline cv::Size frame_size(const Frame& frame) {
+    return frame.format == PixelFormat::YUYV ? frame.raw.size() : frame.image.size();
+}
+
+// 只转换roi区域为BGR；roi会被裁剪到画面内（YUYV按偶数列对齐），offset输出实际区域左上角
+// BGR帧返回原缓冲上的子矩阵，不拷贝；buffer非空时YUYV的转换结果和MJPEG的整帧解码放在其中（跨帧复用）
+inline bool frame_region_bgr(const Frame& frame, cv::Rect roi, cv::Mat& bgr, cv::Point& offset,
+                             cv::Mat* buffer = nullptr) {
+    if (frame.format == PixelFormat::MJPEG) {
+        // JPEG无法只解码局部，整帧解码后取子矩阵
+        cv::Mat local;
+        cv::Mat& full = buffer ? *buffer : local;
+        if (!frame_to_bgr(frame, full)) return false;
+        roi &= cv::Rect(0, 0, full.cols, full.rows);
+        if (roi.area() <= 0) return false;
+        bgr = full(roi);
+        offset = roi.tl();
+        return true;
+    }
+
+    cv::Size size = frame_size(frame);
+    roi &= cv::Rect(0, 0, size.width, size.height);
+    if (frame.format == PixelFormat::YUYV) {
+        int x0 = roi.x & ~1;
+        int x1 = std::min((roi.x + roi.width + 1) & ~1, size.width & ~1);
+        roi = cv::Rect(x0, roi.y, x1 - x0, roi.height);
+    }
+    if (roi.area() <= 0) return false;
+    offset = roi.tl();
+    if (frame.format == PixelFormat::BGR) {
+        bgr = frame.image(roi);
+    } else if (buffer) {
+        cv::Mat view = buffer_view(*buffer, roi.size(), CV_8UC3);
+        cv::cvtColor(frame.raw(roi), view, cv::COLOR_YUV2BGR_YUYV);
+        bgr = view;
+    } else {
+        cv::cvtColor(frame.raw(roi), bgr, cv::COLOR_YUV2BGR_YUYV);
+    }
+    return true;
+}
+
+// ---- V4L2 mmap摄像头：驱动缓冲直接挂到Frame::raw上，不做整帧拷贝和颜色转换 ----
+class V4l2Source : public FrameSource {
+private:
+    struct Buffer {
+        void* start;
+        size_t length;
+    };
+
+    std::string device;
+    PixelFormat format;
+    int width;
+    int height;
+    int stride;
+    int fd;
+    std::vector<Buffer> buffers;
+    bool streaming;
+
+    static int xioctl(int fd, unsigned long request, void* arg) {
+        int rc;
+        do {
+            rc = ioctl(fd, request, arg);
+        } while (rc == -1 && errno == EINTR);
+        return rc;
+    }
+
+    bool queue(int index) {
+        v4l2_buffer buf;
+        std::memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = index;
+        return xioctl(fd, VIDIOC_QBUF, &buf) == 0;
+    }
+
+    bool fail(const char* what) {
+        std::cerr << "V4L2 " << what << "失败（" << device << "）：" << strerror(errno) << std::endl;
+        close_device();
+        return false;
+    }
+
+    bool open_device(size_t buffer_count) {
+        fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+        if (fd < 0) return false;
+
+        v4l2_format fmt;
+        std::memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = width;
+        fmt.fmt.pix.height = height;
+        fmt.fmt.pix.pixelformat = (format == PixelFormat::MJPEG) ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
+        fmt.fmt.pix.field = V4L2_FIELD_ANY;
+        if (xioctl(fd, VIDIOC_S_FMT, &fmt) != 0) return fail("设置格式");
+        if (fmt.fmt.pix.pixelformat != (format == PixelFormat::MJPEG ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV)) {
+            errno = EINVAL;
+            return fail("像素格式不支持");
+        }
+        width = fmt.fmt.pix.width;  // 驱动可能调整分辨率
+        height = fmt.fmt.pix.height;
+        stride = fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : width * 2;
+
+        v4l2_requestbuffers req;
+        std::memset(&req, 0, sizeof(req));
+        req.count = buffer_count;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd, VIDIOC_REQBUFS, &req) != 0 || req.count < 2) return fail("申请缓冲");
+
+        for (unsigned i = 0; i < req.count; ++i) {
+            v4l2_buffer buf;
+            std::memset(&buf, 0, sizeof(buf));
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index = i;
+            if (xioctl(fd, VIDIOC_QUERYBUF, &buf) != 0) return fail("查询缓冲");
+            void* start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+            if (start == MAP_FAILED) return fail("映射缓冲");
+            Buffer b = {start, buf.length};
+            buffers.push_back(b);
+            if (!queue(i)) return fail("入队缓冲");
+        }
+
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(fd, VIDIOC_STREAMON, &type) != 0) return fail("开启视频流");
+        streaming = true;
+        return true;
+    }
+
+    void close_device() {
+        if (fd < 0) return;
+        if (streaming) {
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            xioctl(fd, VIDIOC_STREAMOFF, &type);
+            streaming = false;
+        }
+        for (const Buffer& b : buffers) munmap(b.start, b.length);
+        buffers.clear();
+        ::close(fd);
+        fd = -1;
+    }
+
+public:
+    // buffer_count应大于帧环容量，被消费者持有的帧会一直占着驱动缓冲
+    V4l2Source(const std::string& dev, int w = 640, int h = 480,
+               PixelFormat fmt = PixelFormat::YUYV, size_t buffer_count = 6)
+        : device(dev), format(fmt), width(w), height(h), stride(w * 2), fd(-1), streaming(false) {
+        if (!open_device(buffer_count)) close_device();
+    }
+    ~V4l2Source() { close_device(); }
+
+    bool isOpened() const { return streaming; }
+    std::string name() const { return "v4l2:" + device; }
+
+    bool read(Frame& frame) {
+        // 归还该槽位上次占用的驱动缓冲（采集线程复用槽位时已无消费者持有）
+        if (frame.source_buffer >= 0) {
+            queue(frame.source_buffer);
+            frame.source_buffer = -1;
+        }
+        frame.raw.release();
+        frame.image.release();
+        if (!streaming) return false;
+
+        pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0) return false;
+
+        v4l2_buffer buf;
+        std::memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd, VIDIOC_DQBUF, &buf) != 0) return false;
+        if ((buf.flags & V4L2_BUF_FLAG_ERROR) || buf.bytesused == 0) {
+            queue(buf.index);
+            return false;
+        }
+
+        void* data = buffers[buf.index].start;
+        frame.format = format;
+        frame.source_buffer = static_cast<int>(buf.index);
+        if (format == PixelFormat::YUYV) {
+            frame.raw = cv::Mat(height, width, CV_8UC2, data, stride);
+        } else {
+            frame.raw = cv::Mat(1, static_cast<int>(buf.bytesused), CV_8UC1, data);
+        }
+        return true;
+    }
+};
+
+// ---- OpenCV VideoCapture摄像头（非V4L2平台或驱动不支持mmap时的后备）----
+class OpenCvCameraSource : public FrameSource {
+private:
+    cv::VideoCapture cap;
+    int camera_id;
+
+public:
+    OpenCvCameraSource(int cam_id, int w = 640, int h = 480) : camera_id(cam_id) {
+        if (cap.open(camera_id)) {
+            cap.set(cv::CAP_PROP_FRAME_WIDTH, w);
+            cap.set(cv::CAP_PROP_FRAME_HEIGHT, h);
+        }
+    }
+
+    bool isOpened() const { return cap.isOpened(); }
+    std::string name() const { return "opencv:" + std::to_string(camera_id); }
+
+    bool read(Frame& frame) {
+        frame.format = PixelFormat::BGR;
+        frame.raw.release();
+        return cap.read(frame.image) && !frame.image.empty();
+    }
+};
+
+// ---- 视频文件回放 ----
+class VideoFileSource : public FrameSource {
+private:
+    cv::VideoCapture cap;
+    std::string path;
+    bool loop;
+    bool done;
+
+public:
+    VideoFileSource(const std::string& file, bool loop_playback = false)
+        : path(file), loop(loop_playback), done(false) {
+        cap.open(path);
+    }
+
+    bool isOpened() const { return cap.isOpened(); }
+    bool finished() const { return done; }
+    std::string name() const { return "video:" + path; }
+
+    bool read(Frame& frame) {
+        frame.format = PixelFormat::BGR;
+        frame.raw.release();
+        if (done) return false;
+        if (cap.read(frame.image) && !frame.image.empty()) return true;
+        if (loop) {
+            cap.set(cv::CAP_PROP_POS_FRAMES, 0);
+            if (cap.read(frame.image) && !frame.image.empty()) return true;
+        }
+        done = true;
+        return false;
+    }
+};
+
+// ---- 图片目录回放（按文件名排序，支持jpg/png/bmp）----
+class ImageDirSource : public FrameSource {
+private:
+    std::string dir;
+    std::vector<std::string> files;
+    size_t next;
+    bool loop;
+
+    static bool is_image(const std::string& file) {
+        size_t dot = file.find_last_of('.');
+        if (dot == std::string::npos) return false;
+        std::string ext = file.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+    }
+
+public:
+    ImageDirSource(const std::string& directory, bool loop_playback = false)
+        : dir(directory), next(0), loop(loop_playback) {
+        DIR* d = opendir(dir.c_str());
+        if (!d) return;
+        while (dirent* entry = readdir(d)) {
+            std::string file = entry->d_name;
+            if (is_image(file)) files.push_back(dir + "/" + file);
+        }
+        closedir(d);
+        std::sort(files.begin(), files.end());
+    }
+
+    bool isOpened() const { return !files.empty(); }
+    bool finished() const { return !loop && next >= files.size(); }
+    std::string name() const { return "images:" + dir; }
+
+    bool read(Frame& frame) {
+        frame.format = PixelFormat::BGR;
+        frame.raw.release();
+        for (size_t tries = 0; tries < files.size(); ++tries) {
+            if (next >= files.size()) {
+                if (!loop) return false;
+                next = 0;
+            }
+            frame.image = cv::imread(files[next++], cv::IMREAD_COLOR);
+            if (!frame.image.empty()) return true;
+            std::cerr << "图片读取失败：" << files[next - 1] << std::endl;
+        }
+        return false;
+    }
+};
+
+// 默认摄像头：优先V4L2 mmap（/dev/videoN，YUYV），失败时退回OpenCV
+inline std::unique_ptr<FrameSource> open_camera_source(int camera_id, int width = 640, int height = 480) {
+    std::unique_ptr<FrameSource> source(
+        new V4l2Source("/dev/video" + std::to_string(camera_id), width, height, PixelFormat::YUYV));
+    if (!source->isOpened()) {
+        source.reset(new OpenCvCameraSource(camera_id, width, height));
+    }
+    return source;
+}
+
+#endif // FRAME_SOURCE_H
@@ -0,0 +1,161 @@
+#ifndef IMAGE_DEDUP_H
+#define IMAGE_DEDUP_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// 64位差值哈希（dHash）：灰度图按区域平均缩成9x8，每行相邻两格比较亮度得1位
+// 对缩放、JPEG压缩、轻微噪声和整体亮度变化不敏感，同一场景的相邻画面汉明距离通常在几位以内
+inline uint64_t dhash64(const uint8_t* gray, int width, int height, size_t stride) {
+    if (!gray || width < 9 || height < 8) return 0;
+    uint32_t cells[8][9];
+    for (int cy = 0; cy < 8; ++cy) {
+        const int y0 = cy * height / 8, y1 = (cy + 1) * height / 8;
+        for (int cx = 0; cx < 9; ++cx) {
+            const int x0 = cx * width / 9, x1 = (cx + 1) * width / 9;
+            uint32_t sum = 0;
+            for (int y = y0; y < y1; ++y) {
+                const uint8_t* row = gray + static_cast<size_t>(y) * stride;
+                for (int x = x0; x < x1; ++x) sum += row[x];
+            }
+            cells[cy][cx] = sum / static_cast<uint32_t>((y1 - y0) * (x1 - x0));
+        }
+    }
+    uint64_t hash = 0;
+    for (int cy = 0; cy < 8; ++cy) {
+        for (int cx = 0; cx < 8; ++cx) {
+            hash = (hash << 1) | (cells[cy][cx + 1] > cells[cy][cx] ? 1u : 0u);
+        }
+    }
+    return hash;
+}
+
+inline int hamming64(uint64_t a, uint64_t b) { return __builtin_popcountll(a ^ b); }
+
+// 去重参数：与同一用户最近window张、max_age_sec秒内的照片比较，汉明距离不超过max_distance视为重复
+struct ImageDedupOptions {
+    int max_distance;
+    size_t window;
+    int64_t max_age_sec;  // 0为不限
+    ImageDedupOptions() : max_distance(6), window(32), max_age_sec(24 * 3600) {}
+};
+
+struct ImageDedupStats {
+    uint64_t lookups;     // 查询次数
+    uint64_t hits;        // 复用已有照片的次数（省下的写盘次数）
+    uint64_t registered;  // 新登记的照片数
+    uint64_t evicted;     // 因照片文件已不存在而撤销的登记数
+    size_t users;
+    size_t entries;
+};
+
+// 按用户保存最近照片的哈希和路径（常驻内存，持久化由MemoryDB的image_hash表负责）
+class ImageDedupIndex {
+private:
+    struct Entry {
+        uint64_t hash;
+        std::string path;
+        int64_t timestamp;
+    };
+    struct UserRing {
+        std::vector<Entry> ring;
+        size_t head;
+        UserRing() : head(0) {}
+    };
+
+    ImageDedupOptions opts;
+    std::unordered_map<std::string, UserRing> users;
+    size_t total_entries;
+    ImageDedupStats stats;
+    std::mutex mutex;
+
+public:
+    explicit ImageDedupIndex(const ImageDedupOptions& options = ImageDedupOptions())
+        : opts(options), total_entries(0), stats() {}
+
+    void configure(const ImageDedupOptions& options) {
+        std::lock_guard<std::mutex> lock(mutex);
+        opts = options;
+        users.clear();
+        total_entries = 0;
+    }
+
+    const ImageDedupOptions& options() const { return opts; }
+
+    // 找该用户最近的相似照片（距离最小者）；now用于判断是否过期
+    bool find(const std::string& uid, uint64_t hash, int64_t now, std::string& path, int& distance) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.lookups;
+        auto it = users.find(uid);
+        if (it == users.end()) return false;
+        int best = opts.max_distance + 1;
+        const Entry* match = nullptr;
+        for (const Entry& e : it->second.ring) {
+            if (opts.max_age_sec > 0 && now - e.timestamp > opts.max_age_sec) continue;
+            int d = hamming64(hash, e.hash);
+            if (d < best) {
+                best = d;
+                match = &e;
+            }
+        }
+        if (!match) return false;
+        ++stats.hits;
+        path = match->path;
+        distance = best;
+        return true;
+    }
+
+    // 登记一张新写入的照片（超过window张时覆盖该用户最旧的一张）
+    void add(const std::string& uid, uint64_t hash, const std::string& path, int64_t timestamp,
+             bool count_stats = true) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (opts.window == 0) return;
+        UserRing& u = users[uid];
+        Entry e = {hash, path, timestamp};
+        if (u.ring.size() < opts.window) {
+            u.ring.push_back(e);
+            ++total_entries;
+        } else {
+            u.ring[u.head] = e;
+            u.head = (u.head + 1) % opts.window;
+        }
+        if (count_stats) ++stats.registered;
+    }
+
+    // 撤销该用户指向path的登记（照片文件已被删除）；撤销的是刚才find的命中，
+    // 那次查询不计入统计（调用方接着重新查询会再计一次）
+    void evict(const std::string& uid, const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = users.find(uid);
+        if (it == users.end()) return;
+        UserRing& u = it->second;
+        // 先转成从旧到新的顺序（head归0），删除后add仍按顺序追加、满后覆盖最旧的
+        std::rotate(u.ring.begin(), u.ring.begin() + u.head, u.ring.end());
+        u.head = 0;
+        size_t before = u.ring.size();
+        u.ring.erase(std::remove_if(u.ring.begin(), u.ring.end(), [&](const Entry& e) { return e.path == path; }),
+                     u.ring.end());
+        size_t removed = before - u.ring.size();
+        if (removed == 0) return;
+        total_entries -= removed;
+        stats.evicted += removed;
+        if (stats.hits > 0) --stats.hits;
+        if (stats.lookups > 0) --stats.lookups;
+        if (u.ring.empty()) users.erase(it);
+    }
+
+    ImageDedupStats snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ImageDedupStats s = stats;
+        s.users = users.size();
+        s.entries = total_entries;
+        return s;
+    }
+};
+
+#endif // IMAGE_DEDUP_H
@@ -0,0 +1,389 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_ring.h"
+#include "metrics.h"
+#include "mpsc_queue.h"
+
+// 后台存图参数
+struct ImageWriterOptions {
+    size_t queue_capacity;  // 排队中的照片上限（同时也是像素缓冲池大小），满时新照片直接丢弃
+    int jpeg_quality;       // JPEG质量（1~100）
+    bool reencode_mjpeg;    // MJPEG帧默认原样落盘（不解码不重编码），为true时按jpeg_quality重新编码
+    int fsync_every;        // 累计写入多少个文件后fsync一次（0为不主动fsync，交给内核回写）
+    int fsync_interval_ms;  // 有未fsync的文件时，最长间隔多久fsync一次
+    int thumbnail_width;    // 大于0时另存同名_thumb.jpg缩略图（按宽度等比缩放）
+    int thumbnail_quality;
+    ImageWriterOptions()
+        : queue_capacity(8), jpeg_quality(90), reencode_mjpeg(false), fsync_every(8), fsync_interval_ms(2000),
+          thumbnail_width(0), thumbnail_quality(75) {}
+};
+
+struct ImageWriterStats {
+    uint64_t submitted;   // 入队的照片数
+    uint64_t written;     // 成功写入的照片数
+    uint64_t dropped;     // 队列满被丢弃的照片数
+    uint64_t failed;      // 编码或写入失败的照片数
+    uint64_t fsyncs;      // fsync批次数
+    uint64_t bytes;       // 写入字节数（含缩略图）
+    double encode_ms;     // 累计编码耗时
+    double write_ms;      // 累计写文件耗时（不含fsync）
+};
+
+// 异步存图：调用方只拷贝像素入队，立即拿到最终路径的future；
+// 后台线程完成颜色转换、JPEG编码（复用编码缓冲）、写文件和批量fsync
+// future在文件写入（进入页缓存）后兑现，fsync按批完成；flush()等待全部落盘
+class AsyncImageWriter {
+public:
+    explicit AsyncImageWriter(const std::string& dir, const ImageWriterOptions& options = ImageWriterOptions())
+        : save_dir(dir), opts(options), stop(false), submitted_count(0), finished_count(0), flush_target(0),
+          synced_count(0), sequence(0), stats_() {}
+
+    ~AsyncImageWriter() { shutdown(); }
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    // 后台线程启动前调用有效（之后的修改需先shutdown）
+    void setOptions(const ImageWriterOptions& options) {
+        if (!worker.joinable()) opts = options;
+    }
+    const ImageWriterOptions& options() const { return opts; }
+
+    // 拍照入队：只做一次像素拷贝（MJPEG为压缩数据），不做任何磁盘I/O
+    // 失败（画面为空、队列满）时返回的future立即得到空字符串
+    std::future<std::string> submit(const Frame& frame) {
+        std::promise<std::string> result;
+        std::future<std::string> path = result.get_future();
+        const cv::Mat& pixels = frame.format == PixelFormat::BGR ? frame.image : frame.raw;
+        if (pixels.empty()) {
+            std::cerr << "画面为空，无法保存！" << std::endl;
+            result.set_value("");
+            return path;
+        }
+        start();
+
+        Job* job = take_job();
+        if (!job) {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            ++stats_.dropped;
+            std::cerr << "存图队列已满，丢弃本次照片" << std::endl;
+            result.set_value("");
+            return path;
+        }
+        job->format = frame.format;
+        pixels.copyTo(job->pixels);  // 尺寸不变时复用池中缓冲
+        job->name = next_name();
+        job->done = std::move(result);
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            ++stats_.submitted;
+        }
+        ++submitted_count;
+        queue->try_push(job);  // 任务总数不超过队列容量，不会失败
+        {
+            // 后台线程在mutex_下检查队列后才睡眠：先取放一次锁再通知，唤醒不会落在检查与睡眠之间而丢失
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_one();
+        return path;
+    }
+
+    // 等待已入队的照片全部写入并fsync
+    void flush() {
+        if (!worker.joinable()) return;
+        uint64_t target = submitted_count.load();
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (flush_target.load() < target) flush_target = target;
+        cv_.notify_one();
+        flushed_cv.wait(lock, [this, target] { return synced_count.load() >= target; });
+    }
+
+    // 写完剩余照片后停止后台线程
+    void shutdown() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop = true;
+        }
+        cv_.notify_one();
+        worker.join();
+        stop = false;
+    }
+
+    ImageWriterStats stats() const {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        return stats_;
+    }
+
+private:
+    struct Job {
+        PixelFormat format;
+        cv::Mat pixels;  // BGR图像，或YUYV/MJPEG原始数据
+        std::string name;
+        std::promise<std::string> done;
+        Job() : format(PixelFormat::BGR) {}
+    };
+
+    std::string save_dir;
+    ImageWriterOptions opts;
+
+    std::vector<std::unique_ptr<Job>> jobs;  // 任务池：像素缓冲随任务复用
+    std::vector<Job*> free_jobs;
+    std::mutex pool_mutex;
+    std::unique_ptr<MpscQueue<Job*>> queue;
+
+    std::thread worker;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable flushed_cv;
+    bool stop;
+    std::atomic<uint64_t> submitted_count;
+    std::atomic<uint64_t> finished_count;  // 已写入（或失败）的照片数
+    std::atomic<uint64_t> flush_target;
+    std::atomic<uint64_t> synced_count;    // 已fsync（或无需fsync）的照片数
+    std::atomic<uint64_t> sequence;
+
+    mutable std::mutex stats_mutex;
+    ImageWriterStats stats_;
+
+    // 以下仅后台线程使用
+    cv::Mat bgr, thumb;
+    std::vector<uchar> encoded;  // 编码缓冲，容量跨照片复用
+    std::vector<int> unsynced_fds;
+    std::chrono::steady_clock::time_point first_unsynced;
+
+    void start() {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (worker.joinable()) return;
+        const size_t capacity = opts.queue_capacity > 0 ? opts.queue_capacity : 1;
+        queue.reset(new MpscQueue<Job*>(capacity));
+        jobs.clear();
+        free_jobs.clear();
+        for (size_t i = 0; i < capacity; ++i) {
+            jobs.emplace_back(new Job());
+            free_jobs.push_back(jobs.back().get());
+        }
+        worker = std::thread(&AsyncImageWriter::run, this);
+    }
+
+    Job* take_job() {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (free_jobs.empty()) return nullptr;
+        Job* job = free_jobs.back();
+        free_jobs.pop_back();
+        return job;
+    }
+
+    void return_job(Job* job) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        free_jobs.push_back(job);
+    }
+
+    // img_<秒>_<毫秒>_<序号>.jpg：序号进程内递增，写入时再以O_EXCL防止与已有文件（如重启前）重名
+    std::string next_name() {
+        auto now = std::chrono::system_clock::now();
+        int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "img_%lld_%03d_%llu", static_cast<long long>(ms / 1000),
+                      static_cast<int>(ms % 1000), static_cast<unsigned long long>(++sequence));
+        return buf;
+    }
+
+    void run() {
+        Job* job = nullptr;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait_for(lock, std::chrono::milliseconds(opts.fsync_interval_ms > 0 ? opts.fsync_interval_ms : 1000),
+                             [this] {
+                                 return stop || queue->size_approx() > 0 ||
+                                        flush_target.load() > synced_count.load();
+                             });
+            }
+            while (queue->try_pop(job)) {
+                process(*job);
+                return_job(job);
+            }
+
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping = stop;
+            }
+            const bool flushing = flush_target.load() > synced_count.load();
+            const bool due = !unsynced_fds.empty() &&
+                             (static_cast<int>(unsynced_fds.size()) >= opts.fsync_every ||
+                              std::chrono::steady_clock::now() - first_unsynced >=
+                                  std::chrono::milliseconds(opts.fsync_interval_ms));
+            if (stopping || flushing || due) sync_files();
+            if (unsynced_fds.empty()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    synced_count = finished_count.load();
+                }
+                flushed_cv.notify_all();
+            }
+            if (stopping && queue->size_approx() == 0) break;
+        }
+    }
+
+    void process(Job& job) {
+        const std::string base = save_dir + "/" + job.name;
+        auto t0 = std::chrono::steady_clock::now();
+        bool ok = true;
+        const uchar* data = nullptr;
+        size_t size = 0;
+        const std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, opts.jpeg_quality};
+        if (job.format == PixelFormat::MJPEG && !opts.reencode_mjpeg) {
+            data = job.pixels.ptr<uchar>();
+            size = job.pixels.total() * job.pixels.elemSize();
+        } else {
+            ok = to_bgr(job) && cv::imencode(".jpg", bgr, encoded, params);
+            data = encoded.data();
+            size = encoded.size();
+        }
+        double encode_ms = elapsed_ms(t0);
+        metrics::record_ms(metrics::Stage::ImageEncode, encode_ms);
+
+        std::string path;
+        t0 = std::chrono::steady_clock::now();
+        uint64_t bytes = 0;
+        if (ok) ok = write_file(base, data, size, path);
+        if (ok) bytes += size;
+        if (ok && opts.thumbnail_width > 0) {
+            // 缩略图失败不影响原图
+            std::string thumb_path;
+            if (encode_thumbnail(job) && write_file(thumb_base(path), encoded.data(), encoded.size(), thumb_path)) {
+                bytes += encoded.size();
+            } else {
+                std::cerr << "缩略图保存失败：" << path << std::endl;
+            }
+        }
+        double write_ms = elapsed_ms(t0);
+        metrics::record_ms(metrics::Stage::ImageWrite, write_ms);
+        if (ok) METRIC_COUNT(ImagesWritten, 1);
+        if (!ok) std::cerr << "图片保存失败！路径：" << base << ".jpg" << std::endl;
+
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            if (ok) {
+                ++stats_.written;
+            } else {
+                ++stats_.failed;
+            }
+            stats_.bytes += bytes;
+            stats_.encode_ms += encode_ms;
+            stats_.write_ms += write_ms;
+        }
+        ++finished_count;
+        job.done.set_value(ok ? path : "");
+        job.done = std::promise<std::string>();
+    }
+
+    bool to_bgr(const Job& job) {
+        switch (job.format) {
+        case PixelFormat::BGR:
+            bgr = job.pixels;
+            break;
+        case PixelFormat::YUYV:
+            cv::cvtColor(job.pixels, bgr, cv::COLOR_YUV2BGR_YUYV);
+            break;
+        case PixelFormat::MJPEG:
+            bgr = cv::imdecode(job.pixels, cv::IMREAD_COLOR);
+            break;
+        }
+        return !bgr.empty();
+    }
+
+    bool encode_thumbnail(const Job& job) {
+        // MJPEG原样落盘时没有解码过，按1/4尺寸解码即可
+        if (job.format == PixelFormat::MJPEG && !opts.reencode_mjpeg) {
+            bgr = cv::imdecode(job.pixels, cv::IMREAD_REDUCED_COLOR_4);
+        }
+        if (bgr.empty()) return false;
+        const int w = std::min(opts.thumbnail_width, bgr.cols);
+        const int h = std::max(1, bgr.rows * w / bgr.cols);
+        cv::resize(bgr, thumb, cv::Size(w, h), 0, 0, cv::INTER_AREA);
+        const std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, opts.thumbnail_quality};
+        return cv::imencode(".jpg", thumb, encoded, params);
+    }
+
+    static std::string thumb_base(const std::string& path) {
+        return path.substr(0, path.size() - 4) + "_thumb";  // 去掉.jpg
+    }
+
+    // 以O_EXCL创建文件，重名时追加_1、_2...；需要fsync时保留描述符到下一批
+    bool write_file(const std::string& base, const uchar* data, size_t size, std::string& path) {
+        int fd = -1;
+        for (int attempt = 0; attempt < 100 && fd < 0; ++attempt) {
+            path = base + (attempt ? "_" + std::to_string(attempt) : "") + ".jpg";
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd < 0 && errno != EEXIST) return false;
+        }
+        if (fd < 0) return false;
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::write(fd, data + done, size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ::close(fd);
+                ::unlink(path.c_str());
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        if (opts.fsync_every <= 0) {
+            ::close(fd);
+            return true;
+        }
+        if (unsynced_fds.empty()) first_unsynced = std::chrono::steady_clock::now();
+        unsynced_fds.push_back(fd);
+        return true;
+    }
+
+    // 一批文件逐个fsync后再fsync目录（新建的目录项也要落盘）
+    void sync_files() {
+        if (unsynced_fds.empty()) return;
+        for (int fd : unsynced_fds) {
+            if (::fsync(fd) != 0) std::cerr << "图片fsync失败：" << std::strerror(errno) << std::endl;
+            ::close(fd);
+        }
+        unsynced_fds.clear();
+        int dir_fd = ::open(save_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        ++stats_.fsyncs;
+    }
+
+    static double elapsed_ms(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+};
+
+#endif // IMAGE_WRITER_H
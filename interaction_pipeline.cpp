@@ -0,0 +1,269 @@
+#include "interaction_pipeline.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <utility>
+
+#include "metrics.h"
+
+std::string scene_tag_for(const std::string& user_text) {
+    if (user_text.find("绘本") != std::string::npos || user_text.find("书") != std::string::npos) {
+        return "绘本讲解";
+    }
+    if (user_text.find("小狗") != std::string::npos || user_text.find("猫") != std::string::npos) {
+        return "物品识别-宠物";
+    }
+    return "日常对话";
+}
+
+// 一次交互的状态；各阶段之间的先后由任务图保证，只有待播报的句子在大模型和TTS之间并发传递，
+// 以及“开始出声”这一事件从TTS传给存储
+struct InteractionPipeline::Session {
+    InteractionResult& result;
+    std::chrono::steady_clock::time_point start;
+    bool streaming;  // 大模型输出边生成边切句交给TTS
+    IdentifiedUser user;
+    std::vector<ConversationMem> context;
+    bool recognized;
+    bool answered;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> sentences;
+    bool closed;
+    bool audio_started;  // 第一段语音已播出（或播报已结束而没有出声），存储可以开始
+
+    Session(InteractionResult& r, bool stream)
+        : result(r), start(std::chrono::steady_clock::now()), streaming(stream), recognized(false), answered(false),
+          closed(false), audio_started(false) {}
+
+    double elapsed_ms() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void say(std::string sentence) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sentences.push_back(std::move(sentence));
+        }
+        cv_.notify_all();
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed = true;
+        }
+        cv_.notify_all();
+    }
+
+    void start_audio() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (audio_started) return;
+            audio_started = true;
+        }
+        cv_.notify_all();
+    }
+
+    void wait_audio() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return audio_started; });
+    }
+
+    // 取下一句；没有更多句子时返回false
+    bool next(std::string& sentence) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return closed || !sentences.empty(); });
+        if (sentences.empty()) return false;
+        sentence = std::move(sentences.front());
+        sentences.pop_front();
+        return true;
+    }
+};
+
+InteractionPipeline::InteractionPipeline(MemoryDB& db, const InteractionServices& services,
+                                         const PipelineOptions& options)
+    : db_(db), services_(services), opts(options), pool(options.overlap ? options.workers : 1) {}
+
+// 识别用户并预取最近的上下文（录音期间完成，大模型请求时不再等数据库）
+bool InteractionPipeline::identify(Session& s) {
+    InteractionResult& r = s.result;
+    if (!services_.identifier || !services_.identifier->identify(s.user) || s.user.uid.empty()) {
+        r.face_found = false;
+        return false;
+    }
+    r.face_found = true;
+    r.uid = s.user.uid;
+    db_.getUserContextMem(r.uid, opts.context_top_k, s.context);
+    r.identified_ms = s.elapsed_ms();
+    return true;
+}
+
+bool InteractionPipeline::listen(Session& s) {
+    InteractionResult& r = s.result;
+    if (!services_.recorder || !services_.recognizer) return false;
+    AudioClip clip;
+    {
+        METRIC_TIME(AudioRecord);
+        if (!services_.recorder->record(clip)) {
+            std::cerr << "录音失败！" << std::endl;
+            return false;
+        }
+    }
+    {
+        METRIC_TIME(SpeechRecognize);
+        if (!services_.recognizer->transcribe(clip, r.user_text) || r.user_text.empty()) {
+            std::cerr << "语音识别失败！" << std::endl;
+            return false;
+        }
+    }
+    r.scene_tag = scene_tag_for(r.user_text);
+    r.recognized_ms = s.elapsed_ms();
+    s.recognized = true;
+    return true;
+}
+
+// 调用大模型，回复按句交给TTS；结束时关闭句子队列（失败时先放入兜底回复）
+bool InteractionPipeline::think(Session& s) {
+    InteractionResult& r = s.result;
+    if (!r.face_found || !s.recognized || !services_.chat) {
+        s.say(r.face_found ? opts.failure_reply : opts.no_face_reply);
+        s.close();
+        return false;
+    }
+    if (opts.relevant_context) {
+        std::vector<ConversationMem> relevant =
+            db_.retrieveRelevantMem(r.uid, r.user_text, opts.context_top_k, opts.context_chars);
+        if (!relevant.empty()) s.context.swap(relevant);
+    }
+    r.context_rows = s.context.size();
+
+    ChatRequest request;
+    request.uid = r.uid;
+    request.user_text = r.user_text;
+    request.scene_tag = r.scene_tag;
+    request.context.swap(s.context);
+    request.image = s.user.image;
+
+    SentenceSplitter splitter(opts.sentence_max_bytes);
+    std::vector<std::string> ready;
+    bool spoken = false;
+    auto on_delta = [&](const std::string& delta) {
+        if (r.first_delta_ms == 0) r.first_delta_ms = s.elapsed_ms();
+        if (!s.streaming) return true;
+        splitter.push(delta, ready);
+        for (std::string& sentence : ready) s.say(std::move(sentence));
+        spoken = spoken || !ready.empty();
+        ready.clear();
+        return true;
+    };
+    bool ok;
+    {
+        METRIC_TIME(ChatReply);
+        ok = services_.chat->chat(request, on_delta, r.answer) && !r.answer.empty();
+    }
+    if (ok) {
+        if (s.streaming) {
+            splitter.finish(ready);
+            for (std::string& sentence : ready) s.say(std::move(sentence));
+        } else {
+            s.say(r.answer);
+        }
+        r.answered_ms = s.elapsed_ms();
+        s.answered = true;
+    } else {
+        std::cerr << "大模型调用失败！" << std::endl;
+        if (!spoken) s.say(opts.failure_reply);
+    }
+    s.close();
+    return ok;
+}
+
+// 逐句合成播放，直到句子队列关闭；第一段语音播出时放行存储
+void InteractionPipeline::speak(Session& s) {
+    InteractionResult& r = s.result;
+    std::string sentence;
+    auto on_first_audio = [&] {
+        if (r.first_audio_ms != 0) return;
+        r.first_audio_ms = s.elapsed_ms();
+        metrics::record_ms(metrics::Stage::FirstAudio, r.first_audio_ms);
+        s.start_audio();
+    };
+    while (s.next(sentence)) {
+        if (services_.synthesizer && !services_.synthesizer->speak(sentence, on_first_audio)) {
+            std::cerr << "语音播报失败：" << sentence << std::endl;
+        }
+        ++r.sentences;
+    }
+    r.spoken_ms = s.elapsed_ms();
+    s.start_audio();  // 没有TTS或全部合成失败时不会有首音，播报结束后同样放行存储
+}
+
+// 保存本次交互（照片此时通常早已写完；等待它不在播报的关键路径上）
+bool InteractionPipeline::store(Session& s) {
+    InteractionResult& r = s.result;
+    if (!s.answered) return false;
+    if (s.user.image.valid()) {
+        r.image_path = s.user.image.get();
+        if (!r.image_path.empty() && s.user.image_hash != 0 && !s.user.image_reused) {
+            db_.registerImage(r.uid, s.user.image_hash, r.image_path);
+        }
+    }
+    ConversationMem mem;
+    mem.uid = r.uid;
+    mem.user_text = r.user_text;
+    mem.robot_text = r.answer;
+    mem.timestamp = time(nullptr);
+    mem.scene_tag = r.scene_tag;
+    mem.is_core = 1;  // 与main_loop一致：交互记忆长久保留
+    mem.image_path = r.image_path;
+    r.saved = db_.saveConversationMem(mem);
+    r.saved_ms = s.elapsed_ms();
+    return r.saved;
+}
+
+// 对照基线：与main_loop相同的顺序，每一步等上一步结束；拍照同步等待写完，完整回复后才开始播报
+bool InteractionPipeline::run_serial(Session& s) {
+    if (!identify(s)) {
+        s.say(opts.no_face_reply);
+        s.close();
+        speak(s);
+        return false;
+    }
+    if (s.user.image.valid()) s.user.image.get();
+    listen(s);
+    bool ok = think(s);
+    speak(s);
+    return store(s) && ok;
+}
+
+bool InteractionPipeline::run_overlapped(Session& s) {
+    bool identified = false, recognized = false, answered = false, saved = false;
+    TaskGraph graph(pool);
+    TaskGraph::Node who = graph.add([&] { identified = identify(s); });
+    TaskGraph::Node hear = graph.add([&] { recognized = listen(s); });
+    TaskGraph::Node reply = graph.add([&] { answered = think(s); }, {who, hear});
+    graph.add([&] { speak(s); }, {who, hear});
+    // 存储依赖完整回复，并等第一段语音播出后才写库：写库不与首句合成争抢，之后与其余句子的播报并行
+    // （等待期间占一个工作线程；此时大模型节点已结束，线程池2个线程即够）
+    graph.add([&] {
+        s.wait_audio();
+        saved = store(s);
+    }, {reply});
+    graph.run();
+    return identified && recognized && answered && saved;
+}
+
+bool InteractionPipeline::runOnce(InteractionResult& result) {
+    result = InteractionResult();
+    Session s(result, opts.overlap);
+    bool ok = opts.overlap ? run_overlapped(s) : run_serial(s);
+    result.total_ms = s.elapsed_ms();
+    metrics::record_ms(metrics::Stage::Interaction, result.total_ms);
+    return ok;
+}
@@ -0,0 +1,141 @@
+#ifndef INTERACTION_PIPELINE_H
+#define INTERACTION_PIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "memory_db.h"
+#include "speech_services.h"
+#include "task_graph.h"
+
+// 识别到的当前用户，以及本次交互的照片
+struct IdentifiedUser {
+    std::string uid;
+    std::shared_future<std::string> image;  // 照片写入后得到路径；不拍照时为无效future
+    uint64_t image_hash;                    // 非0时存储阶段用它登记新照片（照片去重）
+    bool image_reused;                      // 照片是已登记的相似旧照片，不需要再登记
+    IdentifiedUser() : image_hash(0), image_reused(false) {}
+};
+
+// 视觉一侧：取一帧、识别用户并拍照（拍照只入队，编码写盘在后台进行）
+// 基于VisionModule的实现见vision_identifier.h；没看到人脸时返回false
+class UserIdentifier {
+public:
+    virtual ~UserIdentifier() {}
+    virtual bool identify(IdentifiedUser& user) = 0;
+};
+
+// 桩实现：delay_ms后返回固定UID，照片为立即就绪的给定路径（空则不拍照）
+class StubIdentifier : public UserIdentifier {
+public:
+    StubIdentifier(double delay_ms = 400.0, const std::string& uid = "stub_user", const std::string& image_path = "")
+        : delay(delay_ms), uid_(uid), image_path_(image_path) {}
+    bool identify(IdentifiedUser& user) override {
+        stub_sleep_ms(delay);
+        user = IdentifiedUser();
+        user.uid = uid_;
+        if (!image_path_.empty()) {
+            std::promise<std::string> ready;
+            ready.set_value(image_path_);
+            user.image = ready.get_future().share();
+        }
+        return true;
+    }
+
+private:
+    double delay;
+    std::string uid_, image_path_;
+};
+
+// 交互中用到的各个服务（调用方持有，生命周期长于流水线）
+struct InteractionServices {
+    UserIdentifier* identifier;
+    AudioRecorder* recorder;
+    SpeechRecognizer* recognizer;
+    ChatModel* chat;
+    SpeechSynthesizer* synthesizer;
+    InteractionServices() : identifier(nullptr), recorder(nullptr), recognizer(nullptr), chat(nullptr), synthesizer(nullptr) {}
+};
+
+struct PipelineOptions {
+    bool overlap;                 // false时按方案.md中main_loop的顺序逐步执行（作为对照基线）
+    size_t workers;               // 线程池大小（重叠模式下同时运行的阶段最多2个）
+    int context_top_k;            // 带给大模型的历史记忆条数
+    size_t context_chars;         // 相关性检索的字数预算（0为不限）
+    bool relevant_context;        // 识别出文字后改用相关性检索（检索不到时用预取的最近记忆）
+    size_t sentence_max_bytes;    // 长句在逗号处提前切给TTS的长度
+    std::string no_face_reply;    // 没看到人脸时的播报
+    std::string failure_reply;    // 识别或大模型失败时的播报
+    PipelineOptions()
+        : overlap(true), workers(2), context_top_k(5), context_chars(600), relevant_context(true),
+          sentence_max_bytes(60), no_face_reply("没看到你哦，靠近一点吧～"),
+          failure_reply("我刚才走神了，能再说一遍吗？") {}
+};
+
+// 一次交互的结果和各阶段耗时（毫秒，均从交互开始计；未执行的阶段为0）
+struct InteractionResult {
+    bool face_found;
+    bool saved;
+    std::string uid;
+    std::string user_text;
+    std::string answer;
+    std::string scene_tag;
+    std::string image_path;
+    size_t context_rows;
+    size_t sentences;
+    double identified_ms;   // 用户识别+上下文预取完成
+    double recognized_ms;   // 录音+ASR完成
+    double first_delta_ms;  // 大模型第一段输出
+    double answered_ms;     // 大模型完整回复
+    double first_audio_ms;  // 第一段语音播出（端到端首音延迟）
+    double spoken_ms;       // 播报结束
+    double saved_ms;        // 记忆写入完成
+    double total_ms;
+    InteractionResult()
+        : face_found(false), saved(false), context_rows(0), sentences(0), identified_ms(0), recognized_ms(0),
+          first_delta_ms(0), answered_ms(0), first_audio_ms(0), spoken_ms(0), saved_ms(0), total_ms(0) {}
+};
+
+// 交互流水线：把"识别用户→拍照→录音→ASR→大模型→TTS→存储"组织成任务图并行执行
+//   识别用户（含上下文预取、拍照入队） ─┐
+//   录音 → ASR                         ─┴→ 大模型（流式，按句切分）→ 存储（TTS已开始播报后）
+//                                         └→ TTS（逐句合成播放，与大模型后续输出并行）
+// 照片的编码写盘在后台存图线程上进行，与录音和大模型请求重叠，大模型实现需要上传图片时才等待
+class InteractionPipeline {
+public:
+    InteractionPipeline(MemoryDB& db, const InteractionServices& services,
+                        const PipelineOptions& options = PipelineOptions());
+
+    InteractionPipeline(const InteractionPipeline&) = delete;
+    InteractionPipeline& operator=(const InteractionPipeline&) = delete;
+
+    // 完成一次交互（阻塞到播报和存储都结束），同一流水线不要并发调用
+    // 返回false表示没有完成完整交互：没看到人脸或有阶段失败（已播报相应的兜底回复）
+    bool runOnce(InteractionResult& result);
+
+    const PipelineOptions& options() const { return opts; }
+
+private:
+    struct Session;
+
+    MemoryDB& db_;
+    InteractionServices services_;
+    PipelineOptions opts;
+    TaskPool pool;
+
+    bool identify(Session& s);
+    bool listen(Session& s);
+    bool think(Session& s);
+    void speak(Session& s);
+    bool store(Session& s);
+    bool run_serial(Session& s);
+    bool run_overlapped(Session& s);
+};
+
+// 场景标签：按识别出的文字里的关键词归类（与方案.md中main_loop的规则一致）
+std::string scene_tag_for(const std::string& user_text);
+
+#endif // INTERACTION_PIPELINE_H
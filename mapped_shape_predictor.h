@@ -0,0 +1,208 @@
+#ifndef MAPPED_SHAPE_PREDICTOR_H
+#define MAPPED_SHAPE_PREDICTOR_H
+
+#include <cstdint>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "model_file.h"
+
+// 直接在mmap的.mrm文件上运行的关键点定位（与dlib::shape_predictor算法一致的回归树级联）
+// dlib反序列化要把全部回归树读进堆（68点模型约100MB）；这里启动时只映射文件、校验索引，
+// 叶子向量在被访问到时才从页缓存调入，多个进程共享同一份物理页
+//
+// 文件kind为"landmarks"，各段（C级级联，每级T棵树，每棵S个分裂节点、S+1个叶子，每级F个特征像素，P个关键点）：
+//   meta           uint32[5]  P, C, T, S, F
+//   initial_shape  float[2P]        平均形状（归一化到检测框的[0,1]坐标）
+//   anchor_idx     uint32[C*F]      特征像素所锚定的关键点
+//   deltas         float[C*F*2]     特征像素相对锚点的偏移
+//   split_idx      uint32[C*T*S*2]  分裂节点比较的两个特征像素
+//   split_thresh   float[C*T*S]
+//   leaves         float[C*T*(S+1)*2P]
+class MappedShapePredictor {
+public:
+    // 转换工具填好后调用write
+    struct Data {
+        uint32_t parts, cascades, trees, splits, features;
+        std::vector<float> initial_shape;
+        std::vector<uint32_t> anchor_idx;
+        std::vector<float> deltas;
+        std::vector<uint32_t> split_idx;
+        std::vector<float> split_thresh;
+        std::vector<float> leaves;
+        Data() : parts(0), cascades(0), trees(0), splits(0), features(0) {}
+    };
+
+    static bool write(const Data& d, const std::string& path) {
+        if (d.initial_shape.size() != 2u * d.parts || d.anchor_idx.size() != size_t(d.cascades) * d.features ||
+            d.deltas.size() != 2u * d.anchor_idx.size() ||
+            d.split_thresh.size() != size_t(d.cascades) * d.trees * d.splits ||
+            d.split_idx.size() != 2u * d.split_thresh.size() ||
+            d.leaves.size() != size_t(d.cascades) * d.trees * (d.splits + 1) * 2 * d.parts) {
+            return false;
+        }
+        const uint32_t meta[5] = {d.parts, d.cascades, d.trees, d.splits, d.features};
+        ModelFileWriter writer("landmarks");
+        writer.add("meta", meta, sizeof(meta));
+        writer.add("initial_shape", d.initial_shape);
+        writer.add("anchor_idx", d.anchor_idx);
+        writer.add("deltas", d.deltas);
+        writer.add("split_idx", d.split_idx);
+        writer.add("split_thresh", d.split_thresh);
+        writer.add("leaves", d.leaves);
+        return writer.write(path);
+    }
+
+    MappedShapePredictor()
+        : parts(0), cascades(0), trees(0), splits(0), features(0), initial_shape(nullptr), anchor_idx(nullptr),
+          deltas(nullptr), split_idx(nullptr), split_thresh(nullptr), leaves(nullptr) {}
+
+    bool load(const std::string& path) {
+        std::shared_ptr<MappedModelFile> f = std::make_shared<MappedModelFile>();
+        return f->open(path, "landmarks") && attach(f);
+    }
+
+    // 校验各段大小和全部索引（约1MB，不触及叶子段），通过后才替换当前模型
+    bool attach(const std::shared_ptr<const MappedModelFile>& f) {
+        bool ok = f && f->isOpen();
+        const uint32_t* meta = ok ? f->section<uint32_t>("meta", 5, ok) : nullptr;
+        if (!ok || meta[0] == 0 || meta[1] == 0 || meta[4] == 0) return false;
+        const size_t P = meta[0], C = meta[1], T = meta[2], S = meta[3], F = meta[4];
+        const float* shape = f->section<float>("initial_shape", 2 * P, ok);
+        const uint32_t* anchors = f->section<uint32_t>("anchor_idx", C * F, ok);
+        const float* offsets = f->section<float>("deltas", C * F * 2, ok);
+        const uint32_t* split_pairs = f->section<uint32_t>("split_idx", C * T * S * 2, ok);
+        const float* thresholds = f->section<float>("split_thresh", C * T * S, ok);
+        const float* leaf_values = f->section<float>("leaves", C * T * (S + 1) * 2 * P, ok);
+        if (!ok) return false;
+        for (size_t i = 0; i < C * F; ++i) {
+            if (anchors[i] >= P) return false;
+        }
+        for (size_t i = 0; i < C * T * S * 2; ++i) {
+            if (split_pairs[i] >= F) return false;
+        }
+
+        file = f;
+        parts = P;
+        cascades = C;
+        trees = T;
+        splits = S;
+        features = F;
+        initial_shape = shape;
+        anchor_idx = anchors;
+        deltas = offsets;
+        split_idx = split_pairs;
+        split_thresh = thresholds;
+        leaves = leaf_values;
+        return true;
+    }
+
+    bool isLoaded() const { return file != nullptr; }
+    unsigned long numParts() const { return parts; }
+
+    // 在检测框[left, right] x [top, bottom]（含边界，与dlib::rectangle一致）内定位关键点
+    // intensity(x, y)返回像素灰度（BGR图按dlib取(R + G + B) / 3），框外像素按0计
+    // 结果写入out：x0, y0, x1, y1, ...（原图坐标，未取整）
+    template <typename Intensity>
+    void predict(long width, long height, const Intensity& intensity, long left, long top, long right, long bottom,
+                 std::vector<float>& out) const {
+        Scratch scratch;
+        predict(width, height, intensity, left, top, right, bottom, out, scratch);
+    }
+
+    // 逐帧调用时传入复用的工作缓冲，不再分配
+    struct Scratch {
+        std::vector<float> shape;
+        std::vector<float> pixels;
+    };
+
+    template <typename Intensity>
+    void predict(long width, long height, const Intensity& intensity, long left, long top, long right, long bottom,
+                 std::vector<float>& out, Scratch& scratch) const {
+        const double sx = static_cast<double>(right - left), sy = static_cast<double>(bottom - top);
+        std::vector<float>& shape = scratch.shape;
+        std::vector<float>& pixels = scratch.pixels;
+        shape.assign(initial_shape, initial_shape + 2 * parts);
+        pixels.resize(features);
+        for (size_t c = 0; c < cascades; ++c) {
+            // 平均形状到当前形状的相似变换（只用旋转缩放部分）：最小二乘的闭式解
+            float a, b;
+            similarity(shape.data(), a, b);
+            const uint32_t* anchors = anchor_idx + c * features;
+            const float* offsets = deltas + c * features * 2;
+            for (size_t i = 0; i < features; ++i) {
+                const float dx = offsets[2 * i], dy = offsets[2 * i + 1];
+                const float u = a * dx - b * dy + shape[2 * anchors[i]];
+                const float v = b * dx + a * dy + shape[2 * anchors[i] + 1];
+                const long px = static_cast<long>(std::floor(left + u * sx + 0.5));
+                const long py = static_cast<long>(std::floor(top + v * sy + 0.5));
+                pixels[i] = (px >= 0 && py >= 0 && px < width && py < height) ? intensity(px, py) : 0.0f;
+            }
+
+            const size_t leaf_size = 2 * parts;
+            for (size_t t = 0; t < trees; ++t) {
+                const size_t tree = c * trees + t;
+                const uint32_t* pairs = split_idx + tree * splits * 2;
+                const float* thresh = split_thresh + tree * splits;
+                size_t node = 0;
+                while (node < splits) {
+                    node = pixels[pairs[2 * node]] - pixels[pairs[2 * node + 1]] > thresh[node] ? 2 * node + 1
+                                                                                               : 2 * node + 2;
+                }
+                const float* leaf = leaves + (tree * (splits + 1) + (node - splits)) * leaf_size;
+                for (size_t k = 0; k < leaf_size; ++k) shape[k] += leaf[k];
+            }
+        }
+
+        out.resize(2 * parts);
+        for (size_t p = 0; p < parts; ++p) {
+            out[2 * p] = static_cast<float>(left + shape[2 * p] * sx);
+            out[2 * p + 1] = static_cast<float>(top + shape[2 * p + 1] * sy);
+        }
+    }
+
+private:
+    std::shared_ptr<const MappedModelFile> file;
+    size_t parts, cascades, trees, splits, features;
+    const float* initial_shape;
+    const uint32_t* anchor_idx;
+    const float* deltas;
+    const uint32_t* split_idx;
+    const float* split_thresh;
+    const float* leaves;
+
+    // to ≈ [a -b; b a] * from（均去中心）
+    void similarity(const float* to, float& a, float& b) const {
+        const float* from = initial_shape;
+        double fx = 0, fy = 0, tx = 0, ty = 0;
+        for (size_t p = 0; p < parts; ++p) {
+            fx += from[2 * p];
+            fy += from[2 * p + 1];
+            tx += to[2 * p];
+            ty += to[2 * p + 1];
+        }
+        fx /= parts;
+        fy /= parts;
+        tx /= parts;
+        ty /= parts;
+        double norm = 0, dot = 0, cross = 0;
+        for (size_t p = 0; p < parts; ++p) {
+            const double x = from[2 * p] - fx, y = from[2 * p + 1] - fy;
+            const double u = to[2 * p] - tx, v = to[2 * p + 1] - ty;
+            norm += x * x + y * y;
+            dot += x * u + y * v;
+            cross += x * v - y * u;
+        }
+        if (norm <= 0) {
+            a = 1.0f;
+            b = 0.0f;
+            return;
+        }
+        a = static_cast<float>(dot / norm);
+        b = static_cast<float>(cross / norm);
+    }
+};
+
+#endif // MAPPED_SHAPE_PREDICTOR_H
@@ -0,0 +1,182 @@
+#ifndef MEMORY_ARCHIVE_H
+#define MEMORY_ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "memory_types.h"
+
+// 归档记忆块：同一用户连续的一批冷记忆序列化后整体压缩成一个BLOB
+// 压缩算法是显式的编译选项，不随编译机器上装了哪些头文件而变：
+//   默认zlib（链接-lz，memory_db本来就依赖）；
+//   定义MEMORYROBOT_ARCHIVE_ZSTD时新归档用zstd（需libzstd开发包，链接-lzstd；CMake中为同名option）
+// BLOB首字节记录压缩算法，两种格式的归档可以混存；zlib归档总能读，zstd归档只有开了该选项的程序能读
+// （读不了时记录日志并跳过该块）——同一个库被不同程序读写时，各程序要用相同的选项编译
+#include <zlib.h>
+#ifdef MEMORYROBOT_ARCHIVE_ZSTD
+#include <zstd.h>
+#endif
+
+enum ArchiveCodec : uint8_t {
+    ARCHIVE_CODEC_ZLIB = 1,
+    ARCHIVE_CODEC_ZSTD = 2
+};
+
+// 归档中的一条记忆（带原mem_id，供全文检索命中后回查）
+struct ArchivedMem {
+    int64_t mem_id;
+    ConversationMem mem;
+};
+
+namespace archive_detail {
+
+// 一条记忆序列化后的最小字节数（mem_id + 时间戳 + is_core + 4个空字符串的长度）
+const size_t kMinRowBytes = 8 + 8 + 4 + 4 * 4;
+// 解压后大小的上限：归档块按chunk_rows条切分，正常远小于此；损坏的长度字段不能引发巨量分配
+const uint32_t kMaxRawBytes = 64u << 20;
+// deflate的最大压缩比约1032:1，声明的原始长度超过它说明长度字段已损坏
+const size_t kMaxZlibRatio = 1032;
+
+inline void put_u32(std::string& out, uint32_t v) {
+    char b[4];
+    std::memcpy(b, &v, 4);
+    out.append(b, 4);
+}
+
+inline void put_i64(std::string& out, int64_t v) {
+    char b[8];
+    std::memcpy(b, &v, 8);
+    out.append(b, 8);
+}
+
+inline void put_str(std::string& out, const std::string& s) {
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out.append(s);
+}
+
+struct Reader {
+    const char* p;
+    const char* end;
+    bool ok;
+
+    bool take(void* dst, size_t n) {
+        if (!ok || static_cast<size_t>(end - p) < n) return ok = false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    }
+    bool str(std::string& s) {
+        uint32_t n = 0;
+        if (!take(&n, 4) || static_cast<size_t>(end - p) < n) return ok = false;
+        s.assign(p, n);
+        p += n;
+        return true;
+    }
+};
+
+} // namespace archive_detail
+
+// 序列化一批记忆（uid由归档表单独保存，不重复写入）
+inline void serialize_archive(const std::vector<ArchivedMem>& rows, std::string& raw) {
+    using namespace archive_detail;
+    raw.clear();
+    put_u32(raw, static_cast<uint32_t>(rows.size()));
+    for (const ArchivedMem& r : rows) {
+        put_i64(raw, r.mem_id);
+        put_i64(raw, static_cast<int64_t>(r.mem.timestamp));
+        put_u32(raw, static_cast<uint32_t>(r.mem.is_core));
+        put_str(raw, r.mem.user_text);
+        put_str(raw, r.mem.robot_text);
+        put_str(raw, r.mem.scene_tag);
+        put_str(raw, r.mem.image_path);
+    }
+}
+
+inline bool deserialize_archive(const std::string& raw, const std::string& uid, std::vector<ArchivedMem>& rows) {
+    archive_detail::Reader rd = { raw.data(), raw.data() + raw.size(), true };
+    uint32_t n = 0;
+    if (!rd.take(&n, 4)) return false;
+    // 条数来自数据本身：不可能超过剩余字节数能容纳的条数，否则是损坏的块
+    if (n > static_cast<size_t>(rd.end - rd.p) / archive_detail::kMinRowBytes) return false;
+    rows.resize(n);
+    for (ArchivedMem& r : rows) {
+        if (!rd.ok) break;
+        int64_t ts = 0;
+        uint32_t core = 0;
+        rd.take(&r.mem_id, 8);
+        rd.take(&ts, 8);
+        rd.take(&core, 4);
+        rd.str(r.mem.user_text);
+        rd.str(r.mem.robot_text);
+        rd.str(r.mem.scene_tag);
+        rd.str(r.mem.image_path);
+        r.mem.uid = uid;
+        r.mem.timestamp = static_cast<time_t>(ts);
+        r.mem.is_core = static_cast<int>(core);
+    }
+    return rd.ok;
+}
+
+// 压缩：输出 = 1字节算法 + 4字节原始长度 + 压缩数据
+inline bool compress_archive(const std::string& raw, std::string& out) {
+    out.clear();
+#ifdef MEMORYROBOT_ARCHIVE_ZSTD
+    out.push_back(static_cast<char>(ARCHIVE_CODEC_ZSTD));
+    archive_detail::put_u32(out, static_cast<uint32_t>(raw.size()));
+    size_t header = out.size();
+    out.resize(header + ZSTD_compressBound(raw.size()));
+    size_t n = ZSTD_compress(&out[header], out.size() - header, raw.data(), raw.size(), 9);
+    if (ZSTD_isError(n)) return false;
+    out.resize(header + n);
+#else
+    out.push_back(static_cast<char>(ARCHIVE_CODEC_ZLIB));
+    archive_detail::put_u32(out, static_cast<uint32_t>(raw.size()));
+    size_t header = out.size();
+    uLongf n = compressBound(static_cast<uLong>(raw.size()));
+    out.resize(header + n);
+    if (compress2(reinterpret_cast<Bytef*>(&out[header]), &n,
+                  reinterpret_cast<const Bytef*>(raw.data()), static_cast<uLong>(raw.size()), 9) != Z_OK) {
+        return false;
+    }
+    out.resize(header + n);
+#endif
+    return true;
+}
+
+// 解压；头部声明的原始长度先做合理性检查再分配，损坏的块返回false
+inline bool decompress_archive(const void* data, size_t size, std::string& raw) {
+    const char* bytes = static_cast<const char*>(data);
+    if (size < 5) return false;
+    uint8_t codec = static_cast<uint8_t>(bytes[0]);
+    uint32_t raw_size = 0;
+    std::memcpy(&raw_size, bytes + 1, 4);
+    const char* payload = bytes + 5;
+    size_t payload_size = size - 5;
+    if (raw_size > archive_detail::kMaxRawBytes) return false;
+
+    if (codec == ARCHIVE_CODEC_ZSTD) {
+#ifdef MEMORYROBOT_ARCHIVE_ZSTD
+        // zstd帧头里也记录了原始长度，两者必须一致
+        unsigned long long frame_size = ZSTD_getFrameContentSize(payload, payload_size);
+        if (frame_size != raw_size) return false;
+        raw.resize(raw_size);
+        size_t n = ZSTD_decompress(&raw[0], raw.size(), payload, payload_size);
+        return !ZSTD_isError(n) && n == raw_size;
+#else
+        return false;  // 未开启MEMORYROBOT_ARCHIVE_ZSTD编译，读不了zstd归档
+#endif
+    }
+    if (codec == ARCHIVE_CODEC_ZLIB) {
+        if (raw_size > payload_size * archive_detail::kMaxZlibRatio) return false;
+        raw.resize(raw_size);
+        uLongf n = raw_size;
+        return uncompress(reinterpret_cast<Bytef*>(&raw[0]), &n,
+                          reinterpret_cast<const Bytef*>(payload), static_cast<uLong>(payload_size)) == Z_OK &&
+               n == raw_size;
+    }
+    return false;
+}
+
+#endif // MEMORY_ARCHIVE_H
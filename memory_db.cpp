@@ -4,6 +4,167 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdexcept>
+#include <cstdlib>
+#include <chrono>
+#include <fcntl.h>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+
+#include "text_segment.h"
+
+namespace {
+
+// 作用域结束时reset语句，及时释放读锁
+struct StmtReset {
+    sqlite3_stmt* stmt;
+    explicit StmtReset(sqlite3_stmt* s) : stmt(s) {}
+    ~StmtReset() { if (stmt) sqlite3_reset(stmt); }
+};
+
+// 类型化列读取（替代sqlite3_exec回调里的char**）
+inline void column_string(sqlite3_stmt* stmt, int col, std::string& out) {
+    const unsigned char* text = sqlite3_column_text(stmt, col);
+    if (text) {
+        out.assign((const char*)text, sqlite3_column_bytes(stmt, col));
+    } else {
+        out.clear();
+    }
+}
+
+inline void read_conversation_row(sqlite3_stmt* stmt, ConversationMem& mem) {
+    column_string(stmt, 0, mem.uid);
+    column_string(stmt, 1, mem.user_text);
+    column_string(stmt, 2, mem.robot_text);
+    mem.timestamp = (time_t)sqlite3_column_int64(stmt, 3);
+    column_string(stmt, 4, mem.scene_tag);
+    mem.is_core = sqlite3_column_int(stmt, 5);
+    column_string(stmt, 6, mem.image_path);
+}
+
+inline void bind_string(sqlite3_stmt* stmt, int idx, const std::string& value) {
+    sqlite3_bind_text(stmt, idx, value.data(), (int)value.size(), SQLITE_STATIC);
+}
+
+// 业务语句（下标为MemoryDB::StmtId）：写连接全部预编译，读连接池只预编译其中的查询语句
+const char* const kStatementSql[] = {
+    // STMT_KV_INSERT
+    "INSERT OR REPLACE INTO kv_mem (key, value, timestamp) VALUES (?, ?, ?);",
+    // STMT_KV_QUERY
+    "SELECT value FROM kv_mem WHERE key = ?;",
+    // STMT_USER_EXISTS
+    "SELECT 1 FROM user_profile WHERE uid = ?;",
+    // STMT_USER_INSERT
+    "INSERT OR IGNORE INTO user_profile (uid, face_feature, user_type, create_time) VALUES (?, ?, 'child', ?);",
+    // STMT_USER_LIST
+    "SELECT uid, face_feature FROM user_profile;",
+    // STMT_MEM_INSERT
+    "INSERT INTO conversation_mem (uid, user_text, robot_text, timestamp, scene_tag, is_core, image_path) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?) RETURNING mem_id;",
+    // STMT_MEM_CONTEXT
+    "SELECT uid, user_text, robot_text, timestamp, scene_tag, is_core, image_path, mem_id "
+    "FROM conversation_mem WHERE uid = ? ORDER BY timestamp DESC, mem_id DESC LIMIT ?;",
+    // STMT_BEGIN
+    "BEGIN;",
+    // STMT_COMMIT
+    "COMMIT;",
+    // STMT_FTS_INSERT
+    "INSERT INTO conversation_fts (rowid, uid, body) VALUES (?, ?, ?);",
+    // STMT_FTS_SEARCH（uid列权重为0，只参与过滤不参与打分；c.uid为NULL表示该条已归档）
+    "SELECT c.uid, c.user_text, c.robot_text, c.timestamp, c.scene_tag, c.is_core, c.image_path, "
+    "bm25(conversation_fts, 0.0, 1.0) AS score, conversation_fts.rowid "
+    "FROM conversation_fts LEFT JOIN conversation_mem c ON c.mem_id = conversation_fts.rowid "
+    "WHERE conversation_fts MATCH ? ORDER BY score LIMIT ?;",
+    // STMT_FTS_TERM_DOCS
+    "SELECT doc FROM conversation_fts_vocab WHERE term = ?;",
+    // STMT_MEM_MAX_ID
+    "SELECT coalesce(max(mem_id), 0) FROM conversation_mem;",
+    // STMT_ARCHIVE_BY_UID
+    "SELECT last_ts, data FROM conversation_archive WHERE uid = ? ORDER BY last_ts DESC;",
+    // STMT_ARCHIVE_BY_MEM
+    "SELECT data FROM conversation_archive WHERE uid = ? AND first_mem_id <= ? AND last_mem_id >= ?;",
+    // STMT_IMAGE_INSERT
+    "INSERT INTO image_hash (uid, hash, image_path, timestamp) VALUES (?, ?, ?, ?);",
+    // STMT_IMAGE_RECENT（按时间正序载入，索引环中留下每个用户最新的window张）
+    "SELECT uid, hash, image_path, timestamp FROM image_hash WHERE timestamp >= ? ORDER BY timestamp;",
+    // STMT_IMAGE_DELETE（照片文件已被清理时撤销登记）
+    "DELETE FROM image_hash WHERE uid = ? AND image_path = ?;",
+};
+
+// 每个线程记住上次租用的是哪个MemoryDB实例的哪个读连接，下次先试它（线程数不超过连接数时总能直接拿到）
+struct LeaseHint {
+    uint64_t owner;
+    size_t index;
+};
+thread_local LeaseHint lease_hint = {0, 0};
+std::atomic<uint64_t> next_instance_id(1);
+
+} // namespace
+
+// 一次读操作租用的连接：开了读连接池时抢占一个空闲的只读连接（CAS，无锁），否则持txn_mutex使用写连接
+// 租用期间不要调用flush()或另一个读函数（未开池时txn_mutex不可重入）
+class MemoryDB::ReadLease {
+public:
+    explicit ReadLease(MemoryDB& owner) : m(owner), conn(nullptr) {
+        const size_t n = m.read_pool.size();
+        if (n == 0) {
+            lock = std::unique_lock<std::mutex>(m.txn_mutex);
+            return;
+        }
+        size_t start = lease_hint.owner == m.instance_id
+                           ? lease_hint.index % n
+                           : std::hash<std::thread::id>()(std::this_thread::get_id()) % n;
+        for (;;) {
+            for (size_t i = 0; i < n; ++i) {
+                size_t idx = (start + i) % n;
+                ReadConn* c = m.read_pool[idx].get();
+                bool expected = false;
+                if (!c->leased.load(std::memory_order_relaxed) &&
+                    c->leased.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    conn = c;
+                    lease_hint.owner = m.instance_id;
+                    lease_hint.index = idx;
+                    return;
+                }
+            }
+            std::this_thread::yield();  // 读线程多于连接数：让出CPU等别的线程归还
+        }
+    }
+
+    ~ReadLease() { release(); }
+
+    // 提前归还（之后不能再使用本租约）
+    void release() {
+        if (conn) {
+            conn->leased.store(false, std::memory_order_release);
+            conn = nullptr;
+        }
+        if (lock.owns_lock()) lock.unlock();
+    }
+
+    ReadLease(const ReadLease&) = delete;
+    ReadLease& operator=(const ReadLease&) = delete;
+
+    sqlite3* handle() const { return conn ? conn->db : m.db; }
+
+    // 取出该连接缓存的语句（已reset并清空绑定）；读连接上只有enableReadPool预编译的查询语句
+    sqlite3_stmt* acquire(StmtId id) {
+        if (!conn) return m.acquire(id);
+        sqlite3_stmt* stmt = conn->stmts[id];
+        if (stmt) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+        return stmt;
+    }
+
+    std::vector<ConversationMem>& rows() { return conn ? conn->context_rows : m.context_rows; }
+
+private:
+    MemoryDB& m;
+    ReadConn* conn;
+    std::unique_lock<std::mutex> lock;
+};
 
 // MD5哈希实现（生成UID）
 std::string MemoryDB::md5(const std::string& input) {
@@ -17,8 +178,56 @@ std::string MemoryDB::md5(const std::string& input) {
     return oss.str().substr(0, 20); // 取前20位，和Python版一致
 }
 
+// 从user_profile加载所有已知人脸到内存特征库（BLOB直接解码，无需解析文本）
+bool MemoryDB::load_gallery() {
+    std::unique_lock<std::shared_mutex> gallery_lock(gallery_mutex);
+    gallery.clear();
+
+    sqlite3_stmt* stmt = acquire(STMT_USER_LIST);
+    StmtReset guard(stmt);
+    int rc;
+
+    FaceDescriptor desc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* uid = (const char*)sqlite3_column_text(stmt, 0);
+        bool ok = false;
+        if (sqlite3_column_type(stmt, 1) == SQLITE_BLOB) {
+            const void* blob = sqlite3_column_blob(stmt, 1);
+            ok = decode_descriptor(blob, sqlite3_column_bytes(stmt, 1), desc);
+        } else {
+            const char* text = (const char*)sqlite3_column_text(stmt, 1);
+            ok = text && parse_descriptor_text(text, desc);
+        }
+        if (uid && ok) {
+            gallery.addFace(uid, desc.data());
+        }
+    }
+
+    if (rc != SQLITE_DONE) {
+        std::cerr << "加载人脸库失败：" << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    std::cout << "人脸库加载完成，共" << gallery.size() << "个用户" << std::endl;
+    return true;
+}
+
+void MemoryDB::setFaceMatchThreshold(float threshold) {
+    gallery.setMatchThreshold(threshold);
+}
+
+void MemoryDB::setDescriptorEncoding(DescriptorEncoding enc) {
+    feature_encoding = enc;
+}
+
 // 构造函数：初始化数据库连接（修复目录创建逻辑）
-MemoryDB::MemoryDB(const std::string& path) : db(nullptr), db_path(path) {
+MemoryDB::MemoryDB(const std::string& path, StorageMode mode)
+    : db(nullptr), db_path(path), feature_encoding(DescriptorEncoding::Float16),
+      storage_mode(mode), snapshot_interval_sec(60), snapshot_every_writes(50),
+      pending_writes(0), snapshot_stop(false),
+      writer_stop(false), enqueued_count(0), committed_count(0), flush_target(0), failed_count(0), failed_reported(0),
+      batch_rows(64), batch_latency_ms(50), retention_stop(false), instance_id(next_instance_id++) {
+    for (int i = 0; i < STMT_COUNT; ++i) stmts[i] = nullptr;
+
     //处理目录创建：兼容相对路径/绝对路径
     std::string dir;
     size_t last_slash = db_path.find_last_of('/');
@@ -39,18 +248,234 @@ MemoryDB::MemoryDB(const std::string& path) : db(nullptr), db_path(path) {
     }
 
     // 打开数据库
-   int rc = sqlite3_open(":memory:", &db); 
-    if (rc != SQLITE_OK) {
-        std::cerr << "数据库打开失败：" << sqlite3_errmsg(db) << std::endl;
+    if (!open_database()) {
         sqlite3_close(db);
         db = nullptr;
-    } else {
+    }
+}
+
+// 按存储模式打开连接
+bool MemoryDB::open_database() {
+    const char* target = (storage_mode == StorageMode::Disk) ? db_path.c_str() : ":memory:";
+    int rc = sqlite3_open(target, &db);
+    if (rc != SQLITE_OK) {
+        std::cerr << "数据库打开失败：" << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    // 新建库使用增量回收：归档整理删除的页可以交还文件系统（只对尚未建表的库生效）
+    sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL;", nullptr, nullptr, nullptr);
+
+    switch (storage_mode) {
+    case StorageMode::Memory:
         std::cout << "内存数据库打开成功（无需磁盘文件）" << std::endl;
+        return true;
+    case StorageMode::Disk:
+        if (!apply_disk_pragmas()) return false;
+        std::cout << "磁盘数据库打开成功（WAL模式）：" << db_path << std::endl;
+        return true;
+    case StorageMode::Hybrid:
+        if (!restore_snapshot()) return false;
+        std::cout << "内存数据库打开成功（快照文件：" << db_path << "）" << std::endl;
+        return true;
+    }
+    return false;
+}
+
+// 磁盘模式调优：WAL下synchronous=NORMAL只在checkpoint时fsync，适合低速TF卡
+bool MemoryDB::apply_disk_pragmas() {
+    const char* pragmas = R"(
+        PRAGMA journal_mode = WAL;
+        PRAGMA synchronous = NORMAL;
+        PRAGMA mmap_size = 67108864;
+        PRAGMA cache_size = -8192;
+        PRAGMA temp_store = MEMORY;
+        PRAGMA wal_autocheckpoint = 1000;
+    )";
+    char* err_msg = nullptr;
+    int rc = sqlite3_exec(db, pragmas, nullptr, nullptr, &err_msg);
+    if (rc != SQLITE_OK) {
+        std::cerr << "设置数据库参数失败：" << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+    sqlite3_busy_timeout(db, 2000);
+    return true;
+}
+
+// 读连接池：只读打开同一个库文件，只预编译查询语句；连接不跨线程同时使用，所以不要SQLite的连接互斥
+bool MemoryDB::enableReadPool(size_t connections) {
+    if (!db || !stmts[STMT_MEM_CONTEXT] || connections == 0) return false;
+    if (storage_mode != StorageMode::Disk) {
+        std::cerr << "读连接池只用于Disk模式（内存库只有一个连接，读写经同一把锁串行）" << std::endl;
+        return false;
+    }
+    if (!read_pool.empty()) return true;
+
+    static const StmtId read_stmts[] = {STMT_KV_QUERY,   STMT_MEM_CONTEXT,    STMT_FTS_SEARCH,    STMT_FTS_TERM_DOCS,
+                                        STMT_MEM_MAX_ID, STMT_ARCHIVE_BY_UID, STMT_ARCHIVE_BY_MEM};
+    for (size_t i = 0; i < connections; ++i) {
+        std::unique_ptr<ReadConn> c(new ReadConn());
+        int rc = sqlite3_open_v2(db_path.c_str(), &c->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+        if (rc == SQLITE_OK) {
+            sqlite3_busy_timeout(c->db, 2000);
+            rc = sqlite3_exec(c->db, "PRAGMA mmap_size = 67108864; PRAGMA cache_size = -2048;", nullptr, nullptr,
+                              nullptr);
+        }
+        for (size_t k = 0; rc == SQLITE_OK && k < sizeof(read_stmts) / sizeof(read_stmts[0]); ++k) {
+            StmtId id = read_stmts[k];
+            rc = sqlite3_prepare_v3(c->db, kStatementSql[id], -1, SQLITE_PREPARE_PERSISTENT, &c->stmts[id], nullptr);
+        }
+        bool ok = rc == SQLITE_OK;
+        if (!ok) std::cerr << "读连接打开失败：" << (c->db ? sqlite3_errmsg(c->db) : "内存不足") << std::endl;
+        read_pool.push_back(std::move(c));
+        if (!ok) {
+            close_read_pool();
+            return false;
+        }
+    }
+    std::cout << "读连接池已开启：" << connections << "个只读连接" << std::endl;
+    return true;
+}
+
+// 关闭读连接池（析构时调用，此时不应再有读操作）
+void MemoryDB::close_read_pool() {
+    for (std::unique_ptr<ReadConn>& c : read_pool) {
+        for (int i = 0; i < STMT_COUNT; ++i) {
+            if (c->stmts[i]) sqlite3_finalize(c->stmts[i]);
+        }
+        if (c->db) sqlite3_close(c->db);
+    }
+    read_pool.clear();
+}
+
+// Hybrid模式启动：用backup API把磁盘快照整体拷进内存库（页级拷贝，无需逐行解析）
+bool MemoryDB::restore_snapshot() {
+    struct stat st;
+    if (stat(db_path.c_str(), &st) != 0) {
+        std::cout << "未找到快照文件，使用空数据库" << std::endl;
+        return true;
+    }
+
+    sqlite3* file_db = nullptr;
+    int rc = sqlite3_open_v2(db_path.c_str(), &file_db, SQLITE_OPEN_READONLY, nullptr);
+    if (rc == SQLITE_OK) {
+        sqlite3_backup* backup = sqlite3_backup_init(db, "main", file_db, "main");
+        if (backup) {
+            sqlite3_backup_step(backup, -1);
+            rc = sqlite3_backup_finish(backup);
+        } else {
+            rc = sqlite3_errcode(db);
+        }
+    }
+    if (rc != SQLITE_OK) {
+        std::cerr << "恢复快照失败：" << sqlite3_errmsg(file_db ? file_db : db) << std::endl;
+    } else {
+        std::cout << "已从快照恢复：" << db_path << "（" << st.st_size << " 字节）" << std::endl;
+    }
+    sqlite3_close(file_db);
+    return rc == SQLITE_OK;
+}
+
+void MemoryDB::setSnapshotPolicy(int interval_sec, int every_writes) {
+    snapshot_interval_sec = interval_sec;
+    snapshot_every_writes = every_writes;
+}
+
+// 内存库快照到磁盘：写临时文件 -> fsync -> rename -> fsync目录
+bool MemoryDB::snapshot() {
+    if (!db || storage_mode != StorageMode::Hybrid) return false;
+
+    std::string tmp_path = db_path + ".tmp";
+    unlink(tmp_path.c_str());
+
+    sqlite3* file_db = nullptr;
+    int rc = sqlite3_open(tmp_path.c_str(), &file_db);
+    if (rc == SQLITE_OK) {
+        // 临时文件整体rename生效，写入过程无需日志和逐页同步
+        sqlite3_exec(file_db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF;", nullptr, nullptr, nullptr);
+        sqlite3_backup* backup = sqlite3_backup_init(file_db, "main", db, "main");
+        if (backup) {
+            // 分批拷贝，每批之间释放源库锁，避免长时间阻塞交互线程
+            do {
+                rc = sqlite3_backup_step(backup, 256);
+                if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) sqlite3_sleep(5);
+            } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+            rc = sqlite3_backup_finish(backup);
+        } else {
+            rc = sqlite3_errcode(file_db);
+        }
+    }
+    if (rc != SQLITE_OK) {
+        std::cerr << "数据库快照失败：" << sqlite3_errmsg(file_db) << std::endl;
+        sqlite3_close(file_db);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    sqlite3_close(file_db);
+
+    int fd = open(tmp_path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    if (rename(tmp_path.c_str(), db_path.c_str()) != 0) {
+        std::cerr << "快照替换失败：" << strerror(errno) << std::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    size_t last_slash = db_path.find_last_of('/');
+    std::string dir = (last_slash != std::string::npos) ? db_path.substr(0, last_slash) : ".";
+    int dir_fd = open(dir.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return true;
+}
+
+// 后台快照线程：定时或写入次数达到阈值时落盘
+void MemoryDB::snapshot_loop() {
+    std::unique_lock<std::mutex> lock(snapshot_mutex);
+    while (!snapshot_stop) {
+        snapshot_cv.wait_for(lock, std::chrono::seconds(snapshot_interval_sec), [this] {
+            return snapshot_stop || pending_writes.load() >= snapshot_every_writes;
+        });
+        if (snapshot_stop) break;
+        int writes = pending_writes.exchange(0);
+        if (writes == 0) continue;
+        lock.unlock();
+        if (!snapshot()) {
+            pending_writes += writes;  // 失败则保留计数，下次重试
+        }
+        lock.lock();
+    }
+}
+
+// 记录一次写入，达到阈值时唤醒快照线程
+void MemoryDB::note_write() {
+    if (storage_mode != StorageMode::Hybrid) return;
+    if (++pending_writes >= snapshot_every_writes) {
+        snapshot_cv.notify_one();
     }
 }
 
 // 析构函数：释放数据库资源
 MemoryDB::~MemoryDB() {
+    stop_retention();
+    stop_async_writes();
+    if (snapshot_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(snapshot_mutex);
+            snapshot_stop = true;
+        }
+        snapshot_cv.notify_one();
+        snapshot_thread.join();
+        if (pending_writes.load() > 0) {
+            snapshot();
+        }
+    }
+    close_read_pool();
+    finalize_statements();
     if (db) {
         sqlite3_close(db);
         db = nullptr;
@@ -69,7 +494,7 @@ bool MemoryDB::init_db() {
     const char* create_user_sql = R"(
         CREATE TABLE IF NOT EXISTS user_profile (
             uid TEXT PRIMARY KEY,
-            face_feature TEXT NOT NULL,
+            face_feature BLOB NOT NULL,
             user_type TEXT NOT NULL,
             create_time INTEGER NOT NULL
         );
@@ -90,9 +515,46 @@ bool MemoryDB::init_db() {
         );
         CREATE INDEX IF NOT EXISTS idx_uid ON conversation_mem(uid);
         CREATE INDEX IF NOT EXISTS idx_timestamp ON conversation_mem(timestamp);
+        CREATE INDEX IF NOT EXISTS idx_uid_timestamp ON conversation_mem(uid, timestamp);
     )";
 
-    // 3. 创建KV测试表
+    // 3. 创建对话全文索引（无内容表，只存倒排索引；中文由text_segment.h预先切分）
+    const char* create_fts_sql = R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS conversation_fts USING fts5(
+            uid, body, content='', tokenize='unicode61'
+        );
+        CREATE VIRTUAL TABLE IF NOT EXISTS conversation_fts_vocab USING fts5vocab(conversation_fts, 'row');
+    )";
+
+    // 4. 创建冷记忆归档表（每行是同一用户一批记忆的压缩块，格式见memory_archive.h）
+    const char* create_archive_sql = R"(
+        CREATE TABLE IF NOT EXISTS conversation_archive (
+            archive_id INTEGER PRIMARY KEY AUTOINCREMENT,
+            uid TEXT NOT NULL,
+            first_mem_id INTEGER NOT NULL,
+            last_mem_id INTEGER NOT NULL,
+            first_ts INTEGER NOT NULL,
+            last_ts INTEGER NOT NULL,
+            row_count INTEGER NOT NULL,
+            raw_bytes INTEGER NOT NULL,
+            data BLOB NOT NULL
+        );
+        CREATE INDEX IF NOT EXISTS idx_archive_uid_ts ON conversation_archive(uid, last_ts);
+    )";
+
+    // 5. 创建照片哈希表（去重索引，hash为dHash按位存入INTEGER）
+    const char* create_image_sql = R"(
+        CREATE TABLE IF NOT EXISTS image_hash (
+            image_id INTEGER PRIMARY KEY AUTOINCREMENT,
+            uid TEXT NOT NULL,
+            hash INTEGER NOT NULL,
+            image_path TEXT NOT NULL,
+            timestamp INTEGER NOT NULL
+        );
+        CREATE INDEX IF NOT EXISTS idx_image_uid_ts ON image_hash(uid, timestamp);
+    )";
+
+    // 6. 创建KV测试表
     const char* create_kv_sql = R"(
         CREATE TABLE IF NOT EXISTS kv_mem (
             key TEXT PRIMARY KEY,
@@ -120,6 +582,30 @@ bool MemoryDB::init_db() {
         return false;
     }
 
+    // 执行创建全文索引
+    rc = sqlite3_exec(db, create_fts_sql, nullptr, nullptr, &err_msg);
+    if (rc != SQLITE_OK) {
+        std::cerr << "创建全文索引失败：" << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+
+    // 执行创建归档表
+    rc = sqlite3_exec(db, create_archive_sql, nullptr, nullptr, &err_msg);
+    if (rc != SQLITE_OK) {
+        std::cerr << "创建归档表失败：" << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+
+    // 执行创建照片哈希表
+    rc = sqlite3_exec(db, create_image_sql, nullptr, nullptr, &err_msg);
+    if (rc != SQLITE_OK) {
+        std::cerr << "创建照片哈希表失败：" << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+
     // 执行创建KV表
     rc = sqlite3_exec(db, create_kv_sql, nullptr, nullptr, &err_msg);
     if (rc != SQLITE_OK) {
@@ -128,50 +614,86 @@ bool MemoryDB::init_db() {
         return false;
     }
 
+    if (!prepare_statements() || !catch_up_fts_index() || !load_image_index()) {
+        return false;
+    }
+
+    // Hybrid模式：启动后台快照线程
+    if (storage_mode == StorageMode::Hybrid && !snapshot_thread.joinable()) {
+        snapshot_thread = std::thread(&MemoryDB::snapshot_loop, this);
+    }
+
     std::cout << "数据库表初始化成功" << std::endl;
+    return load_gallery();
+}
+
+// 预编译所有业务语句（表创建完成后调用）
+bool MemoryDB::prepare_statements() {
+    static_assert(sizeof(kStatementSql) / sizeof(kStatementSql[0]) == STMT_COUNT, "kStatementSql与StmtId不一致");
+
+    finalize_statements();
+    for (int i = 0; i < STMT_COUNT; ++i) {
+        int rc = sqlite3_prepare_v3(db, kStatementSql[i], -1, SQLITE_PREPARE_PERSISTENT, &stmts[i], nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "预编译语句失败：" << sqlite3_errmsg(db) << "（" << kStatementSql[i] << "）" << std::endl;
+            finalize_statements();
+            return false;
+        }
+    }
     return true;
 }
 
+void MemoryDB::finalize_statements() {
+    for (int i = 0; i < STMT_COUNT; ++i) {
+        if (stmts[i]) {
+            sqlite3_finalize(stmts[i]);
+            stmts[i] = nullptr;
+        }
+    }
+}
+
+sqlite3_stmt* MemoryDB::acquire(StmtId id) {
+    sqlite3_stmt* stmt = stmts[id];
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return stmt;
+}
+
 // KV插入（测试用）
 bool MemoryDB::insert_memory(const std::string& key, const std::string& value) {
-    if (!db) return false;
+    if (!db || !stmts[STMT_KV_INSERT]) return false;
 
-    time_t now = time(nullptr);
-    std::string insert_sql = "INSERT OR REPLACE INTO kv_mem (key, value, timestamp) "
-                             "VALUES ('" + key + "', '" + value + "', " + std::to_string(now) + ");";
+    std::lock_guard<std::mutex> txn_lock(txn_mutex);
+    sqlite3_stmt* stmt = acquire(STMT_KV_INSERT);
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, key);
+    bind_string(stmt, 2, value);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)time(nullptr));
 
-    char* err_msg = nullptr;
-    int rc = sqlite3_exec(db, insert_sql.c_str(), nullptr, nullptr, &err_msg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "插入KV数据失败：" << err_msg << std::endl;
-        sqlite3_free(err_msg);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "插入KV数据失败：" << sqlite3_errmsg(db) << std::endl;
         return false;
     }
+    note_write();
     return true;
 }
 
 // KV查询（测试用）
 std::string MemoryDB::query_memory(const std::string& key) {
-    if (!db) return "";
-
     std::string result;
-    std::string select_sql = "SELECT value FROM kv_mem WHERE key = '" + key + "';";
+    if (!db || !stmts[STMT_KV_QUERY]) return result;
 
-    auto callback = [](void* data, int argc, char** argv, char** azColName) -> int {
-        if (argc > 0 && argv[0]) {
-            *(std::string*)data = argv[0];
-        }
-        return 0;
-    };
+    ReadLease conn(*this);
+    sqlite3_stmt* stmt = conn.acquire(STMT_KV_QUERY);
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, key);
 
-    char* err_msg = nullptr;
-    int rc = sqlite3_exec(db, select_sql.c_str(), callback, &result, &err_msg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "查询KV数据失败：" << err_msg << std::endl;
-        sqlite3_free(err_msg);
-        return "";
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        column_string(stmt, 0, result);
+    } else if (rc != SQLITE_DONE) {
+        std::cerr << "查询KV数据失败：" << sqlite3_errmsg(conn.handle()) << std::endl;
     }
-
     return result;
 }
 
@@ -180,103 +702,927 @@ bool MemoryDB::is_open() const {
     return db != nullptr;
 }
 
-// 获取/生成用户UID
+// 获取/生成用户UID：先在内存特征库中做最近邻匹配，无匹配才新建用户
+std::string MemoryDB::getUserUID(const FaceDescriptor& face_feature) {
+    if (!db || !stmts[STMT_USER_INSERT]) return "unknown_uid";
+    METRIC_TIME(UidLookup);
+
+    std::string matched_uid;
+    float distance = 0.0f;
+    bool found;
+    {
+        std::shared_lock<std::shared_mutex> gallery_lock(gallery_mutex);
+        found = gallery.findNearest(face_feature.data(), matched_uid, distance);
+    }
+    if (found) return matched_uid;  // 命中路径不打日志（耗时见UidLookup指标），只在新建用户时记录
+
+    // 新用户：UID取特征原始字节的MD5，特征按配置编码为BLOB
+    std::string uid = md5(std::string((const char*)face_feature.data(), kFloat32BlobSize));
+    std::vector<uint8_t> blob;
+    encode_descriptor(face_feature, feature_encoding, blob);
+
+    // 新增用户都持txn_mutex：取得锁后再匹配一次，同一人被两个线程同时认作新用户时只建一个
+    std::lock_guard<std::mutex> txn_lock(txn_mutex);
+    {
+        std::shared_lock<std::shared_mutex> gallery_lock(gallery_mutex);
+        if (gallery.findNearest(face_feature.data(), matched_uid, distance)) return matched_uid;
+    }
+    sqlite3_stmt* stmt = acquire(STMT_USER_INSERT);
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, uid);
+    sqlite3_bind_blob(stmt, 2, blob.data(), (int)blob.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)time(nullptr));
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "插入用户失败：" << sqlite3_errmsg(db) << std::endl;
+        return "unknown_uid";
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> gallery_lock(gallery_mutex);
+        gallery.addFace(uid, face_feature.data());
+    }
+    note_write();
+    METRIC_COUNT(NewUsers, 1);
+    std::cout << "新建用户成功，UID: " << uid << std::endl;
+    return uid;
+}
+
+// 兼容文本特征：能解析为128维则走特征匹配，否则按MD5精确匹配
 std::string MemoryDB::getUserUID(const std::string& face_feature) {
     if (!db) return "unknown_uid";
 
-    std::string uid = md5(face_feature);
-    char* err_msg = nullptr;
-    std::string select_sql = "SELECT uid FROM user_profile WHERE uid = '" + uid + "';";
+    FaceDescriptor desc;
+    if (parse_descriptor_text(face_feature, desc)) {
+        return getUserUID(desc);
+    }
 
-    // 回调函数：检查用户是否存在
-    bool user_exists = false;
-    auto callback = [](void* data, int argc, char** argv, char** azColName) -> int {
-        *(bool*)data = true;
-        return 0;
-    };
+    if (!stmts[STMT_USER_EXISTS]) return "unknown_uid";
+    std::string uid = md5(face_feature);
 
-    // 执行查询
-    int rc = sqlite3_exec(db, select_sql.c_str(), callback, &user_exists, &err_msg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "查询用户失败：" << err_msg << std::endl;
-        sqlite3_free(err_msg);
+    // 检查用户是否存在（查询与插入在同一把锁内，避免两个线程重复新建）
+    std::lock_guard<std::mutex> txn_lock(txn_mutex);
+    sqlite3_stmt* stmt = acquire(STMT_USER_EXISTS);
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, uid);
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        std::cerr << "查询用户失败：" << sqlite3_errmsg(db) << std::endl;
         return "unknown_uid";
     }
+    bool user_exists = (rc == SQLITE_ROW);
+    sqlite3_reset(stmt);
 
     // 不存在则新建用户
     if (!user_exists) {
-        time_t now = time(nullptr);
-        std::string insert_sql = "INSERT INTO user_profile (uid, face_feature, user_type, create_time) "
-                                 "VALUES ('" + uid + "', '" + face_feature + "', 'child', " + std::to_string(now) + ");";
-        
-        rc = sqlite3_exec(db, insert_sql.c_str(), nullptr, nullptr, &err_msg);
-        if (rc != SQLITE_OK) {
-            std::cerr << "插入用户失败：" << err_msg << std::endl;
-            sqlite3_free(err_msg);
+        sqlite3_stmt* insert = acquire(STMT_USER_INSERT);
+        StmtReset insert_guard(insert);
+        bind_string(insert, 1, uid);
+        bind_string(insert, 2, face_feature);
+        sqlite3_bind_int64(insert, 3, (sqlite3_int64)time(nullptr));
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            std::cerr << "插入用户失败：" << sqlite3_errmsg(db) << std::endl;
             return "unknown_uid";
         }
+        note_write();
         std::cout << "新建用户成功，UID: " << uid << std::endl;
     }
 
     return uid;
 }
 
-// 保存对话记忆
-bool MemoryDB::saveConversationMem(const ConversationMem& mem) {
-    if (!db) return false;
+namespace {
 
-    std::string insert_sql = "INSERT INTO conversation_mem (uid, user_text, robot_text, timestamp, scene_tag, is_core, image_path) "
-                             "VALUES ('" + mem.uid + "', '" + mem.user_text + "', '" + mem.robot_text + "', " + 
-                             std::to_string(mem.timestamp) + ", '" + mem.scene_tag + "', " + std::to_string(mem.is_core) + 
-                             ", '" + mem.image_path + "');";
+// 全文索引的正文：用户说的话、机器人回复和场景标签
+std::string fts_body(const ConversationMem& mem) {
+    return segment_for_index(mem.user_text + " " + mem.robot_text + " " + mem.scene_tag);
+}
 
-    char* err_msg = nullptr;
-    int rc = sqlite3_exec(db, insert_sql.c_str(), nullptr, nullptr, &err_msg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "保存记忆失败：" << err_msg << std::endl;
-        sqlite3_free(err_msg);
+} // namespace
+
+// 写入一条对话记忆及其全文索引（同步路径与写线程共用）
+// in_batch为true时调用方已持有txn_mutex并开启了事务
+// mem_id非空时插入成功后写入新记忆的mem_id（在提交之前）
+bool MemoryDB::insert_conversation_row(const ConversationMem& mem, bool in_batch, std::atomic<int64_t>* mem_id_out) {
+    // 不在事务中时自建事务，保证记忆与索引同时生效
+    std::unique_lock<std::mutex> txn_lock(txn_mutex, std::defer_lock);
+    if (!in_batch) txn_lock.lock();
+    bool own_txn = sqlite3_get_autocommit(db) != 0;
+    if (own_txn) {
+        sqlite3_step(acquire(STMT_BEGIN));
+        sqlite3_reset(stmts[STMT_BEGIN]);
+    }
+
+    bool ok = false;
+    sqlite3_int64 mem_id = 0;
+    {
+        sqlite3_stmt* stmt = acquire(STMT_MEM_INSERT);
+        StmtReset guard(stmt);
+        bind_string(stmt, 1, mem.uid);
+        bind_string(stmt, 2, mem.user_text);
+        bind_string(stmt, 3, mem.robot_text);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)mem.timestamp);
+        bind_string(stmt, 5, mem.scene_tag);
+        sqlite3_bind_int(stmt, 6, mem.is_core);
+        bind_string(stmt, 7, mem.image_path);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            mem_id = sqlite3_column_int64(stmt, 0);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+        }
+    }
+    if (ok && mem_id_out) mem_id_out->store(mem_id);
+    if (ok) {
+        std::string body = fts_body(mem);
+        sqlite3_stmt* stmt = acquire(STMT_FTS_INSERT);
+        StmtReset guard(stmt);
+        sqlite3_bind_int64(stmt, 1, mem_id);
+        bind_string(stmt, 2, mem.uid);
+        bind_string(stmt, 3, body);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    if (!ok) {
+        std::cerr << "保存记忆失败：" << sqlite3_errmsg(db) << std::endl;
+    }
+
+    if (own_txn) {
+        if (ok) {
+            ok = sqlite3_step(acquire(STMT_COMMIT)) == SQLITE_DONE;
+            sqlite3_reset(stmts[STMT_COMMIT]);
+        }
+        if (!ok) {
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        }
+    }
+    if (ok) note_write();
+    return ok;
+}
+
+// 为mem_id大于索引中最大rowid的记忆补建索引
+bool MemoryDB::catch_up_fts_index() {
+    sqlite3_int64 indexed_max = 0;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT coalesce(max(rowid), 0) FROM conversation_fts;", -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        indexed_max = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    const char* select_sql = "SELECT uid, user_text, robot_text, timestamp, scene_tag, is_core, image_path, mem_id "
+                             "FROM conversation_mem WHERE mem_id > ? ORDER BY mem_id;";
+    if (sqlite3_prepare_v2(db, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "补建全文索引失败：" << sqlite3_errmsg(db) << std::endl;
         return false;
     }
+    sqlite3_bind_int64(stmt, 1, indexed_max);
+
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    size_t added = 0;
+    ConversationMem mem;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        read_conversation_row(stmt, mem);
+        std::string body = fts_body(mem);
+        sqlite3_stmt* insert = acquire(STMT_FTS_INSERT);
+        StmtReset guard(insert);
+        sqlite3_bind_int64(insert, 1, sqlite3_column_int64(stmt, 7));
+        bind_string(insert, 2, mem.uid);
+        bind_string(insert, 3, body);
+        sqlite3_step(insert);
+        ++added;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+
+    if (added > 0) {
+        std::cout << "全文索引补建" << added << "条记忆" << std::endl;
+    }
+    return true;
+}
+
+// 保存对话记忆（开启异步写时只入队，不等待磁盘）
+bool MemoryDB::saveConversationMem(const ConversationMem& mem) {
+    if (!db || !stmts[STMT_MEM_INSERT]) return false;
+    METRIC_TIME(MemInsert);
+    METRIC_COUNT(MemsSaved, 1);
+
+    if (!write_queue) {
+        context_cache.beginAppend(mem.uid);
+        if (!insert_conversation_row(mem)) {
+            context_cache.cancelAppend(mem.uid);
+            return false;
+        }
+        context_cache.append(mem, true);
+        return true;
+    }
+
+    // 队列满时背压：唤醒写线程后睡在space_cv上，直到它取走一批腾出空位（不空转占CPU）
+    // 入队后写线程随时可能提交，所以同样要在入队前beginAppend，并先登记到pending_mems
+    std::shared_ptr<PendingMem> row = std::make_shared<PendingMem>(mem);
+    pending_mems.add(row);
+    context_cache.beginAppend(mem.uid);
+    if (!write_queue->try_push(row)) {
+        std::unique_lock<std::mutex> lock(writer_mutex);
+        while (!write_queue->try_push(row)) {
+            writer_cv.notify_one();
+            space_cv.wait(lock);
+        }
+    }
+    context_cache.append(mem, true);
+    uint64_t queued = ++enqueued_count;
+    if (queued - committed_count.load() >= batch_rows) {
+        writer_cv.notify_one();
+    }
+    return true;
+}
+
+bool MemoryDB::enableAsyncWrites(size_t rows, int max_latency_ms, size_t queue_capacity) {
+    if (!db || !stmts[STMT_MEM_INSERT]) return false;
+    if (write_queue) return true;
 
+    batch_rows = rows > 0 ? rows : 1;
+    batch_latency_ms = max_latency_ms > 0 ? max_latency_ms : 1;
+    write_queue.reset(new MpscQueue<std::shared_ptr<PendingMem>>(queue_capacity));
+    writer_stop = false;
+    writer_thread = std::thread(&MemoryDB::writer_loop, this);
     return true;
 }
 
+// 写线程：攒够一批或超时后，在一个事务内提交
+void MemoryDB::writer_loop() {
+    std::vector<std::shared_ptr<PendingMem>> batch;
+    batch.reserve(batch_rows);
+    std::shared_ptr<PendingMem> mem;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(writer_mutex);
+            writer_cv.wait_for(lock, std::chrono::milliseconds(batch_latency_ms), [this] {
+                return writer_stop.load() ||
+                       flush_target.load() > committed_count.load() ||
+                       write_queue->size_approx() >= batch_rows;
+            });
+        }
+
+        // 一次最多取batch_rows条，剩余的留给下一轮（避免单个事务过大）
+        do {
+            batch.clear();
+            while (batch.size() < batch_rows && write_queue->try_pop(mem)) {
+                batch.push_back(std::move(mem));
+            }
+            if (batch.empty()) break;
+            // 队列已腾出空位：先唤醒背压中的入队方，再提交（持一下锁，避免与其检查队列之间丢失通知）
+            { std::lock_guard<std::mutex> lock(writer_mutex); }
+            space_cv.notify_all();
+
+            size_t failed = commit_batch(batch);
+            for (const std::shared_ptr<PendingMem>& row : batch) pending_mems.remove(row);
+            {
+                std::lock_guard<std::mutex> lock(writer_mutex);
+                failed_count += failed;
+                committed_count += batch.size();
+            }
+            flushed_cv.notify_all();
+        } while (batch.size() == batch_rows);
+
+        if (writer_stop.load() && write_queue->size_approx() == 0) break;
+    }
+}
+
+// 一批记忆在一个事务内提交，返回失败的条数
+// 批内有一条失败（或COMMIT失败）时整批回滚，再逐条单独提交，只丢掉真正写不进去的那几条；
+// 失败的记忆已写穿进上下文缓存，作废该用户的缓存，下次查询从库里重新填充
+// 各条插入后即填mem_id（提交前），读方据此与SQL结果去重；回滚后重试的会换成新的mem_id
+size_t MemoryDB::commit_batch(const std::vector<std::shared_ptr<PendingMem>>& batch) {
+    METRIC_TIME(MemBatchCommit);
+    std::lock_guard<std::mutex> txn_lock(txn_mutex);
+    bool in_txn = sqlite3_step(acquire(STMT_BEGIN)) == SQLITE_DONE;
+    sqlite3_reset(stmts[STMT_BEGIN]);
+    if (in_txn) {
+        bool ok = true;
+        for (const std::shared_ptr<PendingMem>& row : batch) {
+            if (!insert_conversation_row(row->mem, true, &row->mem_id)) {
+                ok = false;
+                break;
+            }
+        }
+        if (ok) {
+            ok = sqlite3_step(acquire(STMT_COMMIT)) == SQLITE_DONE;
+            sqlite3_reset(stmts[STMT_COMMIT]);
+            if (!ok) std::cerr << "批量提交失败：" << sqlite3_errmsg(db) << std::endl;
+        }
+        if (ok) return 0;
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+
+    // 未能开启事务或批量提交失败：逐条各自提交（insert_conversation_row自建事务）
+    size_t failed = 0;
+    for (const std::shared_ptr<PendingMem>& row : batch) {
+        if (!insert_conversation_row(row->mem, true, &row->mem_id)) {
+            row->failed = true;
+            context_cache.invalidate(row->mem.uid);
+            ++failed;
+        }
+    }
+    if (failed > 0) std::cerr << "异步写入丢失" << failed << "条记忆" << std::endl;
+    return failed;
+}
+
+bool MemoryDB::flush() {
+    if (!write_queue) return true;
+
+    uint64_t target = enqueued_count.load();
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    if (flush_target.load() < target) flush_target = target;
+    writer_cv.notify_one();
+    flushed_cv.wait(lock, [this, target] { return committed_count.load() >= target; });
+    uint64_t failed = failed_count.load();
+    bool ok = failed == failed_reported;
+    failed_reported = failed;
+    return ok;
+}
+
+// 停止写线程（剩余队列全部落库后退出）
+void MemoryDB::stop_async_writes() {
+    if (!writer_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        writer_stop = true;
+    }
+    writer_cv.notify_one();
+    writer_thread.join();
+    write_queue.reset();
+}
+
+namespace {
+
+// 把未提交的记忆并入时间倒序的rows（最多limit条），返回并入的条数
+// 已失败的丢弃；写线程已插入、且mem_id在本次SQL读到的sql_ids里的，说明读快照已包含它，不重复加入
+// 同一时间戳下未提交的比库里的新（mem_id更大），排在前面，与ORDER BY timestamp DESC, mem_id DESC一致
+size_t merge_pending(const std::vector<std::shared_ptr<PendingMem>>& pending, const std::vector<int64_t>& sql_ids,
+                     size_t limit, std::vector<ConversationMem>& rows) {
+    size_t added = 0;
+    for (size_t i = pending.size(); i-- > 0;) {  // 后入队的更新
+        const PendingMem& p = *pending[i];
+        if (p.failed.load()) continue;
+        int64_t id = p.mem_id.load();
+        if (id != 0 && std::find(sql_ids.begin(), sql_ids.end(), id) != sql_ids.end()) continue;
+        rows.insert(rows.begin() + added, p.mem);
+        ++added;
+    }
+    if (added == 0) return 0;
+    std::stable_sort(rows.begin(), rows.end(), [](const ConversationMem& a, const ConversationMem& b) {
+        return a.timestamp > b.timestamp;
+    });
+    if (rows.size() > limit) rows.resize(limit);
+    return added;
+}
+
+} // namespace
+
 // 获取用户上下文记忆
 std::vector<ConversationMem> MemoryDB::getUserContextMem(const std::string& uid, int top_k) {
     std::vector<ConversationMem> mems;
-    if (!db) return mems;
+    getUserContextMem(uid, top_k, mems);
+    return mems;
+}
+
+// 获取用户上下文记忆：先查环形缓存，未命中再查库并回填缓存
+bool MemoryDB::getUserContextMem(const std::string& uid, int top_k, std::vector<ConversationMem>& out) {
+    METRIC_TIME(ContextQuery);
+    if (context_cache.get(uid, top_k, out)) return true;
 
-    std::string select_sql = "SELECT uid, user_text, robot_text, timestamp, scene_tag, is_core, image_path "
-                             "FROM conversation_mem WHERE uid = '" + uid + "' "
-                             "ORDER BY timestamp DESC LIMIT " + std::to_string(top_k) + ";";
+    out.clear();
+    if (!db || !stmts[STMT_MEM_CONTEXT]) return false;
 
-    // 回调函数：解析查询结果
-    auto callback = [](void* data, int argc, char** argv, char** azColName) -> int {
-        std::vector<ConversationMem>* mems = (std::vector<ConversationMem>*)data;
+    // 写入戳最先取：此后的写入都会让回填作废
+    uint64_t stamp = context_cache.writeStamp(uid);
+    // 不等写线程提交（读不被写阻塞）：查SQL前取出本用户还在异步写队列里的记忆，读完后合并
+    std::vector<std::shared_ptr<PendingMem>> pending;
+    pending_mems.collect(uid, pending);
+
+    int limit = top_k;
+    if (context_cache.enabled() && static_cast<int>(context_cache.ringSize()) > limit) {
+        limit = static_cast<int>(context_cache.ringSize());
+    }
+
+    ReadLease conn(*this);
+    std::vector<ConversationMem>& rows = conn.rows();
+    sqlite3_stmt* stmt = conn.acquire(STMT_MEM_CONTEXT);
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, uid);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    size_t n = 0;
+    std::vector<int64_t> sql_ids;  // 只在有未提交记忆时记录，用于去重
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (n == rows.size()) rows.emplace_back();
+        read_conversation_row(stmt, rows[n++]);
+        if (!pending.empty()) sql_ids.push_back(sqlite3_column_int64(stmt, 7));
+    }
+    if (rc != SQLITE_DONE) {
+        std::cerr << "查询记忆失败：" << sqlite3_errmsg(conn.handle()) << std::endl;
+        return false;
+    }
+    rows.resize(n);
+    sqlite3_reset(stmt);
+
+    // 热表之外还有归档记忆时合并回读（核心记忆可能比归档更旧，所以热表取满也要比较时间）
+    load_archived_context(conn, uid, static_cast<size_t>(limit), rows);
+    size_t total = rows.size();  // 截断前的条数，不足limit说明已取到该用户全部记忆
+    if (!pending.empty()) total += merge_pending(pending, sql_ids, static_cast<size_t>(limit), rows);
+    n = rows.size();
+    context_cache.fill(uid, rows, total < static_cast<size_t>(limit), stamp);
+
+    size_t want = top_k > 0 ? static_cast<size_t>(top_k) : 0;
+    out.assign(rows.begin(), rows.begin() + (n < want ? n : want));
+    return true;
+}
+
+void MemoryDB::setRetrievalWeights(const RetrievalWeights& weights) {
+    retrieval_weights = weights;
+}
+
+// 相关性检索：FTS5取候选 -> 结合BM25、时间衰减、核心记忆重新打分 -> 按字数预算截取
+std::vector<ConversationMem> MemoryDB::retrieveRelevantMem(const std::string& uid, const std::string& query,
+                                                           int top_k, size_t char_budget) {
+    METRIC_TIME(MemRetrieve);
+    std::vector<ConversationMem> result;
+    if (!db || !stmts[STMT_FTS_SEARCH] || top_k <= 0) return result;
+
+    // 不等写线程提交：还在异步写队列里的本用户记忆在内存中按查询词匹配后并入候选（见下）
+    std::vector<std::shared_ptr<PendingMem>> pending;
+    pending_mems.collect(uid, pending);
+    const std::vector<std::string> query_terms = segment_for_query(query);
+    std::vector<std::vector<std::string>> pending_tokens(pending.size());  // 与pending一一对应
+    for (size_t i = 0; i < pending.size(); ++i) {
+        const ConversationMem& m = pending[i]->mem;
+        segment_terms(m.user_text + " " + m.robot_text + " " + m.scene_tag, pending_tokens[i]);
+    }
+
+    ReadLease conn(*this);
+
+    // 按文档频率筛选查询词：去掉无命中的词和出现在10%以上记忆中的高频词（"我们"、"今天"等），
+    // 高频词对排序贡献很小，却决定了BM25需要打分的行数
+    // 文档频率包括未提交的记忆：只出现在队列中的新话题词（索引里还没有）也要保留
+    std::vector<std::string> terms;
+    {
+        std::vector<std::pair<sqlite3_int64, std::string>> df;
+        for (const std::string& t : query_terms) {
+            sqlite3_int64 docs = 0;
+            for (const std::vector<std::string>& tokens : pending_tokens) {
+                if (std::find(tokens.begin(), tokens.end(), t) != tokens.end()) ++docs;
+            }
+            sqlite3_stmt* stmt = conn.acquire(STMT_FTS_TERM_DOCS);
+            StmtReset guard(stmt);
+            bind_string(stmt, 1, t);
+            if (sqlite3_step(stmt) == SQLITE_ROW) docs += sqlite3_column_int64(stmt, 0);
+            if (docs > 0) df.push_back(std::make_pair(docs, t));
+        }
+        sqlite3_int64 total_docs = static_cast<sqlite3_int64>(pending.size());
+        {
+            sqlite3_stmt* stmt = conn.acquire(STMT_MEM_MAX_ID);
+            StmtReset guard(stmt);
+            if (sqlite3_step(stmt) == SQLITE_ROW) total_docs += sqlite3_column_int64(stmt, 0);
+        }
+        std::sort(df.begin(), df.end());
+        for (size_t i = 0; i < df.size(); ++i) {
+            // 至少保留最稀有的两个词
+            if (i >= 2 && df[i].first * 10 > total_docs) break;
+            terms.push_back(df[i].second);
+        }
+    }
+    if (terms.empty()) {
+        // 库里没有可用的查询词时退回最近记忆（其中已合并未提交的记忆）
+        conn.release();  // getUserContextMem自己租用连接
+        return getUserContextMem(uid, top_k);
+    }
+
+    // MATCH表达式：uid : "xxx" AND ("词1" OR "词2" ...)，词内双引号转义
+    auto quote = [](const std::string& t) {
+        std::string q = "\"";
+        for (char c : t) {
+            if (c == '"') q.push_back('"');
+            q.push_back(c);
+        }
+        q.push_back('"');
+        return q;
+    };
+    std::string match = "uid : " + quote(uid) + " AND (";
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (i > 0) match += " OR ";
+        match += quote(terms[i]);
+    }
+    match += ")";
+
+    struct Candidate {
         ConversationMem mem;
-        mem.uid = argv[0] ? argv[0] : "";
-        mem.user_text = argv[1] ? argv[1] : "";
-        mem.robot_text = argv[2] ? argv[2] : "";
-        mem.timestamp = argv[3] ? atol(argv[3]) : 0;
-        mem.scene_tag = argv[4] ? argv[4] : "";
-        mem.is_core = argv[5] ? atoi(argv[5]) : 0;
-        mem.image_path = argv[6] ? argv[6] : "";
-        mems->push_back(mem);
-        return 0;
+        double bm25;
+        double score;
     };
+    std::vector<Candidate> candidates;
+    std::vector<int64_t> found_ids;  // 只在有未提交记忆时记录，用于去重
+    {
+        sqlite3_stmt* stmt = conn.acquire(STMT_FTS_SEARCH);
+        StmtReset guard(stmt);
+        bind_string(stmt, 1, match);
+        sqlite3_bind_int(stmt, 2, std::max(top_k * 8, 64));
+        std::vector<ArchivedMem> chunk;  // 最近解压的归档块，同一块内的多个命中只解压一次
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            candidates.emplace_back();
+            if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+                read_conversation_row(stmt, candidates.back().mem);
+            } else if (!load_archived_row(conn, uid, sqlite3_column_int64(stmt, 8), chunk, candidates.back().mem)) {
+                candidates.pop_back();
+                continue;
+            }
+            candidates.back().bm25 = -sqlite3_column_double(stmt, 7);  // bm25越小越相关，取反
+            if (!pending.empty()) found_ids.push_back(sqlite3_column_int64(stmt, 8));
+        }
+        if (rc != SQLITE_DONE) {
+            std::cerr << "检索记忆失败：" << sqlite3_errmsg(conn.handle()) << std::endl;
+        }
+    }
+    conn.release();  // 之后只在内存中打分排序
 
-    char* err_msg = nullptr;
-    int rc = sqlite3_exec(db, select_sql.c_str(), callback, &mems, &err_msg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "查询记忆失败：" << err_msg << std::endl;
-        sqlite3_free(err_msg);
-        return mems;
+    double max_bm25 = 0.0;
+    for (const Candidate& c : candidates) max_bm25 = std::max(max_bm25, c.bm25);
+
+    // 未提交的记忆没有BM25：按命中的（筛选后的）查询词比例折算到已有候选的最高分（全部命中与最相关的一条同分）
+    if (!pending.empty()) {
+        const double scale = max_bm25 > 0.0 ? max_bm25 : 1.0;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const std::shared_ptr<PendingMem>& p = pending[i];
+            if (p->failed.load()) continue;
+            int64_t id = p->mem_id.load();
+            if (id != 0 && std::find(found_ids.begin(), found_ids.end(), id) != found_ids.end()) continue;
+            const std::vector<std::string>& tokens = pending_tokens[i];
+            size_t matched = 0;
+            for (const std::string& t : terms) {
+                if (std::find(tokens.begin(), tokens.end(), t) != tokens.end()) ++matched;
+            }
+            if (matched == 0) continue;
+            candidates.emplace_back();
+            candidates.back().mem = p->mem;
+            candidates.back().bm25 = scale * matched / terms.size();
+        }
+        for (const Candidate& c : candidates) max_bm25 = std::max(max_bm25, c.bm25);
+    }
+    time_t now = time(nullptr);
+    const RetrievalWeights& w = retrieval_weights;
+    for (Candidate& c : candidates) {
+        double relevance = max_bm25 > 0.0 ? c.bm25 / max_bm25 : 0.0;
+        double age_days = std::max(0.0, difftime(now, c.mem.timestamp) / 86400.0);
+        double recency = std::pow(0.5, age_days / std::max(w.half_life_days, 1e-6));
+        c.score = w.text * relevance + w.recency * recency + w.core * (c.mem.is_core ? 1.0 : 0.0);
     }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.score > b.score;
+    });
 
-    return mems;
+    // 按分数从高到低装入，超出字数预算的条目跳过
+    size_t used = 0;
+    for (Candidate& c : candidates) {
+        if (static_cast<int>(result.size()) >= top_k) break;
+        size_t chars = utf8_length(c.mem.user_text) + utf8_length(c.mem.robot_text);
+        if (char_budget > 0 && used + chars > char_budget) continue;
+        used += chars;
+        result.push_back(std::move(c.mem));
+    }
+    return result;
+}
+
+void MemoryDB::configureContextCache(size_t ring_size, size_t budget_bytes) {
+    context_cache.configure(ring_size, budget_bytes);
 }
 
-// 测试主函数
+ContextCacheStats MemoryDB::contextCacheStats() {
+    return context_cache.snapshot();
+}
+
+// 数据库当前大小（字节）
+int64_t MemoryDB::database_bytes() {
+    int64_t bytes = 0;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size();",
+                           -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        bytes = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return bytes;
+}
+
+// 把归档中比热表结果更新的记忆合并进rows（时间倒序，最多limit条）
+bool MemoryDB::load_archived_context(ReadLease& conn, const std::string& uid, size_t limit,
+                                     std::vector<ConversationMem>& rows) {
+    sqlite3_stmt* stmt = conn.acquire(STMT_ARCHIVE_BY_UID);
+    if (!stmt) return false;
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, uid);
+
+    std::string raw;
+    std::vector<ArchivedMem> chunk;
+    bool merged = false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        // 归档块按last_ts倒序，一旦不比已有的第limit条更新，后面的块都不需要解压
+        time_t last_ts = (time_t)sqlite3_column_int64(stmt, 0);
+        if (rows.size() >= limit && (rows.empty() || last_ts <= rows.back().timestamp)) break;
+
+        if (!decompress_archive(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1), raw) ||
+            !deserialize_archive(raw, uid, chunk)) {
+            std::cerr << "归档块解压失败：" << uid << std::endl;
+            continue;
+        }
+        for (ArchivedMem& r : chunk) rows.push_back(std::move(r.mem));
+        std::stable_sort(rows.begin(), rows.end(), [](const ConversationMem& a, const ConversationMem& b) {
+            return a.timestamp > b.timestamp;
+        });
+        if (rows.size() > limit) rows.resize(limit);
+        merged = true;
+    }
+    return merged;
+}
+
+// 按mem_id回读一条已归档的记忆；chunk缓存上次解压的块
+bool MemoryDB::load_archived_row(ReadLease& conn, const std::string& uid, int64_t mem_id,
+                                 std::vector<ArchivedMem>& chunk, ConversationMem& mem) {
+    auto find_in = [&](const std::vector<ArchivedMem>& rows) {
+        auto it = std::lower_bound(rows.begin(), rows.end(), mem_id,
+                                   [](const ArchivedMem& r, int64_t id) { return r.mem_id < id; });
+        if (it == rows.end() || it->mem_id != mem_id) return false;
+        mem = it->mem;
+        return true;
+    };
+    if (find_in(chunk)) return true;
+
+    sqlite3_stmt* stmt = conn.acquire(STMT_ARCHIVE_BY_MEM);
+    if (!stmt) return false;
+    StmtReset guard(stmt);
+    bind_string(stmt, 1, uid);
+    sqlite3_bind_int64(stmt, 2, mem_id);
+    sqlite3_bind_int64(stmt, 3, mem_id);
+    std::string raw;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (decompress_archive(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0), raw) &&
+            deserialize_archive(raw, uid, chunk) && find_in(chunk)) {
+            return true;
+        }
+    }
+    chunk.clear();
+    return false;
+}
+
+// 归档整理：按用户把非核心冷记忆每chunk_rows条压缩成一块，写入归档表并从热表删除
+// 全文索引条目保留（rowid即原mem_id），检索命中已归档的记忆时回读对应的块
+RetentionReport MemoryDB::runRetention(const RetentionPolicy& policy) {
+    RetentionReport report = RetentionReport();
+    if (!db) return report;
+
+    flush();
+    report.db_bytes_before = database_bytes();
+    sqlite3_int64 cutoff = (sqlite3_int64)time(nullptr) - (sqlite3_int64)policy.max_age_days * 86400;
+    int chunk_rows = policy.chunk_rows > 0 ? policy.chunk_rows : 1;
+
+    sqlite3_stmt* uid_stmt = nullptr;
+    sqlite3_stmt* select_stmt = nullptr;
+    sqlite3_stmt* archive_stmt = nullptr;
+    sqlite3_stmt* delete_stmt = nullptr;
+    bool ok =
+        sqlite3_prepare_v2(db, "SELECT DISTINCT uid FROM conversation_mem WHERE is_core = 0 AND timestamp < ?;",
+                           -1, &uid_stmt, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, "SELECT uid, user_text, robot_text, timestamp, scene_tag, is_core, image_path, mem_id "
+                               "FROM conversation_mem WHERE uid = ? AND is_core = 0 AND timestamp < ? "
+                               "ORDER BY mem_id LIMIT ?;",
+                           -1, &select_stmt, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, "INSERT INTO conversation_archive (uid, first_mem_id, last_mem_id, first_ts, last_ts, "
+                               "row_count, raw_bytes, data) VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+                           -1, &archive_stmt, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, "DELETE FROM conversation_mem WHERE mem_id = ?;", -1, &delete_stmt, nullptr) == SQLITE_OK;
+    if (!ok) {
+        std::cerr << "归档整理失败：" << sqlite3_errmsg(db) << std::endl;
+    }
+
+    std::vector<std::string> uids;
+    if (ok) {
+        sqlite3_bind_int64(uid_stmt, 1, cutoff);
+        std::string uid;
+        while (sqlite3_step(uid_stmt) == SQLITE_ROW) {
+            column_string(uid_stmt, 0, uid);
+            uids.push_back(uid);
+        }
+    }
+
+    std::vector<ArchivedMem> rows;
+    std::string raw, packed;
+    for (size_t u = 0; ok && u < uids.size(); ++u) {
+        const std::string& uid = uids[u];
+        for (;;) {
+            // 每块一个事务，整理期间交互线程的写入只需等待一块
+            std::lock_guard<std::mutex> txn_lock(txn_mutex);
+            sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+
+            rows.clear();
+            sqlite3_reset(select_stmt);
+            bind_string(select_stmt, 1, uid);
+            sqlite3_bind_int64(select_stmt, 2, cutoff);
+            sqlite3_bind_int(select_stmt, 3, chunk_rows);
+            while (sqlite3_step(select_stmt) == SQLITE_ROW) {
+                rows.emplace_back();
+                read_conversation_row(select_stmt, rows.back().mem);
+                rows.back().mem_id = sqlite3_column_int64(select_stmt, 7);
+            }
+            sqlite3_reset(select_stmt);
+            if (rows.empty()) {
+                sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+                break;
+            }
+
+            serialize_archive(rows, raw);
+            ok = compress_archive(raw, packed);
+            time_t first_ts = rows.front().mem.timestamp, last_ts = first_ts;
+            for (const ArchivedMem& r : rows) {
+                first_ts = std::min(first_ts, r.mem.timestamp);
+                last_ts = std::max(last_ts, r.mem.timestamp);
+            }
+            if (ok) {
+                sqlite3_reset(archive_stmt);
+                bind_string(archive_stmt, 1, uid);
+                sqlite3_bind_int64(archive_stmt, 2, rows.front().mem_id);
+                sqlite3_bind_int64(archive_stmt, 3, rows.back().mem_id);
+                sqlite3_bind_int64(archive_stmt, 4, (sqlite3_int64)first_ts);
+                sqlite3_bind_int64(archive_stmt, 5, (sqlite3_int64)last_ts);
+                sqlite3_bind_int(archive_stmt, 6, (int)rows.size());
+                sqlite3_bind_int64(archive_stmt, 7, (sqlite3_int64)raw.size());
+                sqlite3_bind_blob(archive_stmt, 8, packed.data(), (int)packed.size(), SQLITE_STATIC);
+                ok = sqlite3_step(archive_stmt) == SQLITE_DONE;
+            }
+            for (size_t i = 0; ok && i < rows.size(); ++i) {
+                sqlite3_reset(delete_stmt);
+                sqlite3_bind_int64(delete_stmt, 1, rows[i].mem_id);
+                ok = sqlite3_step(delete_stmt) == SQLITE_DONE;
+            }
+            if (ok) ok = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK;
+            if (!ok) {
+                std::cerr << "归档整理失败：" << sqlite3_errmsg(db) << std::endl;
+                sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+                break;
+            }
+
+            report.rows_archived += rows.size();
+            report.chunks += 1;
+            report.raw_bytes += raw.size();
+            report.compressed_bytes += packed.size();
+            if (static_cast<int>(rows.size()) < chunk_rows) break;
+        }
+        context_cache.invalidate(uid);
+    }
+    sqlite3_finalize(uid_stmt);
+    sqlite3_finalize(select_stmt);
+    sqlite3_finalize(archive_stmt);
+    sqlite3_finalize(delete_stmt);
+
+    // 回收删除留下的空闲页（旧库未开启auto_vacuum时空闲页留给后续写入复用）
+    if (report.rows_archived > 0) {
+        std::lock_guard<std::mutex> txn_lock(txn_mutex);
+        sqlite3_exec(db, "PRAGMA incremental_vacuum;", nullptr, nullptr, nullptr);
+        note_write();
+    }
+    report.db_bytes_after = database_bytes();
+
+    std::cout << "归档整理：" << report.rows_archived << "条记忆压缩为" << report.chunks << "块（"
+              << report.raw_bytes << " -> " << report.compressed_bytes << " 字节），数据库 "
+              << report.db_bytes_before << " -> " << report.db_bytes_after << " 字节" << std::endl;
+    return report;
+}
+
+void MemoryDB::startRetention(const RetentionPolicy& policy) {
+    if (!db) return;
+    {
+        std::lock_guard<std::mutex> lock(retention_mutex);
+        retention_policy = policy;
+        retention_stop = false;
+    }
+    if (!retention_thread.joinable()) {
+        retention_thread = std::thread(&MemoryDB::retention_loop, this);
+    } else {
+        retention_cv.notify_one();
+    }
+}
+
+// 后台归档线程：启动后先整理一次，之后每interval_sec秒一次
+void MemoryDB::retention_loop() {
+    std::unique_lock<std::mutex> lock(retention_mutex);
+    while (!retention_stop) {
+        RetentionPolicy policy = retention_policy;
+        lock.unlock();
+        runRetention(policy);
+        lock.lock();
+        retention_cv.wait_for(lock, std::chrono::seconds(retention_policy.interval_sec), [this] {
+            return retention_stop;
+        });
+    }
+}
+
+void MemoryDB::stop_retention() {
+    if (!retention_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(retention_mutex);
+        retention_stop = true;
+    }
+    retention_cv.notify_one();
+    retention_thread.join();
+}
+
+// 照片去重索引：启动时从image_hash表载入max_age_sec内的照片
+bool MemoryDB::load_image_index() {
+    const ImageDedupOptions& opts = image_index.options();
+    image_index.configure(opts);
+    int64_t since = opts.max_age_sec > 0 ? static_cast<int64_t>(time(nullptr)) - opts.max_age_sec : 0;
+    sqlite3_stmt* stmt = acquire(STMT_IMAGE_RECENT);
+    StmtReset guard(stmt);
+    sqlite3_bind_int64(stmt, 1, since);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* uid = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        image_index.add(uid ? uid : "", static_cast<uint64_t>(sqlite3_column_int64(stmt, 1)), path ? path : "",
+                        sqlite3_column_int64(stmt, 3), false);
+    }
+    if (rc != SQLITE_DONE) {
+        std::cerr << "载入照片哈希失败：" << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 命中的照片文件可能已被清理（如夜间清理images/*.jpg）：复用前确认文件还在，
+// 不在则从索引和image_hash表中撤销该照片并继续找，避免把失效路径写进conversation_mem
+bool MemoryDB::findDuplicateImage(const std::string& uid, uint64_t hash, std::string& image_path) {
+    int distance = 0;
+    std::string path;
+    while (image_index.find(uid, hash, static_cast<int64_t>(time(nullptr)), path, distance)) {
+        if (access(path.c_str(), F_OK) == 0) {
+            image_path = path;
+            METRIC_COUNT(ImagesDeduplicated, 1);
+            return true;
+        }
+        evict_stale_image(uid, path);
+    }
+    return false;
+}
+
+void MemoryDB::evict_stale_image(const std::string& uid, const std::string& image_path) {
+    image_index.evict(uid, image_path);
+    if (!db || !stmts[STMT_IMAGE_DELETE]) return;
+    {
+        std::lock_guard<std::mutex> txn_lock(txn_mutex);
+        sqlite3_stmt* stmt = acquire(STMT_IMAGE_DELETE);
+        StmtReset guard(stmt);
+        bind_string(stmt, 1, uid);
+        bind_string(stmt, 2, image_path);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "撤销照片哈希失败：" << sqlite3_errmsg(db) << std::endl;
+            return;
+        }
+    }
+    note_write();
+}
+
+bool MemoryDB::registerImage(const std::string& uid, uint64_t hash, const std::string& image_path) {
+    if (!db || !stmts[STMT_IMAGE_INSERT] || image_path.empty()) return false;
+    int64_t now = static_cast<int64_t>(time(nullptr));
+    {
+        std::lock_guard<std::mutex> txn_lock(txn_mutex);
+        sqlite3_stmt* stmt = acquire(STMT_IMAGE_INSERT);
+        StmtReset guard(stmt);
+        bind_string(stmt, 1, uid);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(hash));
+        bind_string(stmt, 3, image_path);
+        sqlite3_bind_int64(stmt, 4, now);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "登记照片哈希失败：" << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+    }
+    note_write();
+    image_index.add(uid, hash, image_path, now);
+    return true;
+}
+
+void MemoryDB::setImageDedupOptions(const ImageDedupOptions& options) {
+    image_index.configure(options);
+    if (db && stmts[STMT_IMAGE_RECENT]) {
+        std::lock_guard<std::mutex> txn_lock(txn_mutex);
+        load_image_index();
+    }
+}
+
+ImageDedupStats MemoryDB::imageDedupStats() {
+    return image_index.snapshot();
+}
+
+// 测试主函数（链接到其他程序时定义MEMORYROBOT_NO_TEST_MAIN去掉）
+#ifndef MEMORYROBOT_NO_TEST_MAIN
 int main() {
     std::string db_path = "./test.db"; 
     MemoryDB db(db_path);
@@ -311,11 +1657,60 @@ int main() {
         std::string uid = db.getUserUID(face_feature);
         std::cout << "用户UID: " << uid << std::endl;
 
+        // 测试人脸近邻匹配：同一人两帧特征有微小差异，应得到同一UID
+        FaceDescriptor base, jittered, other;
+        for (int i = 0; i < kFaceDescriptorDim; ++i) {
+            base[i] = 0.1f * std::sin(i * 0.37f);
+            jittered[i] = base[i] + ((i % 2) ? 0.01f : -0.01f);
+            other[i] = 0.1f * std::cos(i * 1.3f);
+        }
+        std::string face_uid1 = db.getUserUID(base);
+        std::string face_uid2 = db.getUserUID(jittered);
+        std::string face_uid3 = db.getUserUID(other);
+
+        // 测试特征BLOB编解码误差
+        bool codec_ok = true;
+        std::vector<uint8_t> blob;
+        const DescriptorEncoding encodings[] = {DescriptorEncoding::Float32, DescriptorEncoding::Float16, DescriptorEncoding::Int8};
+        for (DescriptorEncoding enc : encodings) {
+            FaceDescriptor decoded;
+            encode_descriptor(base, enc, blob);
+            if (!decode_descriptor(blob.data(), blob.size(), decoded) ||
+                std::sqrt(l2_distance_sq(base.data(), decoded.data(), kFaceDescriptorDim)) > 0.01f) {
+                codec_ok = false;
+            }
+            std::cout << "特征编码" << static_cast<int>(enc) << "：BLOB " << blob.size() << " 字节" << std::endl;
+        }
+
+        // HNSW索引：小阈值强制建索引，每个特征都应能找回自己
+        FaceGallery indexed_gallery(0.6f, 16);
+        std::mt19937 gen(7);
+        std::normal_distribution<float> noise(0.0f, 0.1f);
+        std::vector<std::vector<float>> samples(200, std::vector<float>(kFaceDescriptorDim));
+        for (size_t n = 0; n < samples.size(); ++n) {
+            for (int i = 0; i < kFaceDescriptorDim; ++i) samples[n][i] = noise(gen);
+            indexed_gallery.addFace("u" + std::to_string(n), samples[n].data());
+        }
+        size_t hnsw_hits = 0;
+        for (size_t n = 0; n < samples.size(); ++n) {
+            std::string hit_uid;
+            float hit_dist = 0.0f;
+            if (indexed_gallery.findNearest(samples[n].data(), hit_uid, hit_dist) && hit_uid == "u" + std::to_string(n)) {
+                ++hnsw_hits;
+            }
+        }
+        if (face_uid1 == face_uid2 && face_uid1 != face_uid3 && codec_ok && indexed_gallery.indexed() && hnsw_hits == samples.size()) {
+            std::cout << "人脸近邻匹配测试通过" << std::endl;
+        } else {
+            std::cerr << "人脸近邻匹配测试失败" << std::endl;
+            return 1;
+        }
+
         // 测试对话记忆保存
         ConversationMem mem;
         mem.uid = uid;
-        mem.user_text = "你好，机器人";
-        mem.robot_text = "你好呀！";
+        mem.user_text = "你好，机器人，I'm Tom";
+        mem.robot_text = "你好呀！Nice to meet you, 'Tom'";
         mem.timestamp = time(nullptr);
         mem.scene_tag = "home";
         mem.is_core = 1;
@@ -338,5 +1733,603 @@ int main() {
         return 1;
     }
 
+    // 测试持久化模式：写入后重新打开，记忆应仍然存在
+    const StorageMode durable_modes[] = {StorageMode::Disk, StorageMode::Hybrid};
+    for (StorageMode mode : durable_modes) {
+        std::string durable_path = "./test_durable.db";
+        unlink(durable_path.c_str());
+        {
+            MemoryDB writer(durable_path, mode);
+            if (!writer.init_db()) return 1;
+            ConversationMem mem;
+            mem.uid = "durable_uid";
+            mem.user_text = "还记得我吗";
+            mem.robot_text = "记得！";
+            mem.timestamp = time(nullptr);
+            mem.scene_tag = "home";
+            mem.is_core = 1;
+            writer.saveConversationMem(mem);
+        }
+        size_t restored = 0;
+        {
+            MemoryDB reader(durable_path, mode);
+            if (!reader.init_db()) return 1;
+            restored = reader.getUserContextMem("durable_uid", 5).size();
+        }
+        unlink(durable_path.c_str());
+        unlink((durable_path + "-wal").c_str());
+        unlink((durable_path + "-shm").c_str());
+        if (restored != 1) {
+            std::cerr << "持久化测试失败（模式" << static_cast<int>(mode) << "）" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "持久化测试通过" << std::endl;
+
+    // 测试异步批量写：多线程并发入队，flush后应全部可查
+    {
+        MemoryDB async_db(db_path);
+        if (!async_db.init_db() || !async_db.enableAsyncWrites(64, 50, 256)) return 1;
+        const int kThreads = 4, kPerThread = 500;
+        std::vector<std::thread> producers;
+        for (int t = 0; t < kThreads; ++t) {
+            producers.emplace_back([&async_db, t]() {
+                for (int i = 0; i < kPerThread; ++i) {
+                    ConversationMem mem;
+                    mem.uid = "async_uid";
+                    mem.user_text = "第" + std::to_string(t) + "-" + std::to_string(i) + "句";
+                    mem.robot_text = "收到";
+                    mem.timestamp = time(nullptr);
+                    mem.is_core = 0;
+                    async_db.saveConversationMem(mem);
+                }
+            });
+        }
+        for (auto& p : producers) p.join();
+        bool flushed = async_db.flush();
+        size_t stored = async_db.getUserContextMem("async_uid", kThreads * kPerThread + 10).size();
+        if (!flushed || stored != static_cast<size_t>(kThreads * kPerThread)) {
+            std::cerr << "异步批量写测试失败：" << stored << std::endl;
+            return 1;
+        }
+        std::cout << "异步批量写测试通过（" << stored << "条）" << std::endl;
+    }
+
+    // 测试异步写失败：触发器拒绝部分记忆，flush报告失败，已写穿进缓存的失败记忆不再被查到
+    {
+        std::string fail_path = "./test_async_fail.db";
+        unlink(fail_path.c_str());
+        bool flushed = true, flushed_again = false, leaked = false;
+        uint64_t failures = 0;
+        size_t stored = 0;
+        {
+            MemoryDB fail_db(fail_path, StorageMode::Disk);
+            if (!fail_db.init_db() || !fail_db.enableAsyncWrites(8, 20, 64)) return 1;
+            fail_db.configureContextCache(16, 64 * 1024);
+            sqlite3* side = nullptr;
+            if (sqlite3_open(fail_path.c_str(), &side) != SQLITE_OK ||
+                sqlite3_exec(side, "CREATE TRIGGER reject_bad BEFORE INSERT ON conversation_mem "
+                                   "WHEN NEW.user_text LIKE '坏%' BEGIN SELECT RAISE(ABORT, 'rejected'); END;",
+                             nullptr, nullptr, nullptr) != SQLITE_OK) {
+                sqlite3_close(side);
+                return 1;
+            }
+            sqlite3_close(side);
+            std::vector<ConversationMem> ctx;
+            fail_db.getUserContextMem("fail_uid", 5, ctx);  // 先让该用户进入缓存，之后的写入都会写穿
+            ConversationMem mem;
+            mem.uid = "fail_uid";
+            mem.robot_text = "好";
+            mem.is_core = 0;
+            for (int i = 0; i < 10; ++i) {
+                mem.user_text = (i % 5 == 2 ? "坏记忆" : "好记忆") + std::to_string(i);
+                mem.timestamp = 1000 + i;
+                fail_db.saveConversationMem(mem);
+            }
+            flushed = fail_db.flush();
+            failures = fail_db.asyncWriteFailures();
+            fail_db.getUserContextMem("fail_uid", 16, ctx);
+            stored = ctx.size();
+            for (const ConversationMem& m : ctx) leaked = leaked || m.user_text.compare(0, 3, "坏") == 0;
+            flushed_again = fail_db.flush();  // 没有新的失败时flush恢复为true
+        }
+        unlink(fail_path.c_str());
+        unlink((fail_path + "-wal").c_str());
+        unlink((fail_path + "-shm").c_str());
+        if (flushed || !flushed_again || failures != 2 || stored != 8 || leaked) {
+            std::cerr << "异步写失败测试失败（失败" << failures << "条，查到" << stored << "条）" << std::endl;
+            return 1;
+        }
+        std::cout << "异步写失败测试通过" << std::endl;
+    }
+
+    // 测试上下文缓存：首次未命中，之后命中；新保存的记忆立即可见
+    {
+        MemoryDB cache_db(db_path);
+        if (!cache_db.init_db()) return 1;
+        cache_db.configureContextCache(8, 64 * 1024);
+        ConversationMem mem;
+        mem.uid = "cache_uid";
+        mem.robot_text = "嗯嗯";
+        mem.scene_tag = "home";
+        mem.is_core = 0;
+        for (int i = 0; i < 5; ++i) {
+            mem.user_text = "旧记忆" + std::to_string(i);
+            mem.timestamp = 1000 + i;
+            cache_db.saveConversationMem(mem);
+        }
+        std::vector<ConversationMem> ctx;
+        cache_db.getUserContextMem("cache_uid", 3, ctx);  // 未命中，回填
+        mem.user_text = "新记忆";
+        mem.timestamp = 2000;
+        cache_db.saveConversationMem(mem);                // 写穿更新
+        cache_db.getUserContextMem("cache_uid", 3, ctx);  // 命中
+        bool newest_ok = !ctx.empty() && ctx[0].user_text == "新记忆";
+        cache_db.getUserContextMem("cache_uid", 6, ctx);  // 用户记忆全部在环内，仍命中
+        ContextCacheStats stats = cache_db.contextCacheStats();
+        if (!newest_ok || ctx.size() != 6 || stats.hits != 2 || stats.misses != 1) {
+            std::cerr << "上下文缓存测试失败" << std::endl;
+            return 1;
+        }
+        std::cout << "上下文缓存测试通过（命中" << stats.hits << "，未命中" << stats.misses
+                  << "，占用" << stats.bytes << "字节）" << std::endl;
+
+        // 补录的旧记忆（时间戳早于环内最新一条）：命中返回的顺序应与清空缓存后查SQL的顺序一致
+        mem.user_text = "补录记忆";
+        mem.timestamp = 1500;
+        cache_db.saveConversationMem(mem);
+        mem.user_text = "更早的补录";
+        mem.timestamp = 10;
+        cache_db.saveConversationMem(mem);
+        std::vector<ConversationMem> hit, fresh;
+        cache_db.getUserContextMem("cache_uid", 8, hit);
+        cache_db.configureContextCache(8, 64 * 1024);  // 清空缓存，下次查询走SQL
+        cache_db.getUserContextMem("cache_uid", 8, fresh);
+        bool same_order = hit.size() == fresh.size() && hit.size() == 8 && hit[1].user_text == "补录记忆";
+        for (size_t i = 0; same_order && i < hit.size(); ++i) {
+            same_order = hit[i].user_text == fresh[i].user_text && hit[i].timestamp == fresh[i].timestamp;
+        }
+        if (!same_order) {
+            std::cerr << "上下文缓存顺序测试失败" << std::endl;
+            return 1;
+        }
+        std::cout << "上下文缓存顺序测试通过" << std::endl;
+    }
+
+    // 测试异步写的读己之写：不调用flush，刚入队的记忆立即出现在上下文查询里（缓存关闭，走SQL+队列合并）
+    {
+        MemoryDB ryw_db(db_path);
+        if (!ryw_db.init_db() || !ryw_db.enableAsyncWrites(64, 1000, 256)) return 1;
+        ryw_db.configureContextCache(0, 0);
+        ConversationMem mem;
+        mem.uid = "ryw_uid";
+        mem.robot_text = "好";
+        mem.is_core = 0;
+        bool ok = true;
+        for (int i = 0; i < 40 && ok; ++i) {
+            mem.user_text = "队列中" + std::to_string(i);
+            mem.timestamp = 5000 + i;
+            ryw_db.saveConversationMem(mem);
+            std::vector<ConversationMem> ctx;
+            ryw_db.getUserContextMem("ryw_uid", 3, ctx);
+            ok = !ctx.empty() && ctx[0].user_text == mem.user_text &&
+                 ctx.size() == static_cast<size_t>(std::min(i + 1, 3));
+        }
+        size_t all = ryw_db.getUserContextMem("ryw_uid", 100).size();
+        ryw_db.flush();
+        size_t after_flush = ryw_db.getUserContextMem("ryw_uid", 100).size();
+        if (!ok || all != 40 || after_flush != 40) {
+            std::cerr << "异步写读己之写测试失败（" << all << "/" << after_flush << "）" << std::endl;
+            return 1;
+        }
+        std::cout << "异步写读己之写测试通过" << std::endl;
+    }
+
+    // 测试相关性检索：很久以前聊过的话题应能被检索到，且字数预算生效
+    {
+        MemoryDB search_db(db_path);
+        if (!search_db.init_db()) return 1;
+        time_t now = time(nullptr);
+        ConversationMem mem;
+        mem.uid = "search_uid";
+        mem.scene_tag = "日常对话";
+        mem.is_core = 0;
+        mem.user_text = "我家的小狗叫旺财";
+        mem.robot_text = "旺财真是个好名字！";
+        mem.timestamp = now - 40 * 86400;
+        search_db.saveConversationMem(mem);
+        for (int i = 0; i < 50; ++i) {
+            mem.user_text = "今天天气怎么样" + std::to_string(i);
+            mem.robot_text = "今天是晴天";
+            mem.timestamp = now - i * 60;
+            search_db.saveConversationMem(mem);
+        }
+        std::vector<ConversationMem> hits = search_db.retrieveRelevantMem("search_uid", "你还记得我的小狗叫什么吗", 3);
+        std::vector<ConversationMem> budgeted = search_db.retrieveRelevantMem("search_uid", "天气", 10, 40);
+        size_t budget_chars = 0;
+        for (const auto& m : budgeted) budget_chars += utf8_length(m.user_text) + utf8_length(m.robot_text);
+        if (hits.empty() || hits[0].user_text != "我家的小狗叫旺财" || budgeted.empty() || budget_chars > 40) {
+            std::cerr << "相关性检索测试失败" << std::endl;
+            return 1;
+        }
+        std::cout << "相关性检索测试通过：" << hits[0].user_text << std::endl;
+
+        // 异步写：刚入队、还没提交的相关记忆不调用flush也能被检索到，且不与已提交的重复
+        if (!search_db.enableAsyncWrites(64, 1000, 256)) return 1;
+        mem.user_text = "旺财学会握手了";
+        mem.robot_text = "旺财真聪明";
+        mem.timestamp = now;
+        search_db.saveConversationMem(mem);
+        std::vector<ConversationMem> fresh = search_db.retrieveRelevantMem("search_uid", "旺财", 5);
+        size_t found = 0;
+        for (const auto& m : fresh) found += m.user_text.find("旺财") != std::string::npos ? 1 : 0;
+        // 新话题：查询词只出现在队列中的记忆里（索引中文档频率为0），仍应按相关性命中而不是退回最近记忆
+        mem.user_text = "我最喜欢的恐龙是霸王龙";
+        mem.robot_text = "霸王龙很厉害";
+        search_db.saveConversationMem(mem);
+        std::vector<ConversationMem> new_topic = search_db.retrieveRelevantMem("search_uid", "恐龙", 5);
+        search_db.flush();
+        size_t after_flush = search_db.retrieveRelevantMem("search_uid", "旺财", 5).size();
+        if (found != 2 || fresh.size() != 2 || after_flush != 2 || new_topic.size() != 1 ||
+            new_topic[0].user_text != "我最喜欢的恐龙是霸王龙") {
+            std::cerr << "异步写检索测试失败（" << found << "/" << fresh.size() << "/" << after_flush << "，新话题"
+                      << new_topic.size() << "条）" << std::endl;
+            return 1;
+        }
+        std::cout << "异步写检索测试通过" << std::endl;
+    }
+
+    // 测试冷记忆归档：旧的非核心记忆压缩入归档表，核心记忆留在热表，查询和检索时透明回读
+    {
+        MemoryDB archive_db(db_path);
+        if (!archive_db.init_db()) return 1;
+        time_t now = time(nullptr);
+        ConversationMem mem;
+        mem.uid = "archive_uid";
+        mem.robot_text = "好的，我记住了";
+        mem.scene_tag = "home";
+        for (int i = 0; i < 600; ++i) {
+            mem.user_text = "很久以前说的第" + std::to_string(i) + "句话";
+            mem.is_core = (i % 100 == 0) ? 1 : 0;
+            mem.timestamp = now - 200 * 86400 + i * 60;
+            archive_db.saveConversationMem(mem);
+        }
+        mem.is_core = 0;
+        mem.user_text = "我最喜欢的恐龙是霸王龙";
+        mem.timestamp = now - 150 * 86400;
+        archive_db.saveConversationMem(mem);
+        mem.user_text = "刚刚说的话";
+        mem.timestamp = now - 60;
+        archive_db.saveConversationMem(mem);
+
+        RetentionPolicy policy;
+        policy.max_age_days = 90;
+        RetentionReport report = archive_db.runRetention(policy);
+        std::vector<ConversationMem> all = archive_db.getUserContextMem("archive_uid", 1000);
+        std::vector<ConversationMem> hits = archive_db.retrieveRelevantMem("archive_uid", "恐龙", 3);
+        if (report.rows_archived != 595 || report.chunks != 3 || report.compressed_bytes >= report.raw_bytes ||
+            all.size() != 602 || all[0].user_text != "刚刚说的话" ||
+            hits.empty() || hits[0].user_text != "我最喜欢的恐龙是霸王龙") {
+            std::cerr << "冷记忆归档测试失败" << std::endl;
+            return 1;
+        }
+        std::cout << "冷记忆归档测试通过" << std::endl;
+    }
+
+    // 测试损坏的归档块：长度字段被篡改时解压/反序列化返回false，不按损坏的长度分配内存
+    {
+        std::vector<ArchivedMem> rows(3);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            rows[i].mem_id = static_cast<int64_t>(i + 1);
+            rows[i].mem.uid = "corrupt_uid";
+            rows[i].mem.user_text = "第" + std::to_string(i) + "句";
+        }
+        std::string raw, blob, back;
+        serialize_archive(rows, raw);
+        std::vector<ArchivedMem> parsed;
+        bool ok = compress_archive(raw, blob) && decompress_archive(blob.data(), blob.size(), back) &&
+                  deserialize_archive(back, "corrupt_uid", parsed) && parsed.size() == 3;
+
+        std::string huge_raw = blob;  // 声明原始长度4GB
+        uint32_t huge = 0xFFFFFFFFu;
+        std::memcpy(&huge_raw[1], &huge, 4);
+        std::string inflated = blob;  // 声明的长度远超压缩比上限
+        uint32_t too_big = static_cast<uint32_t>(blob.size() * 2000);
+        std::memcpy(&inflated[1], &too_big, 4);
+        std::string bad_count = raw;  // 条数字段改成40亿条
+        std::memcpy(&bad_count[0], &huge, 4);
+        std::string truncated = raw.substr(0, raw.size() - 3);
+
+        if (!ok || decompress_archive(huge_raw.data(), huge_raw.size(), back) ||
+            decompress_archive(inflated.data(), inflated.size(), back) ||
+            deserialize_archive(bad_count, "corrupt_uid", parsed) ||
+            deserialize_archive(truncated, "corrupt_uid", parsed)) {
+            std::cerr << "损坏归档块测试失败" << std::endl;
+            return 1;
+        }
+        std::cout << "损坏归档块测试通过" << std::endl;
+    }
+
+    // 测试照片去重：同一用户带噪声的相似画面复用旧照片，不同画面或其他用户不复用，重启后索引仍在；
+    // 照片文件被清理后不再复用，登记一并撤销（重启后也不会再命中）
+    {
+        const int w = 160, h = 120;
+        std::vector<uint8_t> room(w * h), noisy(w * h), other(w * h);
+        std::mt19937 img_gen(11);
+        std::uniform_int_distribution<int> jitter(-6, 6);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                int v = (x * 255 / w + 40 * ((x / 20 + y / 30) % 2)) % 256;
+                room[y * w + x] = static_cast<uint8_t>(v);
+                noisy[y * w + x] = static_cast<uint8_t>(std::min(255, std::max(0, v + 8 + jitter(img_gen))));
+                other[y * w + x] = static_cast<uint8_t>((y * 255 / h + 60 * ((x / 16) % 2)) % 256);
+            }
+        }
+        uint64_t h_room = dhash64(room.data(), w, h, w), h_noisy = dhash64(noisy.data(), w, h, w);
+        uint64_t h_other = dhash64(other.data(), w, h, w);
+
+        std::string dedup_path = "./test_dedup.db";
+        const std::string room_jpg = "./test_dedup_room.jpg", stale_jpg = "./test_dedup_stale.jpg";
+        unlink(dedup_path.c_str());
+        for (const std::string& f : {room_jpg, stale_jpg}) {
+            FILE* fp = fopen(f.c_str(), "wb");
+            if (!fp) return 1;
+            fputs("jpg", fp);
+            fclose(fp);
+        }
+        std::string reused, reused_after_restart, unused;
+        bool miss_other = false, miss_user = false, stale_hit = false, miss_deleted = false, miss_deleted_restart = false;
+        ImageDedupStats stats = {}, stale_stats = {};
+        {
+            MemoryDB dedup_db(dedup_path, StorageMode::Disk);
+            if (!dedup_db.init_db()) return 1;
+            if (!dedup_db.findDuplicateImage("dedup_uid", h_room, unused)) {
+                dedup_db.registerImage("dedup_uid", h_room, room_jpg);
+            }
+            dedup_db.findDuplicateImage("dedup_uid", h_noisy, reused);
+            miss_other = !dedup_db.findDuplicateImage("dedup_uid", h_other, unused);
+            miss_user = !dedup_db.findDuplicateImage("someone_else", h_room, unused);
+            stats = dedup_db.imageDedupStats();
+
+            // 另一用户的照片登记后文件被删
+            dedup_db.registerImage("stale_uid", h_room, stale_jpg);
+            stale_hit = dedup_db.findDuplicateImage("stale_uid", h_noisy, unused);
+            unlink(stale_jpg.c_str());
+            miss_deleted = !dedup_db.findDuplicateImage("stale_uid", h_noisy, unused);
+            stale_stats = dedup_db.imageDedupStats();
+        }
+        {
+            MemoryDB dedup_db(dedup_path, StorageMode::Disk);
+            if (!dedup_db.init_db()) return 1;
+            dedup_db.findDuplicateImage("dedup_uid", h_noisy, reused_after_restart);
+            FILE* fp = fopen(stale_jpg.c_str(), "wb");  // 文件重新出现也不应再命中：登记已从表中撤销
+            if (fp) fclose(fp);
+            miss_deleted_restart = !dedup_db.findDuplicateImage("stale_uid", h_noisy, unused);
+        }
+        unlink(dedup_path.c_str());
+        unlink((dedup_path + "-wal").c_str());
+        unlink((dedup_path + "-shm").c_str());
+        unlink(room_jpg.c_str());
+        unlink(stale_jpg.c_str());
+        if (!stale_hit || !miss_deleted || !miss_deleted_restart || stale_stats.evicted != 1 ||
+            stale_stats.hits != 2 || stale_stats.lookups != 6) {
+            std::cerr << "照片去重测试失败：照片文件删除后仍被复用" << std::endl;
+            return 1;
+        }
+        if (reused != room_jpg || reused_after_restart != reused || !miss_other || !miss_user ||
+            stats.lookups != 4 || stats.hits != 1 || stats.registered != 1) {
+            std::cerr << "照片去重测试失败（相似画面距离" << hamming64(h_room, h_noisy) << "，不同画面距离"
+                      << hamming64(h_room, h_other) << "）" << std::endl;
+            return 1;
+        }
+        std::cout << "照片去重测试通过（相似画面距离" << hamming64(h_room, h_noisy) << "，不同画面距离"
+                  << hamming64(h_room, h_other) << "，复用率" << stats.hits << "/" << stats.lookups << "）" << std::endl;
+    }
+
+    // 测试并发：Disk模式开4个读连接并开启异步写（与实际部署相同），2个线程写、4个线程读
+    // （先关缓存走读连接，再开缓存测写穿与回填的竞争）
+    // 每个读都检查：只返回该用户的记忆、时间倒序、不早于查询前已确认写入（入队）的那一条；
+    // 读不等写：上下文查询的p99须低于kReadP99BoundUs（读路径若等写线程提交，每次要等一个批次）
+    // 同一张新面孔由4个线程同时认人，只能建出一个用户
+    {
+        std::string pool_path = "./test_pool.db";
+        unlink(pool_path.c_str());
+        const int writers = 2, readers = 4, users_per_writer = 4, rounds = 2, writes_per_round = 150;
+        const int users = writers * users_per_writer;
+        const double kReadP99BoundUs = 20000.0;
+        std::atomic<int> errors(0);
+        std::atomic<uint64_t> reads(0);
+        std::vector<std::vector<double>> read_us(readers);
+        double read_p99_us = 0.0;
+        bool flushed = false;
+        double elapsed_sec[rounds] = {0.0, 0.0};
+        std::vector<std::string> new_face_uids(readers);
+        std::vector<int> written(users, 0);
+        {
+            MemoryDB pool_db(pool_path, StorageMode::Disk);
+            if (!pool_db.init_db() || !pool_db.enableReadPool(4) || !pool_db.enableAsyncWrites(32, 200, 64)) return 1;
+            std::vector<std::string> uids(users);
+            for (int u = 0; u < users; ++u) uids[u] = "stress_" + std::to_string(u);
+            std::unique_ptr<std::atomic<int>[]> published(new std::atomic<int>[users]);
+            for (int u = 0; u < users; ++u) published[u] = 0;
+
+            for (int round = 0; round < rounds; ++round) {
+                pool_db.configureContextCache(round == 0 ? 0 : 16, 1024 * 1024);
+                std::atomic<int> writers_done(0);
+                auto t0 = std::chrono::steady_clock::now();
+                std::vector<std::thread> threads;
+                for (int w = 0; w < writers; ++w) {
+                    threads.emplace_back([&, w] {
+                        for (int i = 0; i < writes_per_round; ++i) {
+                            int u = w * users_per_writer + i % users_per_writer;
+                            int seq = published[u].load() + 1;
+                            ConversationMem mem;
+                            mem.uid = uids[u];
+                            mem.user_text = "stress " + std::to_string(seq);
+                            mem.robot_text = "ok";
+                            mem.timestamp = 1700000000 + seq;
+                            mem.scene_tag = "stress";
+                            mem.is_core = 0;
+                            if (!pool_db.saveConversationMem(mem)) ++errors;
+                            published[u] = seq;
+                        }
+                        ++writers_done;
+                    });
+                }
+                for (int r = 0; r < readers; ++r) {
+                    threads.emplace_back([&, r, round] {
+                        std::vector<ConversationMem> out;
+                        unsigned state = 7919u * (r + 1);
+                        while (writers_done.load() < writers) {
+                            state = state * 1103515245u + 12345u;
+                            int u = static_cast<int>((state >> 8) % users);
+                            int floor = published[u].load();
+                            auto q0 = std::chrono::steady_clock::now();
+                            bool ok = pool_db.getUserContextMem(uids[u], 5, out);
+                            read_us[r].push_back(
+                                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - q0).count());
+                            int prev = 1 << 30;
+                            for (const ConversationMem& m : out) {
+                                int seq = std::atoi(m.user_text.c_str() + 7);
+                                ok = ok && m.uid == uids[u] && seq < prev && m.timestamp == 1700000000 + seq;
+                                prev = seq;
+                            }
+                            ok = ok && (floor == 0 || (!out.empty() && std::atoi(out[0].user_text.c_str() + 7) >= floor));
+                            if ((state & 7) == 0) {
+                                for (const ConversationMem& m : pool_db.retrieveRelevantMem(uids[u], "stress", 3)) {
+                                    ok = ok && m.uid == uids[u];
+                                }
+                            }
+                            if (!ok) ++errors;
+                            ++reads;
+                        }
+                        if (round == 0) {
+                            FaceDescriptor stranger;
+                            for (int i = 0; i < kFaceDescriptorDim; ++i) stranger[i] = 0.1f * std::cos(i * 0.71f + 2.0f);
+                            new_face_uids[r] = pool_db.getUserUID(stranger);
+                        }
+                    });
+                }
+                for (std::thread& t : threads) t.join();
+                elapsed_sec[round] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            }
+
+            // 全部写完后每个用户的记忆条数应等于写入次数
+            flushed = pool_db.flush();
+            pool_db.configureContextCache(0, 0);
+            std::vector<ConversationMem> all;
+            for (int u = 0; u < users; ++u) {
+                pool_db.getUserContextMem(uids[u], 10000, all);
+                written[u] = static_cast<int>(all.size()) == published[u].load() ? 0 : 1;
+            }
+        }
+        unlink(pool_path.c_str());
+        unlink((pool_path + "-wal").c_str());
+        unlink((pool_path + "-shm").c_str());
+        int lost = 0;
+        for (int w : written) lost += w;
+        std::vector<double> all_reads;
+        for (const std::vector<double>& v : read_us) all_reads.insert(all_reads.end(), v.begin(), v.end());
+        if (!all_reads.empty()) {
+            size_t k = static_cast<size_t>(all_reads.size() * 0.99);
+            if (k >= all_reads.size()) k = all_reads.size() - 1;
+            std::nth_element(all_reads.begin(), all_reads.begin() + k, all_reads.end());
+            read_p99_us = all_reads[k];
+        }
+        bool same_new_user = true;
+        for (const std::string& uid : new_face_uids) same_new_user = same_new_user && uid == new_face_uids[0];
+        if (errors.load() != 0 || lost != 0 || !flushed || !same_new_user || new_face_uids[0] == "unknown_uid" ||
+            read_p99_us > kReadP99BoundUs) {
+            std::cerr << "并发读写测试失败（错误" << errors.load() << "次，条数不符的用户" << lost << "个，新用户"
+                      << (same_new_user ? "唯一" : "重复") << "，读p99 " << read_p99_us << "us）" << std::endl;
+            return 1;
+        }
+        std::cout << "并发读写测试通过（" << writers << "写" << readers << "读，异步写+读连接池，共" << reads.load()
+                  << "次读、" << writers * writes_per_round * rounds << "次写；无缓存 " << elapsed_sec[0]
+                  << " 秒，有缓存 " << elapsed_sec[1] << " 秒；读p99 " << read_p99_us << "us）" << std::endl;
+    }
+
+    // 测试读不被写阻塞：另一个连接占住写锁，写线程卡在提交上（相当于一次很慢的批量提交），
+    // 这期间上下文查询和检索照常返回，且能看到还在队列里的记忆
+    {
+        std::string stall_path = "./test_stall.db";
+        unlink(stall_path.c_str());
+        const double kStallMs = 300.0, kReadBoundMs = 100.0;
+        double worst_ms = 0.0;
+        int reads_during_stall = 0;
+        bool visible = true, flushed = false;
+        {
+            MemoryDB stall_db(stall_path, StorageMode::Disk);
+            if (!stall_db.init_db() || !stall_db.enableReadPool(2) || !stall_db.enableAsyncWrites(8, 10, 64)) return 1;
+            stall_db.configureContextCache(0, 0);
+            sqlite3* side = nullptr;
+            if (sqlite3_open(stall_path.c_str(), &side) != SQLITE_OK ||
+                sqlite3_exec(side, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                sqlite3_close(side);
+                return 1;
+            }
+            ConversationMem mem;
+            mem.uid = "stall_uid";
+            mem.robot_text = "好的";
+            mem.scene_tag = "home";
+            mem.is_core = 0;
+            for (int i = 0; i < 5; ++i) {
+                mem.user_text = "卡住时说的话" + std::to_string(i);
+                mem.timestamp = 3000 + i;
+                stall_db.saveConversationMem(mem);
+            }
+            std::vector<ConversationMem> out;
+            auto start = std::chrono::steady_clock::now();
+            while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < kStallMs) {
+                auto q0 = std::chrono::steady_clock::now();
+                stall_db.getUserContextMem("stall_uid", 5, out);
+                visible = visible && out.size() == 5 && out[0].user_text == "卡住时说的话4";
+                visible = visible && stall_db.retrieveRelevantMem("stall_uid", "卡住", 5).size() == 5;
+                worst_ms = std::max(worst_ms,
+                                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - q0).count());
+                ++reads_during_stall;
+            }
+            sqlite3_exec(side, "ROLLBACK;", nullptr, nullptr, nullptr);
+            sqlite3_close(side);
+            flushed = stall_db.flush();
+            visible = visible && stall_db.getUserContextMem("stall_uid", 10).size() == 5;
+        }
+        unlink(stall_path.c_str());
+        unlink((stall_path + "-wal").c_str());
+        unlink((stall_path + "-shm").c_str());
+        if (!visible || !flushed || worst_ms > kReadBoundMs) {
+            std::cerr << "读不被写阻塞测试失败（最慢一次读" << worst_ms << "ms）" << std::endl;
+            return 1;
+        }
+        std::cout << "读不被写阻塞测试通过（写线程卡住" << kStallMs << "ms期间读" << reads_during_stall << "次，最慢"
+                  << worst_ms << "ms）" << std::endl;
+    }
+
+#ifndef MEMORYROBOT_NO_METRICS
+    // 测试指标导出：以上各项操作都应计入对应阶段，导出文件可被解析
+    {
+        metrics::MetricsSnapshot snap = metrics::snapshot();
+        const metrics::StageSnapshot& insert = snap.stages[static_cast<int>(metrics::Stage::MemInsert)];
+        const metrics::StageSnapshot& lookup = snap.stages[static_cast<int>(metrics::Stage::UidLookup)];
+        metrics::MetricsExporter exporter;
+        const std::string prom_path = "./test_metrics.prom";
+        bool exported = exporter.start(prom_path, metrics::ExportFormat::Prometheus, 60);
+        exporter.stop();  // stop时写最后一次
+        std::ifstream prom(prom_path.c_str());
+        std::string text((std::istreambuf_iterator<char>(prom)), std::istreambuf_iterator<char>());
+        unlink(prom_path.c_str());
+        if (!exported || insert.count == 0 || lookup.count == 0 ||
+            snap.counters[static_cast<int>(metrics::Counter::ImagesDeduplicated)] != 3 ||  // 照片去重测试中的3次复用
+            text.find("memoryrobot_stage_latency_us_count{stage=\"mem_insert\"} " + std::to_string(insert.count)) ==
+                std::string::npos) {
+            std::cerr << "指标导出测试失败" << std::endl;
+            return 1;
+        }
+        std::cout << "指标导出测试通过（保存记忆" << insert.count << "次，p50 " << insert.quantile(0.5) << "us，p99 "
+                  << insert.quantile(0.99) << "us，最大" << insert.max_us << "us）" << std::endl;
+    }
+#endif
+
     return 0;
-}
\ No newline at end of file
+}
+#endif // MEMORYROBOT_NO_TEST_MAIN
@@ -9,34 +9,172 @@
 #include <iomanip>
 #include <sstream>
 #include <openssl/md5.h>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
 
-// 记忆数据结构（对应conversation_mem表）
-struct ConversationMem {
-    std::string uid;
-    std::string user_text;
-    std::string robot_text;
-    time_t timestamp;
-    std::string scene_tag;
-    int is_core;
-    std::string image_path;
+#include "memory_types.h"
+#include "face_descriptor.h"
+#include "face_gallery.h"
+#include "mpsc_queue.h"
+#include "pending_mems.h"
+#include "context_cache.h"
+#include "memory_archive.h"
+#include "image_dedup.h"
+#include "metrics.h"
+
+// 相关性检索的打分权重：score = text * 归一化BM25 + recency * 0.5^(天数/half_life_days) + core * is_core
+struct RetrievalWeights {
+    double text;
+    double recency;
+    double core;
+    double half_life_days;
+    RetrievalWeights() : text(1.0), recency(0.3), core(0.2), half_life_days(30.0) {}
+};
+
+// 冷记忆归档策略：超过max_age_days天的非核心记忆按用户每chunk_rows条压缩成一块移入归档表
+struct RetentionPolicy {
+    int max_age_days;
+    int chunk_rows;
+    int interval_sec;  // 后台整理周期
+    RetentionPolicy() : max_age_days(90), chunk_rows(256), interval_sec(24 * 3600) {}
+};
+
+// 一次归档整理的结果（数据库大小为page_count * page_size）
+struct RetentionReport {
+    size_t rows_archived;
+    size_t chunks;
+    size_t raw_bytes;         // 归档前的序列化大小
+    size_t compressed_bytes;  // 压缩后写入归档表的大小
+    int64_t db_bytes_before;
+    int64_t db_bytes_after;
 };
 
-// 用户档案结构（对应user_profile表）
-struct UserProfile {
-    std::string uid;
-    std::string face_feature;
-    std::string user_type;
-    time_t create_time;
+// 存储模式
+enum class StorageMode {
+    Memory,  // 纯内存（:memory:），重启后数据丢失
+    Disk,    // 直接读写db_path：WAL + synchronous=NORMAL + mmap，提交不逐条fsync
+    Hybrid   // 内存工作集 + 后台用online backup API定期快照到db_path，启动时从快照恢复
 };
 
 class MemoryDB {
 private:
-    sqlite3* db;          // 声明顺序1
+    // 预编译语句缓存：init_db中一次性prepare，每次调用只reset+重新绑定参数
+    enum StmtId {
+        STMT_KV_INSERT,
+        STMT_KV_QUERY,
+        STMT_USER_EXISTS,
+        STMT_USER_INSERT,
+        STMT_USER_LIST,
+        STMT_MEM_INSERT,
+        STMT_MEM_CONTEXT,
+        STMT_BEGIN,
+        STMT_COMMIT,
+        STMT_FTS_INSERT,
+        STMT_FTS_SEARCH,
+        STMT_FTS_TERM_DOCS,
+        STMT_MEM_MAX_ID,
+        STMT_ARCHIVE_BY_UID,
+        STMT_ARCHIVE_BY_MEM,
+        STMT_IMAGE_INSERT,
+        STMT_IMAGE_RECENT,
+        STMT_IMAGE_DELETE,
+        STMT_COUNT
+    };
+
+    sqlite3* db;          // 声明顺序1（写连接；未开启读连接池时也承担读，全部访问持txn_mutex）
     std::string db_path;  // 声明顺序2
+    sqlite3_stmt* stmts[STMT_COUNT];
+    FaceGallery gallery;  // 常驻内存的人脸特征库
+    std::shared_mutex gallery_mutex;  // 匹配共享、新增独占
+    DescriptorEncoding feature_encoding;  // user_profile.face_feature的BLOB编码
     std::string md5(const std::string& input);  // MD5哈希生成
+    bool load_gallery();  // 从user_profile加载已知人脸
+    bool prepare_statements();
+    void finalize_statements();
+    sqlite3_stmt* acquire(StmtId id);  // 取出缓存语句（已reset并清空绑定）
+
+    // 存储模式与快照（Hybrid模式）
+    StorageMode storage_mode;
+    int snapshot_interval_sec;       // 定时快照间隔
+    int snapshot_every_writes;       // 累计写入N次后提前快照
+    std::atomic<int> pending_writes; // 上次快照后的写入次数
+    std::thread snapshot_thread;
+    std::mutex snapshot_mutex;
+    std::condition_variable snapshot_cv;
+    bool snapshot_stop;
+    bool open_database();
+    bool apply_disk_pragmas();
+    bool restore_snapshot();
+    void snapshot_loop();
+    void note_write();
+
+    // 异步批量写入（saveConversationMem入队，写线程按批在单个事务内提交）
+    std::unique_ptr<MpscQueue<std::shared_ptr<PendingMem>>> write_queue;
+    PendingMems pending_mems;  // 已入队未处理完的记忆，读路径据此合并，不等写线程提交
+    std::thread writer_thread;
+    std::mutex writer_mutex;
+    std::condition_variable writer_cv;   // 唤醒写线程
+    std::condition_variable flushed_cv;  // 通知flush等待者
+    std::condition_variable space_cv;    // 队列满时入队方在此等待，写线程每取走一批通知
+    std::atomic<bool> writer_stop;
+    std::atomic<uint64_t> enqueued_count;
+    std::atomic<uint64_t> committed_count;  // 写线程已处理（提交或确认失败）的条数
+    std::atomic<uint64_t> flush_target;
+    std::atomic<uint64_t> failed_count;     // 提交失败而丢失的条数
+    uint64_t failed_reported;               // 上次flush时的failed_count（持writer_mutex）
+    size_t batch_rows;
+    int batch_latency_ms;
+    ContextCache context_cache;  // 按用户的最近记忆环形缓存
+    std::vector<ConversationMem> context_rows;  // 未命中时SQL结果的复用缓冲（写连接兼做读时使用）
+    RetrievalWeights retrieval_weights;
+    std::mutex txn_mutex;  // 写连接及其语句缓存的互斥：写线程、同步写入、归档整理和未开池时的读共用
+    bool insert_conversation_row(const ConversationMem& mem, bool in_batch = false, std::atomic<int64_t>* mem_id = nullptr);
+    bool catch_up_fts_index();  // 补建缺失的全文索引（旧库升级或异常中断后）
+    void writer_loop();
+    size_t commit_batch(const std::vector<std::shared_ptr<PendingMem>>& batch);
+    void stop_async_writes();
+
+    // 冷记忆归档（归档块按需解压回读，全文索引保留原mem_id）
+    RetentionPolicy retention_policy;
+    std::thread retention_thread;
+    std::mutex retention_mutex;
+    std::condition_variable retention_cv;
+    bool retention_stop;
+    void retention_loop();
+    void stop_retention();
+    int64_t database_bytes();
+
+    // 照片去重（image_hash表 + 常驻内存的最近照片索引）
+    ImageDedupIndex image_index;
+    bool load_image_index();
+    void evict_stale_image(const std::string& uid, const std::string& image_path);
+
+    // 只读连接池（Disk模式）：WAL下读连接各自持有一致快照，不等写事务，也不阻塞写
+    // 每个连接有自己的语句缓存和结果缓冲，同一时刻只租给一个线程（leased用CAS抢占，读路径无锁）
+    struct ReadConn {
+        sqlite3* db;
+        sqlite3_stmt* stmts[STMT_COUNT];
+        std::vector<ConversationMem> context_rows;
+        std::atomic<bool> leased;
+        ReadConn() : db(nullptr), leased(false) {
+            for (int i = 0; i < STMT_COUNT; ++i) stmts[i] = nullptr;
+        }
+    };
+    class ReadLease;  // 一次读操作租用的连接（见memory_db.cpp）
+    std::vector<std::unique_ptr<ReadConn>> read_pool;
+    const uint64_t instance_id;  // 线程记住上次租用的连接时用来区分MemoryDB实例
+    void close_read_pool();
+    bool load_archived_context(ReadLease& conn, const std::string& uid, size_t limit,
+                               std::vector<ConversationMem>& rows);
+    bool load_archived_row(ReadLease& conn, const std::string& uid, int64_t mem_id,
+                           std::vector<ArchivedMem>& chunk, ConversationMem& mem);
 
 public:
-    MemoryDB(const std::string& path);
+    MemoryDB(const std::string& path, StorageMode mode = StorageMode::Memory);
     ~MemoryDB();
     bool init_db();                  // 初始化数据库（创建表）
     bool insert_memory(const std::string& key, const std::string& value);  // KV插入
@@ -44,9 +182,60 @@ public:
     bool is_open() const;            // 检查数据库是否打开
 
     // 核心业务函数
-    std::string getUserUID(const std::string& face_feature);
+    std::string getUserUID(const FaceDescriptor& face_feature);
+    std::string getUserUID(const std::string& face_feature);  // 兼容逗号分隔的文本特征
     bool saveConversationMem(const ConversationMem& mem);
     std::vector<ConversationMem> getUserContextMem(const std::string& uid, int top_k);
+    // 复用调用方缓冲的版本：缓存命中时不执行SQL，稳态下不分配内存
+    bool getUserContextMem(const std::string& uid, int top_k, std::vector<ConversationMem>& out);
+    // 相关性检索：全文匹配query，结合时间衰减和核心记忆加权，返回不超过char_budget字（0为不限）的最佳top_k条
+    std::vector<ConversationMem> retrieveRelevantMem(const std::string& uid, const std::string& query,
+                                                     int top_k, size_t char_budget = 0);
+    void setRetrievalWeights(const RetrievalWeights& weights);
+
+    // 人脸匹配参数：欧氏距离小于threshold视为同一用户
+    void setFaceMatchThreshold(float threshold);
+    // 新用户特征的存储编码（已有记录按BLOB长度自动识别）
+    void setDescriptorEncoding(DescriptorEncoding enc);
+
+    // Hybrid模式快照策略：每interval_sec秒或每every_writes次写入落盘一次（init_db前设置）
+    void setSnapshotPolicy(int interval_sec, int every_writes);
+    // 立即把内存库快照到db_path（先写临时文件再rename，断电不会损坏旧快照）
+    bool snapshot();
+    StorageMode storageMode() const { return storage_mode; }
+
+    // 开启异步写：每batch_rows条或max_latency_ms毫秒提交一次；队列满时调用方阻塞到写线程取走一批（背压）
+    bool enableAsyncWrites(size_t batch_rows = 64, int max_latency_ms = 50, size_t queue_capacity = 1024);
+    // 屏障：阻塞到此前所有已入队的记忆都已处理；自上次flush以来有记忆提交失败时返回false
+    // 失败的记忆不会出现在之后的查询中（已写穿的上下文缓存随之作废）
+    bool flush();
+    // 异步写累计提交失败的条数
+    uint64_t asyncWriteFailures() const { return failed_count.load(); }
+
+    // 上下文缓存：每用户保留ring_size条，总内存超过budget_bytes时按LRU淘汰（按uid分片，各片1/16预算）；ring_size为0关闭
+    void configureContextCache(size_t ring_size, size_t budget_bytes);
+    ContextCacheStats contextCacheStats();
+
+    // 立即执行一次归档整理：非核心冷记忆压缩入归档表，之后回收空闲页
+    RetentionReport runRetention(const RetentionPolicy& policy);
+    // 后台按policy.interval_sec周期执行归档整理
+    void startRetention(const RetentionPolicy& policy);
+
+    // 照片去重：拍照前先用画面的dHash（image_dedup.h，VisionModule::imageHash）查询，
+    // 找到同一用户最近的相似照片时直接把其路径填入image_path，不再写新文件；
+    // 否则写新照片后registerImage登记。同一文件可被多条记忆引用，历史记录不受影响
+    bool findDuplicateImage(const std::string& uid, uint64_t hash, std::string& image_path);
+    bool registerImage(const std::string& uid, uint64_t hash, const std::string& image_path);
+    // 去重参数（init_db前设置；之后设置会按新参数重新加载索引）
+    void setImageDedupOptions(const ImageDedupOptions& options);
+    ImageDedupStats imageDedupStats();
+
+    // 读连接池：Disk模式下另开connections个只读连接，上下文查询、检索和KV查询按线程租用，
+    // 与写线程、归档整理并行（Memory/Hybrid模式只有一个内存库连接，返回false，读写经txn_mutex串行）
+    // 在init_db之后、多线程开始访问之前调用。开不开池，业务函数（认人、存取记忆、检索、照片去重）
+    // 都可以多线程并发调用；set*/configure*类设置函数应在启动阶段调用
+    bool enableReadPool(size_t connections = 4);
+    size_t readPoolSize() const { return read_pool.size(); }
 };
 
 #endif // MEMORY_DB_H
\ No newline at end of file
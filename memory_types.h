@@ -0,0 +1,28 @@
+#ifndef MEMORY_TYPES_H
+#define MEMORY_TYPES_H
+
+#include <string>
+#include <ctime>
+
+#include "face_descriptor.h"
+
+// 记忆数据结构（对应conversation_mem表）
+struct ConversationMem {
+    std::string uid;
+    std::string user_text;
+    std::string robot_text;
+    time_t timestamp;
+    std::string scene_tag;
+    int is_core;
+    std::string image_path;
+};
+
+// 用户档案结构（对应user_profile表）
+struct UserProfile {
+    std::string uid;
+    FaceDescriptor face_feature;
+    std::string user_type;
+    time_t create_time;
+};
+
+#endif // MEMORY_TYPES_H
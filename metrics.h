@@ -0,0 +1,416 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 各阶段耗时直方图和事件计数，供部署后排查长尾延迟（不必接profiler）
+// 记录走线程私有分片（单写者，relaxed原子读写，无锁无RMW），导出时合并各分片
+// 编译时定义MEMORYROBOT_NO_METRICS则计时/计数宏展开为空，导出器为空实现
+//
+// 用法：函数或代码块开头写METRIC_TIME(FaceDetect)；事件写METRIC_COUNT(FacesDetected, n)
+// 导出：MetricsExporter定期把快照写成Prometheus文本或JSON文件（先写临时文件再rename）
+namespace metrics {
+
+// 计时阶段（名称见stage_name）
+enum class Stage : int {
+    CameraGrab,      // 摄像头取一帧
+    FaceDetect,      // HOG人脸检测
+    ShapePredict,    // 关键点定位
+    FaceDescriptor,  // ResNet特征前向
+    FaceTrack,       // 跟踪器更新
+    ImageEncode,     // 照片颜色转换和JPEG编码
+    ImageWrite,      // 照片写文件
+    UidLookup,       // 人脸特征查UID
+    ContextQuery,    // 最近上下文查询
+    MemRetrieve,     // 相关性检索
+    MemInsert,       // 保存一条记忆（调用方看到的耗时，异步写时只含入队）
+    MemBatchCommit,  // 写线程提交一批
+    AudioRecord,     // 录音
+    SpeechRecognize, // 语音转文字
+    ChatReply,       // 大模型完整回复
+    FirstAudio,      // 交互开始到第一段语音播出（端到端首音延迟）
+    Interaction,     // 一次完整交互（到播报和存储都结束）
+    Count
+};
+
+// 事件计数
+enum class Counter : int {
+    FramesCaptured,
+    FramesGated,      // 被运动门控跳过的帧
+    FacesDetected,
+    DescriptorsComputed,
+    NewUsers,
+    MemsSaved,
+    ImagesWritten,
+    ImagesDeduplicated,
+    FrameAllocations,  // 视觉处理期间的堆分配次数（需开启alloc_counter.h的计数）
+    Count
+};
+
+const int kStages = static_cast<int>(Stage::Count);
+const int kCounters = static_cast<int>(Counter::Count);
+
+inline const char* stage_name(Stage s) {
+    static const char* const names[kStages] = {
+        "camera_grab", "face_detect", "shape_predict", "face_descriptor", "face_track", "image_encode",
+        "image_write", "uid_lookup", "context_query", "mem_retrieve", "mem_insert", "mem_batch_commit",
+        "audio_record", "speech_recognize", "chat_reply", "first_audio", "interaction",
+    };
+    return names[static_cast<int>(s)];
+}
+
+inline const char* counter_name(Counter c) {
+    static const char* const names[kCounters] = {
+        "frames_captured", "frames_gated", "faces_detected", "descriptors_computed",
+        "new_users", "mems_saved", "images_written", "images_deduplicated",
+        "frame_allocations",
+    };
+    return names[static_cast<int>(c)];
+}
+
+// ---- 对数线性分桶（HDR风格）：单位微秒，0~15逐一分桶，之后每个2的幂区间再分16桶（相对误差<6.25%） ----
+const int kSubBuckets = 16;
+const int kBuckets = kSubBuckets + 28 * kSubBuckets;  // 上限约2^32微秒（71分钟），更大的值计入最后一桶
+
+inline int bucket_index(uint64_t us) {
+    if (us < static_cast<uint64_t>(kSubBuckets)) return static_cast<int>(us);
+    int e = 63 - __builtin_clzll(us);  // >= 4
+    int idx = kSubBuckets + (e - 4) * kSubBuckets + static_cast<int>((us >> (e - 4)) & (kSubBuckets - 1));
+    return idx < kBuckets ? idx : kBuckets - 1;
+}
+
+// 桶内最大值（分位数按桶上界报告，偏保守）
+inline uint64_t bucket_upper(int idx) {
+    if (idx < kSubBuckets) return static_cast<uint64_t>(idx);
+    int e = (idx - kSubBuckets) / kSubBuckets + 4;
+    uint64_t sub = static_cast<uint64_t>((idx - kSubBuckets) % kSubBuckets);
+    return ((kSubBuckets + sub + 1) << (e - 4)) - 1;
+}
+
+struct StageSnapshot {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    std::vector<uint64_t> buckets;
+    StageSnapshot() : count(0), sum_us(0), max_us(0), buckets(kBuckets, 0) {}
+
+    // q分位数（微秒），不超过max_us
+    uint64_t quantile(double q) const {
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * count + 0.999999);
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min(bucket_upper(i), max_us);
+        }
+        return max_us;
+    }
+};
+
+struct MetricsSnapshot {
+    int64_t unix_time;
+    std::vector<StageSnapshot> stages;
+    std::vector<uint64_t> counters;
+    MetricsSnapshot() : unix_time(0), stages(kStages), counters(kCounters, 0) {}
+
+    // 与更早的快照相减得到这段时间内的分布（区间最大值取最高非空桶的上界）
+    MetricsSnapshot since(const MetricsSnapshot& prev) const {
+        MetricsSnapshot d;
+        d.unix_time = unix_time;
+        for (int s = 0; s < kStages; ++s) {
+            const StageSnapshot& a = stages[s];
+            const StageSnapshot& b = prev.stages[s];
+            StageSnapshot& o = d.stages[s];
+            o.count = a.count - b.count;
+            o.sum_us = a.sum_us - b.sum_us;
+            for (int i = 0; i < kBuckets; ++i) {
+                o.buckets[i] = a.buckets[i] - b.buckets[i];
+                if (o.buckets[i]) o.max_us = std::min(bucket_upper(i), a.max_us);
+            }
+        }
+        for (int c = 0; c < kCounters; ++c) d.counters[c] = counters[c] - prev.counters[c];
+        return d;
+    }
+};
+
+#ifndef MEMORYROBOT_NO_METRICS
+
+// 线程私有分片：只有所属线程写入，导出线程只读
+struct Shard {
+    std::atomic<uint64_t> buckets[kStages][kBuckets];
+    std::atomic<uint64_t> sum_us[kStages];
+    std::atomic<uint64_t> max_us[kStages];
+    std::atomic<uint64_t> counters[kCounters];
+    Shard() {
+        for (int s = 0; s < kStages; ++s) {
+            for (int i = 0; i < kBuckets; ++i) buckets[s][i].store(0, std::memory_order_relaxed);
+            sum_us[s].store(0, std::memory_order_relaxed);
+            max_us[s].store(0, std::memory_order_relaxed);
+        }
+        for (int c = 0; c < kCounters; ++c) counters[c].store(0, std::memory_order_relaxed);
+    }
+};
+
+// 单写者的自增：不需要原子RMW
+inline void bump(std::atomic<uint64_t>& v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class Registry {
+public:
+    // 进程内唯一，不析构（退出时其他线程可能仍在记录）
+    static Registry& instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    // 当前线程的分片（首次使用时登记；线程退出后分片保留，计数不丢）
+    Shard& local() {
+        thread_local Shard* shard = nullptr;
+        if (!shard) {
+            std::lock_guard<std::mutex> lock(mutex);
+            shards.emplace_back(new Shard());
+            shard = shards.back().get();
+        }
+        return *shard;
+    }
+
+    MetricsSnapshot snapshot() {
+        MetricsSnapshot snap;
+        snap.unix_time = static_cast<int64_t>(time(nullptr));
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& shard : shards) {
+            for (int s = 0; s < kStages; ++s) {
+                StageSnapshot& st = snap.stages[s];
+                for (int i = 0; i < kBuckets; ++i) {
+                    uint64_t n = shard->buckets[s][i].load(std::memory_order_relaxed);
+                    st.buckets[i] += n;
+                    st.count += n;
+                }
+                st.sum_us += shard->sum_us[s].load(std::memory_order_relaxed);
+                st.max_us = std::max(st.max_us, shard->max_us[s].load(std::memory_order_relaxed));
+            }
+            for (int c = 0; c < kCounters; ++c) {
+                snap.counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+            }
+        }
+        return snap;
+    }
+
+private:
+    Registry() {}
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+inline void record(Stage stage, uint64_t us) {
+    Shard& shard = Registry::instance().local();
+    const int s = static_cast<int>(stage);
+    bump(shard.buckets[s][bucket_index(us)], 1);
+    bump(shard.sum_us[s], us);
+    if (us > shard.max_us[s].load(std::memory_order_relaxed)) shard.max_us[s].store(us, std::memory_order_relaxed);
+}
+
+// 调用方已自行计时的场合
+inline void record_ms(Stage stage, double ms) { record(stage, static_cast<uint64_t>(ms * 1000.0)); }
+
+inline void add(Counter counter, uint64_t n = 1) {
+    bump(Registry::instance().local().counters[static_cast<int>(counter)], n);
+}
+
+inline MetricsSnapshot snapshot() { return Registry::instance().snapshot(); }
+
+// 作用域计时
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage s) : stage(s), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        record(stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                std::chrono::steady_clock::now() - start).count()));
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define METRICS_CONCAT_(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_(a, b)
+#define METRIC_TIME(stage) ::metrics::ScopedTimer METRICS_CONCAT(metric_timer_, __LINE__)(::metrics::Stage::stage)
+#define METRIC_COUNT(counter, n) ::metrics::add(::metrics::Counter::counter, (n))
+
+#else  // MEMORYROBOT_NO_METRICS
+
+inline MetricsSnapshot snapshot() { return MetricsSnapshot(); }
+inline void record_ms(Stage, double) {}
+
+#define METRIC_TIME(stage) do {} while (0)
+#define METRIC_COUNT(counter, n) do {} while (0)
+
+#endif // MEMORYROBOT_NO_METRICS
+
+// ---- 导出 ----
+
+enum class ExportFormat {
+    Prometheus,  // 文本格式，可由node_exporter的textfile收集器读取
+    Json
+};
+
+// total为启动以来的累计值，window为最近一个导出周期内的分布（看长尾回归主要看window）
+// Prometheus：各阶段为summary（分位数取window，_sum/_count取累计），计数为counter
+inline std::string to_prometheus(const MetricsSnapshot& total, const MetricsSnapshot& window) {
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::ostringstream out;
+    out << "# HELP memoryrobot_stage_latency_us Per-stage latency in microseconds (quantiles over the last export interval)\n";
+    out << "# TYPE memoryrobot_stage_latency_us summary\n";
+    for (int s = 0; s < kStages; ++s) {
+        const char* name = stage_name(static_cast<Stage>(s));
+        for (double q : kQuantiles) {
+            out << "memoryrobot_stage_latency_us{stage=\"" << name << "\",quantile=\"" << q << "\"} "
+                << window.stages[s].quantile(q) << "\n";
+        }
+        out << "memoryrobot_stage_latency_us_sum{stage=\"" << name << "\"} " << total.stages[s].sum_us << "\n";
+        out << "memoryrobot_stage_latency_us_count{stage=\"" << name << "\"} " << total.stages[s].count << "\n";
+    }
+    out << "# HELP memoryrobot_stage_latency_max_us Largest latency since start in microseconds\n";
+    out << "# TYPE memoryrobot_stage_latency_max_us gauge\n";
+    for (int s = 0; s < kStages; ++s) {
+        out << "memoryrobot_stage_latency_max_us{stage=\"" << stage_name(static_cast<Stage>(s)) << "\"} "
+            << total.stages[s].max_us << "\n";
+    }
+    for (int c = 0; c < kCounters; ++c) {
+        const char* name = counter_name(static_cast<Counter>(c));
+        out << "# TYPE memoryrobot_" << name << "_total counter\n";
+        out << "memoryrobot_" << name << "_total " << total.counters[c] << "\n";
+    }
+    return out.str();
+}
+
+inline std::string to_json(const MetricsSnapshot& total, const MetricsSnapshot& window) {
+    std::ostringstream out;
+    auto stage_json = [&out](const StageSnapshot& st) {
+        out << "{\"count\":" << st.count << ",\"mean_us\":" << (st.count ? st.sum_us / st.count : 0)
+            << ",\"p50_us\":" << st.quantile(0.5) << ",\"p90_us\":" << st.quantile(0.9)
+            << ",\"p99_us\":" << st.quantile(0.99) << ",\"p999_us\":" << st.quantile(0.999)
+            << ",\"max_us\":" << st.max_us << "}";
+    };
+    out << "{\"timestamp\":" << total.unix_time << ",\"stages\":{";
+    for (int s = 0; s < kStages; ++s) {
+        out << (s ? "," : "") << "\"" << stage_name(static_cast<Stage>(s)) << "\":{\"total\":";
+        stage_json(total.stages[s]);
+        out << ",\"window\":";
+        stage_json(window.stages[s]);
+        out << "}";
+    }
+    out << "},\"counters\":{";
+    for (int c = 0; c < kCounters; ++c) {
+        out << (c ? "," : "") << "\"" << counter_name(static_cast<Counter>(c)) << "\":" << total.counters[c];
+    }
+    out << "}}\n";
+    return out.str();
+}
+
+// 先写临时文件再rename，读取方不会看到写了一半的文件
+inline bool write_file_atomic(const std::string& path, const std::string& content) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::trunc);
+        if (!out) return false;
+        out << content;
+        if (!out.flush()) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// 定期导出：每interval_sec秒重写一次文件，stop时再写最后一次
+class MetricsExporter {
+public:
+    MetricsExporter() : format(ExportFormat::Prometheus), interval_sec(60), stop_flag(false) {}
+    ~MetricsExporter() { stop(); }
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    bool start(const std::string& file_path, ExportFormat fmt = ExportFormat::Prometheus, int interval = 60) {
+#ifdef MEMORYROBOT_NO_METRICS
+        (void)file_path;
+        (void)fmt;
+        (void)interval;
+        return false;
+#else
+        if (worker.joinable()) return false;
+        path = file_path;
+        format = fmt;
+        interval_sec = interval > 0 ? interval : 1;
+        stop_flag = false;
+        previous = snapshot();
+        worker = std::thread(&MetricsExporter::run, this);
+        return true;
+#endif
+    }
+
+    void stop() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop_flag = true;
+        }
+        cv.notify_one();
+        worker.join();
+    }
+
+    // 立即导出一次（与后台线程互斥）
+    bool writeNow() {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (path.empty()) return false;
+        MetricsSnapshot current = snapshot();
+        MetricsSnapshot window = current.since(previous);
+        previous = current;
+        return write_file_atomic(path, format == ExportFormat::Json ? to_json(current, window)
+                                                                    : to_prometheus(current, window));
+    }
+
+private:
+    std::string path;
+    ExportFormat format;
+    int interval_sec;
+    MetricsSnapshot previous;
+    std::thread worker;
+    std::mutex mutex;
+    std::mutex write_mutex;
+    std::condition_variable cv;
+    bool stop_flag;
+
+    void run() {
+        for (;;) {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait_for(lock, std::chrono::seconds(interval_sec), [this] { return stop_flag; });
+                stopping = stop_flag;
+            }
+            if (!writeNow()) std::cerr << "指标导出失败：" << path << std::endl;
+            if (stopping) break;
+        }
+    }
+};
+
+} // namespace metrics
+
+#endif // METRICS_H
@@ -0,0 +1,222 @@
+// 模型转换工具：把dlib的.dat模型一次性转换成可直接mmap的.mrm格式（见model_file.h）
+// 用法：model_convert_tool landmarks <shape_predictor.dat> <输出.mrm>
+//       model_convert_tool recognition <dlib_face_recognition_resnet_model_v1.dat> <输出.mrm> [校准文件]
+// 转换后用同一随机输入对比dlib原模型与映射模型的结果，并对比两种加载方式的耗时和单张特征耗时
+// 转换结果按本机字节序存放，应在目标机（或同为小端的机器）上转换
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dlib/image_processing.h>
+
+#include "face_recognition_model_v1.h"
+#include "mapped_shape_predictor.h"
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// 按dlib::shape_predictor的序列化格式逐项读取（其成员为私有）
+bool convert_landmarks(const std::string& in_path, const std::string& out_path) {
+    dlib::matrix<float, 0, 1> initial_shape;
+    std::vector<std::vector<dlib::impl::regression_tree>> forests;
+    std::vector<std::vector<unsigned long>> anchor_idx;
+    std::vector<std::vector<dlib::vector<float, 2>>> deltas;
+    try {
+        std::ifstream in(in_path.c_str(), std::ios::binary);
+        if (!in) {
+            std::cerr << "文件打开失败：" << in_path << std::endl;
+            return false;
+        }
+        int version = 0;
+        dlib::deserialize(version, in);
+        if (version != 1) {
+            std::cerr << "不支持的shape_predictor版本：" << version << std::endl;
+            return false;
+        }
+        dlib::deserialize(initial_shape, in);
+        dlib::deserialize(forests, in);
+        dlib::deserialize(anchor_idx, in);
+        dlib::deserialize(deltas, in);
+    } catch (std::exception& e) {
+        std::cerr << "关键点模型读取失败：" << e.what() << std::endl;
+        return false;
+    }
+
+    // 映射格式要求每级树数、每棵树深度、每级特征像素数一致（dlib训练出的模型均如此）
+    MappedShapePredictor::Data d;
+    d.parts = static_cast<uint32_t>(initial_shape.size() / 2);
+    d.cascades = static_cast<uint32_t>(forests.size());
+    if (forests.empty() || forests[0].empty() || anchor_idx.size() != forests.size() ||
+        deltas.size() != forests.size()) {
+        std::cerr << "关键点模型结构无效" << std::endl;
+        return false;
+    }
+    d.trees = static_cast<uint32_t>(forests[0].size());
+    d.splits = static_cast<uint32_t>(forests[0][0].splits.size());
+    d.features = static_cast<uint32_t>(anchor_idx[0].size());
+    d.initial_shape.assign(initial_shape.begin(), initial_shape.end());
+    for (size_t c = 0; c < forests.size(); ++c) {
+        if (forests[c].size() != d.trees || anchor_idx[c].size() != d.features || deltas[c].size() != d.features) {
+            std::cerr << "关键点模型各级结构不一致，无法转换" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < d.features; ++i) {
+            d.anchor_idx.push_back(static_cast<uint32_t>(anchor_idx[c][i]));
+            d.deltas.push_back(deltas[c][i].x());
+            d.deltas.push_back(deltas[c][i].y());
+        }
+        for (const dlib::impl::regression_tree& tree : forests[c]) {
+            if (tree.splits.size() != d.splits || tree.leaf_values.size() != d.splits + 1) {
+                std::cerr << "关键点模型各树深度不一致，无法转换" << std::endl;
+                return false;
+            }
+            for (const dlib::impl::split_feature& s : tree.splits) {
+                d.split_idx.push_back(static_cast<uint32_t>(s.idx1));
+                d.split_idx.push_back(static_cast<uint32_t>(s.idx2));
+                d.split_thresh.push_back(s.thresh);
+            }
+            for (const dlib::matrix<float, 0, 1>& leaf : tree.leaf_values) {
+                if (leaf.size() != initial_shape.size()) {
+                    std::cerr << "关键点模型叶子维数无效" << std::endl;
+                    return false;
+                }
+                d.leaves.insert(d.leaves.end(), leaf.begin(), leaf.end());
+            }
+        }
+    }
+    if (!MappedShapePredictor::write(d, out_path)) {
+        std::cerr << "写入失败：" << out_path << std::endl;
+        return false;
+    }
+    std::cout << "关键点模型：" << d.parts << "点，" << d.cascades << "级 x " << d.trees << "棵树（深度"
+              << std::log2(d.splits + 1) << "），已写入" << out_path << std::endl;
+
+    // ---- 校验：随机纹理图上同一批检测框，dlib与映射实现的关键点应一致 ----
+    dlib::shape_predictor reference;
+    auto t0 = std::chrono::steady_clock::now();
+    dlib::deserialize(in_path) >> reference;
+    double dlib_ms = elapsed_ms(t0);
+    MappedShapePredictor mapped;
+    t0 = std::chrono::steady_clock::now();
+    if (!mapped.load(out_path)) {
+        std::cerr << "转换结果无法加载：" << out_path << std::endl;
+        return false;
+    }
+    double mapped_ms = elapsed_ms(t0);
+
+    std::mt19937 rng(20240601);
+    dlib::array2d<unsigned char> img(480, 640);
+    for (long y = 0; y < img.nr(); ++y) {
+        for (long x = 0; x < img.nc(); ++x) img[y][x] = static_cast<unsigned char>(rng() & 0xff);
+    }
+    dlib::gaussian_blur(img, img, 2.0);
+    long max_diff = 0;
+    size_t mismatched = 0, total = 0;
+    for (int i = 0; i < 50; ++i) {
+        long size = 80 + static_cast<long>(rng() % 200);
+        long left = static_cast<long>(rng() % 600) - 40, top = static_cast<long>(rng() % 440) - 40;
+        dlib::rectangle rect(left, top, left + size, top + size);
+        dlib::full_object_detection ref = reference(img, rect);
+        std::vector<float> coords;
+        mapped.predict(img.nc(), img.nr(), [&img](long x, long y) { return static_cast<float>(img[y][x]); },
+                       rect.left(), rect.top(), rect.right(), rect.bottom(), coords);
+        for (unsigned long p = 0; p < ref.num_parts(); ++p) {
+            dlib::point q(dlib::dpoint(coords[2 * p], coords[2 * p + 1]));
+            long diff = std::max(std::labs(q.x() - ref.part(p).x()), std::labs(q.y() - ref.part(p).y()));
+            max_diff = std::max(max_diff, diff);
+            mismatched += diff > 0;
+            ++total;
+        }
+    }
+    std::cout << "校验：" << total << "个关键点，与dlib不同 " << mismatched << " 个，最大偏差 " << max_diff
+              << " 像素" << std::endl;
+    std::cout << "加载耗时：dlib反序列化 " << dlib_ms << " ms，映射 " << mapped_ms << " ms" << std::endl;
+    // 特征像素坐标取整处的浮点差异偶尔会让个别树走不同分支，允许极少数关键点差1像素
+    return max_diff <= 1 && mismatched * 100 <= total;
+}
+
+bool convert_recognition(const std::string& in_path, const std::string& out_path, const std::string& calib_path) {
+    dlib::face_recognition_model_v1 model;
+    auto t0 = std::chrono::steady_clock::now();
+    try {
+        dlib::deserialize(in_path) >> model;
+    } catch (std::exception& e) {
+        std::cerr << "识别模型读取失败：" << e.what() << std::endl;
+        return false;
+    }
+    double dlib_ms = elapsed_ms(t0);
+    if (!model.enable_quantized_backend(calib_path)) {
+        std::cerr << "权重导出失败：网络结构与dlib_face_recognition_resnet_model_v1不符或校准文件无效" << std::endl;
+        return false;
+    }
+    ModelFileWriter writer("face_net");
+    if (!model.quantized_backend()->exportTo(writer) || !writer.write(out_path)) {
+        std::cerr << "写入失败：" << out_path << std::endl;
+        return false;
+    }
+    std::cout << "识别模型已写入" << out_path << (calib_path.empty() ? "（未带校准范围）" : "（含校准范围）")
+              << std::endl;
+
+    // ---- 校验：随机人脸块上映射模型（float）与dlib的特征应只差浮点舍入 ----
+    dlib::face_recognition_model_v1 mapped;
+    t0 = std::chrono::steady_clock::now();
+    if (!mapped.load_mapped(out_path)) {
+        std::cerr << "转换结果无法加载：" << out_path << std::endl;
+        return false;
+    }
+    double mapped_ms = elapsed_ms(t0);
+
+    std::mt19937 rng(20240601);
+    dlib::matrix<dlib::rgb_pixel> chip(QuantizedFaceNet::kInputSize, QuantizedFaceNet::kInputSize);
+    for (long r = 0; r < chip.nr(); ++r) {
+        for (long c = 0; c < chip.nc(); ++c) {
+            chip(r, c) = dlib::rgb_pixel(rng() & 0xff, rng() & 0xff, rng() & 0xff);
+        }
+    }
+    dlib::matrix<float, 0, 1> ref = model.reference_descriptor(chip);
+    dlib::matrix<float, 0, 1> own = mapped.reference_descriptor(chip);
+    float err = dlib::max(dlib::abs(ref - own));
+    std::cout << "校验：映射模型与dlib最大逐维误差 " << err << std::endl;
+    std::cout << "加载耗时：dlib反序列化 " << dlib_ms << " ms，映射 " << mapped_ms << " ms" << std::endl;
+
+    // 单张特征耗时：各预热一次后取多次平均（映射模型默认float，enable_quantized_backend后为int8）
+    const int kTimingRuns = 20;
+    const uint8_t* rgb = reinterpret_cast<const uint8_t*>(&chip(0, 0));
+    QuantizedFaceNet* net = mapped.quantized_backend();
+    float descriptor[QuantizedFaceNet::kDescriptorDim];
+    auto per_run_ms = [&](const std::function<void()>& run) {
+        run();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kTimingRuns; ++i) run();
+        return elapsed_ms(start) / kTimingRuns;
+    };
+    double dlib_run_ms = per_run_ms([&] { ref = model.reference_descriptor(chip); });
+    double float_run_ms = per_run_ms([&] { net->forwardFloat(rgb, descriptor); });
+    double int8_run_ms = per_run_ms([&] { net->forward(rgb, descriptor); });
+    std::cout << "单张特征耗时：dlib " << dlib_run_ms << " ms，映射float " << float_run_ms << " ms，映射int8 "
+              << int8_run_ms << " ms" << (net->calibrated() ? "" : "（未校准，按激活范围动态量化）") << std::endl;
+    return err <= 1e-3f;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (argc >= 4 && mode == "landmarks") {
+        return convert_landmarks(argv[2], argv[3]) ? 0 : 1;
+    }
+    if (argc >= 4 && mode == "recognition") {
+        return convert_recognition(argv[2], argv[3], argc > 4 ? argv[4] : "") ? 0 : 1;
+    }
+    std::cerr << "用法：" << argv[0] << " landmarks <shape_predictor.dat> <输出.mrm>" << std::endl;
+    std::cerr << "      " << argv[0] << " recognition <识别模型.dat> <输出.mrm> [校准文件]" << std::endl;
+    return 1;
+}
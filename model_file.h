@@ -0,0 +1,226 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 可直接mmap使用的模型文件（.mrm）：64字节文件头 + 段表 + 按64字节对齐的数据段
+// 数据按本机字节序（小端）原样存放，加载时只做mmap和校验，权重在首次访问时才从页缓存调入，
+// 多个进程映射同一文件时共享同一份只读物理页
+//
+// 文件头：magic "MRMODEL\0" | uint32 version | uint32 段数 | uint64 文件大小 | char kind[16] | uint32 字节序标记 | 填充
+// 段表项（64字节）：char name[48] | uint64 offset | uint64 size
+namespace model_file {
+
+const char kMagic[8] = {'M', 'R', 'M', 'O', 'D', 'E', 'L', '\0'};
+const uint32_t kVersion = 1;
+const uint32_t kByteOrderMark = 0x01020304;
+const size_t kAlign = 64;
+const size_t kHeaderSize = 64;
+const size_t kNameSize = 48;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t file_size;
+    char kind[16];
+    uint32_t byte_order;
+    char reserved[20];
+};
+
+struct SectionEntry {
+    char name[kNameSize];
+    uint64_t offset;
+    uint64_t size;
+};
+
+static_assert(sizeof(Header) == kHeaderSize, "模型文件头须为64字节");
+static_assert(sizeof(SectionEntry) == 64, "段表项须为64字节");
+
+inline size_t align_up(size_t n) { return (n + kAlign - 1) / kAlign * kAlign; }
+
+// 判断文件是否为.mrm格式（按文件头，不看扩展名）
+inline bool is_model_file(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[8];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, kMagic, sizeof(magic)) == 0;
+}
+
+} // namespace model_file
+
+// 写入：先add各段（数据拷贝进内存），最后write一次性写出
+class ModelFileWriter {
+public:
+    explicit ModelFileWriter(const std::string& kind) : kind_(kind) {}
+
+    void add(const std::string& name, const void* data, size_t bytes) {
+        Section s;
+        s.name = name;
+        s.data.assign(static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+        sections.push_back(std::move(s));
+    }
+
+    template <typename T>
+    void add(const std::string& name, const std::vector<T>& values) {
+        add(name, values.data(), values.size() * sizeof(T));
+    }
+
+    // 先写临时文件再rename，转换中断不会留下半个模型文件
+    bool write(const std::string& path) const {
+        model_file::Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, model_file::kMagic, sizeof(header.magic));
+        header.version = model_file::kVersion;
+        header.section_count = static_cast<uint32_t>(sections.size());
+        std::strncpy(header.kind, kind_.c_str(), sizeof(header.kind) - 1);
+        header.byte_order = model_file::kByteOrderMark;
+
+        std::vector<model_file::SectionEntry> table(sections.size());
+        size_t offset = model_file::align_up(model_file::kHeaderSize + table.size() * sizeof(model_file::SectionEntry));
+        for (size_t i = 0; i < sections.size(); ++i) {
+            if (sections[i].name.size() >= model_file::kNameSize) return false;
+            std::memset(&table[i], 0, sizeof(table[i]));
+            std::strncpy(table[i].name, sections[i].name.c_str(), model_file::kNameSize - 1);
+            table[i].offset = offset;
+            table[i].size = sections[i].data.size();
+            offset = model_file::align_up(offset + sections[i].data.size());
+        }
+        header.file_size = offset;
+
+        std::string tmp = path + ".tmp";
+        std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(model_file::SectionEntry));
+        size_t pos = model_file::kHeaderSize + table.size() * sizeof(model_file::SectionEntry);
+        const char zeros[model_file::kAlign] = {};
+        for (size_t i = 0; i < sections.size(); ++i) {
+            out.write(zeros, table[i].offset - pos);
+            out.write(sections[i].data.data(), sections[i].data.size());
+            pos = table[i].offset + sections[i].data.size();
+        }
+        out.write(zeros, header.file_size - pos);
+        out.close();
+        if (!out) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct Section {
+        std::string name;
+        std::vector<char> data;
+    };
+    std::string kind_;
+    std::vector<Section> sections;
+};
+
+// 只读映射：open只映射并校验文件头和段表，不读取权重
+class MappedModelFile {
+public:
+    MappedModelFile() : base(nullptr), length(0), table(nullptr), count(0) {}
+    ~MappedModelFile() { close(); }
+    MappedModelFile(const MappedModelFile&) = delete;
+    MappedModelFile& operator=(const MappedModelFile&) = delete;
+
+    bool open(const std::string& path, const std::string& expected_kind) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < model_file::kHeaderSize) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);  // 映射建立后可关闭描述符
+        if (p == MAP_FAILED) {
+            length = 0;
+            return false;
+        }
+        base = static_cast<const char*>(p);
+        if (!validate(expected_kind)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (base) munmap(const_cast<char*>(base), length);
+        base = nullptr;
+        length = 0;
+        table = nullptr;
+        count = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return length; }
+
+    // 按名字取段；n为按T计的元素个数，段不存在或大小不是T的整数倍时返回nullptr
+    template <typename T>
+    const T* section(const std::string& name, size_t& n) const {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (std::strncmp(table[i].name, name.c_str(), model_file::kNameSize) != 0) continue;
+            if (table[i].size % sizeof(T) != 0) return nullptr;
+            n = table[i].size / sizeof(T);
+            return reinterpret_cast<const T*>(base + table[i].offset);
+        }
+        n = 0;
+        return nullptr;
+    }
+
+    // 取元素个数必须为expected的段
+    template <typename T>
+    const T* section(const std::string& name, size_t expected, bool& ok) const {
+        size_t n = 0;
+        const T* p = section<T>(name, n);
+        if (!p || n != expected) {
+            ok = false;
+            return nullptr;
+        }
+        return p;
+    }
+
+private:
+    const char* base;
+    size_t length;
+    const model_file::SectionEntry* table;
+    uint32_t count;
+
+    bool validate(const std::string& expected_kind) {
+        const model_file::Header* h = reinterpret_cast<const model_file::Header*>(base);
+        if (std::memcmp(h->magic, model_file::kMagic, sizeof(h->magic)) != 0 || h->version != model_file::kVersion ||
+            h->byte_order != model_file::kByteOrderMark || h->file_size != length ||
+            std::strncmp(h->kind, expected_kind.c_str(), sizeof(h->kind)) != 0) {
+            return false;
+        }
+        size_t table_end = model_file::kHeaderSize + static_cast<size_t>(h->section_count) * sizeof(model_file::SectionEntry);
+        if (table_end > length) return false;
+        table = reinterpret_cast<const model_file::SectionEntry*>(base + model_file::kHeaderSize);
+        count = h->section_count;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (table[i].offset % model_file::kAlign != 0 || table[i].offset > length ||
+                table[i].size > length - table[i].offset) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // MODEL_FILE_H
@@ -0,0 +1,195 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_ring.h"
+#include "frame_source.h"
+
+// 运动/有人门控参数
+struct MotionGateOptions {
+    int grid_width;          // 降采样灰度网格尺寸（每格取原图对应块的平均亮度）
+    int grid_height;
+    int pixel_threshold;     // 一格亮度与背景相差超过此值记为变化
+    double trigger_ratio;    // 变化格数占比超过此值唤醒检测器
+    double background_rate;  // 背景模型更新速率（0~1），越大越快吸收光照等缓慢变化
+    int hold_frames;         // 触发后（或检测器报告有人后）继续放行的帧数
+    MotionGateOptions()
+        : grid_width(80), grid_height(60), pixel_threshold(18), trigger_ratio(0.005),
+          background_rate(0.05), hold_frames(15) {}
+};
+
+struct MotionGateStats {
+    uint64_t frames;    // 进入门控的帧数
+    uint64_t passed;    // 放行给检测器的帧数
+    uint64_t skipped;   // 画面无变化被跳过的帧数
+    uint64_t triggers;  // 由画面变化触发的次数（保持期内的放行不计）
+};
+
+// 检测器前的廉价预筛：低分辨率亮度网格与滑动平均背景做差，画面无变化时跳过检测
+// 人静坐时画面变化很小，所以检测器发现人脸后应调用notePresence(true)保持放行
+class MotionGate {
+public:
+    explicit MotionGate(const MotionGateOptions& options = MotionGateOptions())
+        : opts(options), has_background(false), hold(0), frame_w(0), frame_h(0), stats_() {}
+
+    void setOptions(const MotionGateOptions& options) {
+        opts = options;
+        reset();
+    }
+
+    void reset() {
+        has_background = false;
+        hold = 0;
+        background.clear();
+        mask.clear();
+    }
+
+    // 返回true表示本帧需要运行检测器
+    bool update(const Frame& frame) {
+        ++stats_.frames;
+        if (!sample(frame)) {
+            ++stats_.passed;  // 无法取亮度时不拦截
+            return true;
+        }
+
+        const size_t cells = grid.size();
+        if (!has_background) {
+            background.assign(grid.begin(), grid.end());
+            mask.assign(cells, 0);
+            has_background = true;
+            ++stats_.triggers;
+            hold = opts.hold_frames;
+            ++stats_.passed;
+            return true;
+        }
+
+        size_t changed = 0;
+        const float rate = static_cast<float>(opts.background_rate);
+        for (size_t i = 0; i < cells; ++i) {
+            float diff = grid[i] - background[i];
+            bool moved = std::abs(diff) > opts.pixel_threshold;
+            mask[i] = moved ? 1 : 0;
+            changed += moved;
+            background[i] += rate * diff;
+        }
+
+        bool motion = changed > opts.trigger_ratio * cells;
+        if (motion) {
+            ++stats_.triggers;
+            hold = opts.hold_frames;
+        } else if (hold > 0) {
+            --hold;
+            motion = true;
+        }
+        if (motion) {
+            ++stats_.passed;
+        } else {
+            ++stats_.skipped;
+        }
+        return motion;
+    }
+
+    // 检测器结果回传：画面中有人时延长放行
+    void notePresence(bool present) {
+        if (present) hold = opts.hold_frames;
+    }
+
+    // 最近一帧变化格子的外接框（原图坐标），没有变化时返回false
+    bool motionRegion(cv::Rect& roi) const {
+        int x0 = opts.grid_width, y0 = opts.grid_height, x1 = -1, y1 = -1;
+        for (int y = 0; y < opts.grid_height && !mask.empty(); ++y) {
+            for (int x = 0; x < opts.grid_width; ++x) {
+                if (!mask[y * opts.grid_width + x]) continue;
+                x0 = std::min(x0, x);
+                y0 = std::min(y0, y);
+                x1 = std::max(x1, x);
+                y1 = std::max(y1, y);
+            }
+        }
+        if (x1 < 0) return false;
+        int left = x0 * frame_w / opts.grid_width, top = y0 * frame_h / opts.grid_height;
+        int right = (x1 + 1) * frame_w / opts.grid_width, bottom = (y1 + 1) * frame_h / opts.grid_height;
+        roi = cv::Rect(left, top, right - left, bottom - top);
+        return true;
+    }
+
+    // grid_width x grid_height的变化掩码（1为变化）
+    const std::vector<uint8_t>& motionMask() const { return mask; }
+    MotionGateStats stats() const { return stats_; }
+
+private:
+    MotionGateOptions opts;
+    std::vector<float> grid;        // 当前帧的亮度网格
+    std::vector<float> background;  // 背景模型
+    std::vector<uint8_t> mask;
+    std::vector<int> cell_counts;
+    bool has_background;
+    int hold;
+    int frame_w, frame_h;  // 原图尺寸，用于把变化区域换算回原图坐标
+    cv::Mat small;         // MJPEG缩小解码的缓冲
+    MotionGateStats stats_;
+
+    // 按格求平均亮度，原图足够大时隔行隔列取样；BGR按(B + 2G + R) / 4近似亮度，YUYV直接取Y
+    template <typename Luma>
+    void average(int w, int h, Luma luma) {
+        const int gw = opts.grid_width, gh = opts.grid_height;
+        grid.assign(static_cast<size_t>(gw) * gh, 0.0f);
+        std::vector<int>& counts = cell_counts;
+        counts.assign(grid.size(), 0);
+        const int step = (w >= 2 * gw && h >= 2 * gh) ? 2 : 1;
+        for (int y = 0; y < h; y += step) {
+            int gy = y * gh / h;
+            for (int x = 0; x < w; x += step) {
+                int idx = gy * gw + x * gw / w;
+                grid[idx] += luma(y, x);
+                ++counts[idx];
+            }
+        }
+        for (size_t i = 0; i < grid.size(); ++i) {
+            if (counts[i] > 0) grid[i] /= counts[i];
+        }
+    }
+
+    bool sample(const Frame& frame) {
+        switch (frame.format) {
+        case PixelFormat::BGR: {
+            const cv::Mat& img = frame.image;
+            if (img.empty()) return false;
+            frame_w = img.cols;
+            frame_h = img.rows;
+            average(img.cols, img.rows, [&img](int y, int x) {
+                const uint8_t* p = img.ptr<uint8_t>(y) + x * 3;
+                return (p[0] + 2 * p[1] + p[2]) >> 2;
+            });
+            return true;
+        }
+        case PixelFormat::YUYV: {
+            const cv::Mat& raw = frame.raw;
+            if (raw.empty()) return false;
+            frame_w = raw.cols;
+            frame_h = raw.rows;
+            average(raw.cols, raw.rows, [&raw](int y, int x) { return static_cast<int>(raw.ptr<uint8_t>(y)[x * 2]); });
+            return true;
+        }
+        case PixelFormat::MJPEG: {
+            // 按1/8尺寸只解码亮度，比整帧解码便宜得多
+            if (frame.raw.empty()) return false;
+            small = cv::imdecode(frame.raw, cv::IMREAD_REDUCED_GRAYSCALE_8);
+            if (small.empty()) return false;
+            frame_w = small.cols * 8;
+            frame_h = small.rows * 8;
+            const cv::Mat& img = small;
+            average(img.cols, img.rows, [&img](int y, int x) { return static_cast<int>(img.ptr<uint8_t>(y)[x]); });
+            return true;
+        }
+        }
+        return false;
+    }
+};
+
+#endif // MOTION_GATE_H
@@ -0,0 +1,86 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// 有界无锁队列：多生产者单消费者（基于Vyukov有界环形队列）
+// 每个槽位带序号，生产者只CAS入队位置，消费者独占出队位置
+template <typename T>
+class MpscQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+
+public:
+    // capacity向上取整为2的幂
+    explicit MpscQueue(size_t capacity) : enqueue_pos(0), dequeue_pos(0) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        cells.reset(new Cell[cap]);
+        mask = cap - 1;
+        for (size_t i = 0; i < cap; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // 入队；队列满时返回false（由调用方决定等待或丢弃）
+    template <typename U>
+    bool try_push(U&& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::forward<U>(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 出队（仅消费者线程调用）；队列空时返回false
+    bool try_pop(T& out) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell& cell = cells[pos & mask];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+            return false;
+        }
+        out = std::move(cell.data);
+        cell.seq.store(pos + mask + 1, std::memory_order_release);
+        dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 近似长度（并发下仅作参考）
+    size_t size_approx() const {
+        size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+        size_t head = dequeue_pos.load(std::memory_order_relaxed);
+        return tail >= head ? tail - head : 0;
+    }
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,86 @@
+#ifndef PENDING_MEMS_H
+#define PENDING_MEMS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory_types.h"
+
+// 异步写队列中的一条记忆：入队时建立，写线程插入后填mem_id（在COMMIT之前），最终失败时置failed
+struct PendingMem {
+    ConversationMem mem;
+    std::atomic<int64_t> mem_id;  // 0表示尚未插入；事务回滚后逐条重试时会换成新的mem_id
+    std::atomic<bool> failed;     // 最终没能写入（不会出现在库里）
+    explicit PendingMem(const ConversationMem& m) : mem(m), mem_id(0), failed(false) {}
+};
+
+// 已入队、写线程尚未处理完的记忆，按uid索引
+// 读路径不再用flush()等写线程提交，而是把本用户未处理完的记忆并进SQL结果（见merge_pending）：
+// 读方先collect再查SQL；写线程先提交再remove，所以查询开始前已提交的记忆一定在SQL结果里，
+// 两边都有的那一条按mem_id去重
+// 按uid哈希分条加锁；队列为空时collect只读一个原子计数，同步写入模式下读路径没有额外开销
+class PendingMems {
+private:
+    static const size_t kStripes = 16;
+
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::deque<std::shared_ptr<PendingMem>>> rows;  // 按入队先后
+    };
+
+    Stripe stripes[kStripes];
+    std::atomic<size_t> count;
+
+    Stripe& stripe_of(const std::string& uid) { return stripes[std::hash<std::string>()(uid) % kStripes]; }
+
+public:
+    PendingMems() : count(0) {}
+
+    PendingMems(const PendingMems&) = delete;
+    PendingMems& operator=(const PendingMems&) = delete;
+
+    // 入队前登记
+    void add(const std::shared_ptr<PendingMem>& p) {
+        Stripe& s = stripe_of(p->mem.uid);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.rows[p->mem.uid].push_back(p);
+        ++count;
+    }
+
+    // 写线程提交（或确认失败）之后移除
+    void remove(const std::shared_ptr<PendingMem>& p) {
+        Stripe& s = stripe_of(p->mem.uid);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.rows.find(p->mem.uid);
+        if (it == s.rows.end()) return;
+        std::deque<std::shared_ptr<PendingMem>>& q = it->second;
+        for (auto r = q.begin(); r != q.end(); ++r) {
+            if (*r == p) {
+                q.erase(r);
+                --count;
+                break;
+            }
+        }
+        if (q.empty()) s.rows.erase(it);
+    }
+
+    // 把uid未处理完的记忆按入队先后追加到out
+    void collect(const std::string& uid, std::vector<std::shared_ptr<PendingMem>>& out) {
+        if (count.load() == 0) return;
+        Stripe& s = stripe_of(uid);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.rows.find(uid);
+        if (it == s.rows.end()) return;
+        out.insert(out.end(), it->second.begin(), it->second.end());
+    }
+};
+
+#endif // PENDING_MEMS_H
@@ -0,0 +1,677 @@
+#ifndef QUANTIZED_FACE_NET_H
+#define QUANTIZED_FACE_NET_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+
+#include "model_file.h"
+
+// GEMM内核：按编译目标自动选择（int8: x86 AVX2、ARM NEON；float: x86 AVX(+FMA)、aarch64 NEON；其余为标量）
+#if defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// dlib_face_recognition_resnet_model_v1（face_recognition_model_v1.h中的anet_type）的int8推理实现
+// 权重按输出通道对称量化为int8，卷积输入（均为ReLU之后的非负值，首层为0~255的原始像素）按层量化为0~127，
+// 卷积用im2col + int8点积（int32累加）计算，残差相加、ReLU、池化和全连接层保持float
+// 同一套权重的float前向（映射模型默认走它）用分块float GEMM计算卷积，不依赖-ffast-math也能向量化
+// 权重可以由setWeights传入（自己持有），也可以直接引用mmap的.mrm模型文件（attach，不拷贝）
+namespace qnet {
+
+// ---- 内核 ----
+
+#if defined(__AVX2__)
+inline int32_t hsum_epi32(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+inline int32x4_t mac_s8(int32x4_t acc, int8x16_t a, int8x16_t b) {
+    int16x8_t p = vmull_s8(vget_low_s8(a), vget_low_s8(b));
+    p = vmlal_s8(p, vget_high_s8(a), vget_high_s8(b));  // 两项乘积和不超过2*127*127，int16不溢出
+    return vpadalq_s16(acc, p);
+}
+
+inline int32_t hsum_s32(int32x4_t v) {
+#if defined(__aarch64__)
+    return vaddvq_s32(v);
+#else
+    int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+    return vget_lane_s32(vpadd_s32(s, s), 0);
+#endif
+}
+#endif
+
+// 一个激活向量a（0~127）与4行权重（-127~127）的点积，K为32的倍数；激活只加载一次
+inline void dot4_u8s8(const uint8_t* a, const int8_t* b0, const int8_t* b1, const int8_t* b2, const int8_t* b3,
+                      int K, int32_t* out) {
+#if defined(__AVX2__)
+    // 激活不超过127，maddubs相邻两项之和不超过2*127*127，不会饱和
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+    for (int k = 0; k < K; k += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+        __m256i p0 = _mm256_maddubs_epi16(va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b0 + k)));
+        __m256i p1 = _mm256_maddubs_epi16(va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b1 + k)));
+        __m256i p2 = _mm256_maddubs_epi16(va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b2 + k)));
+        __m256i p3 = _mm256_maddubs_epi16(va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b3 + k)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(p0, ones));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(p1, ones));
+        acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(p2, ones));
+        acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(p3, ones));
+    }
+    out[0] = hsum_epi32(acc0);
+    out[1] = hsum_epi32(acc1);
+    out[2] = hsum_epi32(acc2);
+    out[3] = hsum_epi32(acc3);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t acc0 = vdupq_n_s32(0), acc1 = vdupq_n_s32(0), acc2 = vdupq_n_s32(0), acc3 = vdupq_n_s32(0);
+    for (int k = 0; k < K; k += 16) {
+        int8x16_t va = vreinterpretq_s8_u8(vld1q_u8(a + k));  // 0~127按有符号解释不变
+        acc0 = mac_s8(acc0, va, vld1q_s8(b0 + k));
+        acc1 = mac_s8(acc1, va, vld1q_s8(b1 + k));
+        acc2 = mac_s8(acc2, va, vld1q_s8(b2 + k));
+        acc3 = mac_s8(acc3, va, vld1q_s8(b3 + k));
+    }
+    out[0] = hsum_s32(acc0);
+    out[1] = hsum_s32(acc1);
+    out[2] = hsum_s32(acc2);
+    out[3] = hsum_s32(acc3);
+#else
+    int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int k = 0; k < K; ++k) {
+        int32_t v = a[k];
+        s0 += v * b0[k];
+        s1 += v * b1[k];
+        s2 += v * b2[k];
+        s3 += v * b3[k];
+    }
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+#endif
+}
+
+// float GEMM的一块：4个滤波器 x kTileP个输出像素，c_j[p] = b[j] + sum_k w_j[k] * x[k * ldx + p]
+// x为按列排布的im2col（每行一个卷积核位置，每列一个输出像素）：每个k载入一行16个像素、广播4个权重，
+// 64个累加器常驻寄存器，沿像素方向向量化，没有点积那样的水平求和，也不改变逐项累加的顺序
+const int kTileP = 16;
+
+inline void gemm4_f32(const float* w0, const float* w1, const float* w2, const float* w3, const float* b,
+                      const float* x, size_t ldx, int K, float* c0, float* c1, float* c2, float* c3) {
+#if defined(__AVX__)
+#if defined(__FMA__)
+#define QNET_MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define QNET_MADD(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+    __m256 a00 = _mm256_set1_ps(b[0]), a01 = a00, a10 = _mm256_set1_ps(b[1]), a11 = a10;
+    __m256 a20 = _mm256_set1_ps(b[2]), a21 = a20, a30 = _mm256_set1_ps(b[3]), a31 = a30;
+    for (int k = 0; k < K; ++k) {
+        const float* xk = x + static_cast<size_t>(k) * ldx;
+        const __m256 x0 = _mm256_loadu_ps(xk), x1 = _mm256_loadu_ps(xk + 8);
+        __m256 v = _mm256_broadcast_ss(w0 + k);
+        a00 = QNET_MADD(v, x0, a00);
+        a01 = QNET_MADD(v, x1, a01);
+        v = _mm256_broadcast_ss(w1 + k);
+        a10 = QNET_MADD(v, x0, a10);
+        a11 = QNET_MADD(v, x1, a11);
+        v = _mm256_broadcast_ss(w2 + k);
+        a20 = QNET_MADD(v, x0, a20);
+        a21 = QNET_MADD(v, x1, a21);
+        v = _mm256_broadcast_ss(w3 + k);
+        a30 = QNET_MADD(v, x0, a30);
+        a31 = QNET_MADD(v, x1, a31);
+    }
+#undef QNET_MADD
+    _mm256_storeu_ps(c0, a00);
+    _mm256_storeu_ps(c0 + 8, a01);
+    _mm256_storeu_ps(c1, a10);
+    _mm256_storeu_ps(c1 + 8, a11);
+    _mm256_storeu_ps(c2, a20);
+    _mm256_storeu_ps(c2 + 8, a21);
+    _mm256_storeu_ps(c3, a30);
+    _mm256_storeu_ps(c3 + 8, a31);
+#elif defined(__aarch64__)
+    float32x4_t acc[4][4];
+    for (int j = 0; j < 4; ++j) {
+        for (int q = 0; q < 4; ++q) acc[j][q] = vdupq_n_f32(b[j]);
+    }
+    for (int k = 0; k < K; ++k) {
+        const float* xk = x + static_cast<size_t>(k) * ldx;
+        const float32x4_t x0 = vld1q_f32(xk), x1 = vld1q_f32(xk + 4), x2 = vld1q_f32(xk + 8), x3 = vld1q_f32(xk + 12);
+        const float wk[4] = {w0[k], w1[k], w2[k], w3[k]};
+        for (int j = 0; j < 4; ++j) {
+            acc[j][0] = vfmaq_n_f32(acc[j][0], x0, wk[j]);
+            acc[j][1] = vfmaq_n_f32(acc[j][1], x1, wk[j]);
+            acc[j][2] = vfmaq_n_f32(acc[j][2], x2, wk[j]);
+            acc[j][3] = vfmaq_n_f32(acc[j][3], x3, wk[j]);
+        }
+    }
+    float* const c[4] = {c0, c1, c2, c3};
+    for (int j = 0; j < 4; ++j) {
+        for (int q = 0; q < 4; ++q) vst1q_f32(c[j] + 4 * q, acc[j][q]);
+    }
+#else
+    // 内层沿像素方向、各像素互不相关，编译器可自动向量化（不需要-ffast-math）
+    float acc[4][kTileP];
+    for (int j = 0; j < 4; ++j) {
+        for (int p = 0; p < kTileP; ++p) acc[j][p] = b[j];
+    }
+    for (int k = 0; k < K; ++k) {
+        const float* xk = x + static_cast<size_t>(k) * ldx;
+        const float v0 = w0[k], v1 = w1[k], v2 = w2[k], v3 = w3[k];
+        for (int p = 0; p < kTileP; ++p) {
+            acc[0][p] += v0 * xk[p];
+            acc[1][p] += v1 * xk[p];
+            acc[2][p] += v2 * xk[p];
+            acc[3][p] += v3 * xk[p];
+        }
+    }
+    std::memcpy(c0, acc[0], sizeof(acc[0]));
+    std::memcpy(c1, acc[1], sizeof(acc[1]));
+    std::memcpy(c2, acc[2], sizeof(acc[2]));
+    std::memcpy(c3, acc[3], sizeof(acc[3]));
+#endif
+}
+
+// CHW排列的float张量，缓冲跨调用复用
+struct Tensor {
+    int c, h, w;
+    std::vector<float> data;
+    Tensor() : c(0), h(0), w(0) {}
+    void resize(int channels, int rows, int cols) {
+        c = channels;
+        h = rows;
+        w = cols;
+        data.resize(static_cast<size_t>(c) * h * w);
+    }
+    float* plane(int k) { return &data[static_cast<size_t>(k) * h * w]; }
+    const float* plane(int k) const { return &data[static_cast<size_t>(k) * h * w]; }
+};
+
+} // namespace qnet
+
+class QuantizedFaceNet {
+public:
+    static const int kInputSize = 150;
+    static const int kDescriptorDim = 128;
+    static const int kConvCount = 29;  // 首层7x7卷积 + 14个残差块各两层3x3卷积
+    static const int kFcInputs = 256;
+
+    // 一层卷积的权重（已折叠其后的affine层）：weight按[输出][输入][行][列]排列
+    struct ConvParams {
+        std::vector<float> weight;
+        std::vector<float> bias;
+    };
+
+    QuantizedFaceNet(const QuantizedFaceNet&) = delete;  // 层内指针指向自身持有的缓冲
+    QuantizedFaceNet& operator=(const QuantizedFaceNet&) = delete;
+
+    QuantizedFaceNet() : fc(nullptr), has_weights(false), has_calibration(false) {
+        add_layer(3, 32, 7, 2, 0);
+        struct Block { int channels; bool down; };
+        // 与anet_type一致：alevel4(3x32) alevel3(64下采样+3x64) alevel2(128下采样+2x128)
+        //                  alevel1(256下采样+2x256) alevel0(256下采样)
+        const Block blocks[] = {
+            {32, false}, {32, false}, {32, false},
+            {64, true}, {64, false}, {64, false}, {64, false},
+            {128, true}, {128, false}, {128, false},
+            {256, true}, {256, false}, {256, false},
+            {256, true}
+        };
+        int ch = 32;
+        for (const Block& b : blocks) {
+            add_layer(ch, b.channels, 3, b.down ? 2 : 1, b.down ? 0 : 1);  // dlib步长不为1的卷积不补边
+            add_layer(b.channels, b.channels, 3, 1, 1);
+            block_down.push_back(b.down);
+            ch = b.channels;
+        }
+        act_max.assign(kConvCount, 0.0f);
+    }
+
+    // convs按从输入到输出的顺序给出（共kConvCount层，权重以dlib输入归一化后的张量为输入）；
+    // fc为kFcInputs x 128，按[输入][输出]排列（与dlib fc_层参数相同）
+    bool setWeights(const std::vector<ConvParams>& convs, const std::vector<float>& fc_in) {
+        if (convs.size() != layers.size() || fc_in.size() != static_cast<size_t>(kFcInputs) * kDescriptorDim) {
+            return false;
+        }
+        for (size_t i = 0; i < layers.size(); ++i) {
+            Layer& L = layers[i];
+            if (convs[i].weight.size() != static_cast<size_t>(L.out_ch) * L.kdim ||
+                convs[i].bias.size() != static_cast<size_t>(L.out_ch)) {
+                return false;
+            }
+            L.weight = convs[i].weight;
+            L.bias = convs[i].bias;
+        }
+
+        // 首层输入改为0~255的原始像素：dlib的归一化(p - mean) / 256折进权重和偏置
+        static const float kMean[3] = {122.782f, 117.001f, 104.298f};
+        Layer& stem = layers[0];
+        const int taps = stem.k * stem.k;
+        for (int f = 0; f < stem.out_ch; ++f) {
+            float* w = &stem.weight[static_cast<size_t>(f) * stem.kdim];
+            for (int c = 0; c < 3; ++c) {
+                for (int t = 0; t < taps; ++t) {
+                    stem.bias[f] -= w[c * taps + t] * kMean[c] / 256.0f;
+                    w[c * taps + t] /= 256.0f;
+                }
+            }
+        }
+
+        for (Layer& L : layers) {
+            quantize_weights(L);
+            L.w = L.weight.data();
+            L.b = L.bias.data();
+            L.qw = L.qweight.data();
+            L.ws = L.wscale.data();
+        }
+        fc_weight = fc_in;
+        fc = fc_weight.data();
+        act_max[0] = 255.0f;
+        mapped.reset();
+        has_weights = true;
+        return true;
+    }
+
+    // ---- .mrm模型文件（kind为"face_net"）：每层float权重（已折叠）、int8权重及系数、fc、校准范围 ----
+
+    // 写出当前权重（需已setWeights或attach）
+    bool exportTo(ModelFileWriter& writer) const {
+        if (!has_weights) return false;
+        const uint32_t meta[4] = {static_cast<uint32_t>(kConvCount), static_cast<uint32_t>(kFcInputs),
+                                  static_cast<uint32_t>(kDescriptorDim), has_calibration ? 1u : 0u};
+        writer.add("meta", meta, sizeof(meta));
+        for (size_t i = 0; i < layers.size(); ++i) {
+            const Layer& L = layers[i];
+            const std::string prefix = "conv" + std::to_string(i);
+            writer.add(prefix + ".w", L.w, sizeof(float) * L.out_ch * L.kdim);
+            writer.add(prefix + ".b", L.b, sizeof(float) * L.out_ch);
+            writer.add(prefix + ".qw", L.qw, static_cast<size_t>(L.out_ch) * L.kpad);
+            writer.add(prefix + ".ws", L.ws, sizeof(float) * L.out_ch);
+        }
+        writer.add("fc.w", fc, sizeof(float) * kFcInputs * kDescriptorDim);
+        writer.add("act_max", act_max);
+        return true;
+    }
+
+    // 直接使用映射文件中的权重：不拷贝，各层权重在首次前向时才按页调入
+    bool attach(const std::shared_ptr<const MappedModelFile>& file) {
+        bool ok = file && file->isOpen();
+        const uint32_t* meta = ok ? file->section<uint32_t>("meta", 4, ok) : nullptr;
+        if (!ok || meta[0] != static_cast<uint32_t>(kConvCount) || meta[1] != static_cast<uint32_t>(kFcInputs) ||
+            meta[2] != static_cast<uint32_t>(kDescriptorDim)) {
+            return false;
+        }
+        std::vector<Layer> views = layers;
+        for (size_t i = 0; i < views.size() && ok; ++i) {
+            Layer& L = views[i];
+            const std::string prefix = "conv" + std::to_string(i);
+            L.w = file->section<float>(prefix + ".w", static_cast<size_t>(L.out_ch) * L.kdim, ok);
+            L.b = file->section<float>(prefix + ".b", L.out_ch, ok);
+            L.qw = file->section<int8_t>(prefix + ".qw", static_cast<size_t>(L.out_ch) * L.kpad, ok);
+            L.ws = file->section<float>(prefix + ".ws", L.out_ch, ok);
+        }
+        const float* fc_view = file->section<float>("fc.w", static_cast<size_t>(kFcInputs) * kDescriptorDim, ok);
+        const float* ranges = file->section<float>("act_max", kConvCount, ok);
+        if (!ok) return false;
+
+        for (Layer& L : views) {
+            L.weight.clear();
+            L.bias.clear();
+            L.qweight.clear();
+            L.wscale.clear();
+        }
+        layers.swap(views);
+        fc_weight.clear();
+        fc = fc_view;
+        act_max.assign(ranges, ranges + kConvCount);
+        has_calibration = meta[3] != 0;
+        mapped = file;
+        has_weights = true;
+        return true;
+    }
+
+    bool ready() const { return has_weights; }
+    bool calibrated() const { return has_calibration; }
+
+    // 150x150 RGB人脸块（逐像素RGB交错，与dlib::matrix<rgb_pixel>内存布局相同）-> 128维特征
+    void forward(const uint8_t* rgb, float* descriptor) { run(rgb, descriptor, true, false); }
+    // 同一套权重的float参考实现（用于校准和精度对比）
+    void forwardFloat(const uint8_t* rgb, float* descriptor) { run(rgb, descriptor, false, false); }
+
+    // ---- 校准：统计每层卷积输入的最大激活，作为静态量化范围；未校准时每次按实际最大值动态量化 ----
+    void resetCalibration() {
+        act_max.assign(kConvCount, 0.0f);
+        act_max[0] = 255.0f;
+        has_calibration = false;
+    }
+
+    void calibrate(const uint8_t* rgb) {
+        float descriptor[kDescriptorDim];
+        run(rgb, descriptor, false, true);
+        has_calibration = true;
+    }
+
+    bool saveCalibration(const std::string& path) const {
+        if (!has_calibration) return false;
+        std::ofstream out(path.c_str());
+        if (!out) return false;
+        out << "quantized_face_net_calibration 1\n" << kConvCount << "\n";
+        for (float v : act_max) out << v << "\n";
+        return static_cast<bool>(out);
+    }
+
+    bool loadCalibration(const std::string& path) {
+        std::ifstream in(path.c_str());
+        std::string magic;
+        int version = 0, count = 0;
+        if (!(in >> magic >> version >> count) || magic != "quantized_face_net_calibration" ||
+            version != 1 || count != kConvCount) {
+            return false;
+        }
+        std::vector<float> values(kConvCount);
+        for (float& v : values) {
+            if (!(in >> v) || v <= 0.0f) return false;
+        }
+        act_max = values;
+        has_calibration = true;
+        return true;
+    }
+
+private:
+    struct Layer {
+        int in_ch, out_ch, k, stride, pad;
+        int kdim;   // in_ch * k * k
+        int kpad;   // kdim向上取整到32（内核按32字节一组处理）
+        // setWeights时由下面的vector持有；attach时为空，数据在映射文件中
+        std::vector<float> weight;     // [out_ch][kdim]
+        std::vector<float> bias;
+        std::vector<int8_t> qweight;   // [out_ch][kpad]
+        std::vector<float> wscale;     // 每输出通道的权重量化系数
+        // 前向时使用的视图（指向上面的vector或映射文件）
+        const float* w = nullptr;
+        const float* b = nullptr;
+        const int8_t* qw = nullptr;
+        const float* ws = nullptr;
+    };
+
+    std::vector<Layer> layers;
+    std::vector<bool> block_down;
+    std::vector<float> fc_weight;
+    const float* fc;
+    std::shared_ptr<const MappedModelFile> mapped;  // attach时保持映射有效
+    std::vector<float> act_max;  // 每层卷积输入的量化范围
+    bool has_weights;
+    bool has_calibration;
+
+    // 前向缓冲（forward不可并发调用）
+    qnet::Tensor x, t1, t2, pooled;
+    std::vector<uint8_t> qin;
+    std::vector<uint8_t> qcol;
+    std::vector<float> fcol;
+
+    void add_layer(int in_ch, int out_ch, int k, int stride, int pad) {
+        Layer L;
+        L.in_ch = in_ch;
+        L.out_ch = out_ch;
+        L.k = k;
+        L.stride = stride;
+        L.pad = pad;
+        L.kdim = in_ch * k * k;
+        L.kpad = (L.kdim + 31) / 32 * 32;
+        layers.push_back(L);
+    }
+
+    static void quantize_weights(Layer& L) {
+        L.qweight.assign(static_cast<size_t>(L.out_ch) * L.kpad, 0);
+        L.wscale.resize(L.out_ch);
+        for (int f = 0; f < L.out_ch; ++f) {
+            const float* w = &L.weight[static_cast<size_t>(f) * L.kdim];
+            float m = 0.0f;
+            for (int i = 0; i < L.kdim; ++i) m = std::max(m, std::fabs(w[i]));
+            float scale = m > 0.0f ? m / 127.0f : 1.0f;
+            L.wscale[f] = scale;
+            int8_t* q = &L.qweight[static_cast<size_t>(f) * L.kpad];
+            for (int i = 0; i < L.kdim; ++i) {
+                q[i] = static_cast<int8_t>(std::lround(w[i] / scale));
+            }
+        }
+    }
+
+    static int out_dim(int n, const Layer& L) { return (n + 2 * L.pad - L.k) / L.stride + 1; }
+
+    // 卷积（输出不含激活）；calib时只用float并记录输入最大值
+    void conv(int li, const qnet::Tensor& in, qnet::Tensor& out, bool int8, bool calib) {
+        const Layer& L = layers[li];
+        const int oh = out_dim(in.h, L), ow = out_dim(in.w, L);
+        const int P = oh * ow;
+        out.resize(L.out_ch, oh, ow);
+
+        float in_max = 0.0f;
+        if (calib || (int8 && !has_calibration)) {
+            for (float v : in.data) in_max = std::max(in_max, v);
+            if (li == 0) in_max = 255.0f;
+        }
+        if (calib) act_max[li] = std::max(act_max[li], in_max);
+
+        if (!int8) {
+            // 按kTileP个像素一块：块内的im2col列（kdim x 16）留在缓存中，依次与每4个滤波器相乘
+            const size_t ldx = static_cast<size_t>(P + qnet::kTileP - 1) / qnet::kTileP * qnet::kTileP;
+            fcol.resize(static_cast<size_t>(L.kdim) * ldx);
+            im2col_f32(in, L, oh, ow, ldx);
+            float tail[4][qnet::kTileP];
+            for (int p = 0; p < P; p += qnet::kTileP) {
+                const bool full = p + qnet::kTileP <= P;
+                const float* x = &fcol[p];
+                for (int f = 0; f < L.out_ch; f += 4) {
+                    const float* w = L.w + static_cast<size_t>(f) * L.kdim;
+                    if (full) {
+                        qnet::gemm4_f32(w, w + L.kdim, w + 2 * L.kdim, w + 3 * L.kdim, L.b + f, x, ldx, L.kdim,
+                                        out.plane(f) + p, out.plane(f + 1) + p, out.plane(f + 2) + p,
+                                        out.plane(f + 3) + p);
+                        continue;
+                    }
+                    // 最后不满一块：im2col补的是0列，结果先写到临时块再拷出有效部分
+                    qnet::gemm4_f32(w, w + L.kdim, w + 2 * L.kdim, w + 3 * L.kdim, L.b + f, x, ldx, L.kdim,
+                                    tail[0], tail[1], tail[2], tail[3]);
+                    for (int j = 0; j < 4; ++j) std::memcpy(out.plane(f + j) + p, tail[j], sizeof(float) * (P - p));
+                }
+            }
+            return;
+        }
+
+        // 输入量化为0~127（卷积输入都是非负值；超出校准范围的截断）
+        float range = has_calibration ? act_max[li] : in_max;
+        float scale = range > 0.0f ? range / 127.0f : 1.0f;
+        float inv = 1.0f / scale;
+        qin.resize(in.data.size());
+        for (size_t i = 0; i < in.data.size(); ++i) {
+            float v = in.data[i] * inv + 0.5f;
+            qin[i] = static_cast<uint8_t>(v <= 0.0f ? 0 : (v >= 127.0f ? 127 : static_cast<int>(v)));
+        }
+
+        qcol.resize(static_cast<size_t>(P) * L.kpad);
+        im2col_u8(in, L, oh, ow);
+        int32_t acc[4];
+        for (int p = 0; p < P; ++p) {
+            const uint8_t* a = &qcol[static_cast<size_t>(p) * L.kpad];
+            for (int f = 0; f < L.out_ch; f += 4) {
+                const int8_t* w = L.qw + static_cast<size_t>(f) * L.kpad;
+                qnet::dot4_u8s8(a, w, w + L.kpad, w + 2 * L.kpad, w + 3 * L.kpad, L.kpad, acc);
+                for (int j = 0; j < 4; ++j) {
+                    out.plane(f + j)[p] = acc[j] * (scale * L.ws[f + j]) + L.b[f + j];
+                }
+            }
+        }
+    }
+
+    // 每个输出像素一行：[输入通道][核行][核列]，越界处补0
+    template <typename T, typename Src>
+    static void im2col_rows(const Src& src, int in_ch, int h, int w, const Layer& L, int oh, int ow, T* col, int row_len) {
+        for (int oy = 0; oy < oh; ++oy) {
+            for (int ox = 0; ox < ow; ++ox) {
+                T* row = col + static_cast<size_t>(oy * ow + ox) * row_len;
+                int idx = 0;
+                for (int c = 0; c < in_ch; ++c) {
+                    for (int ky = 0; ky < L.k; ++ky) {
+                        int y = oy * L.stride - L.pad + ky;
+                        for (int kx = 0; kx < L.k; ++kx, ++idx) {
+                            int xx = ox * L.stride - L.pad + kx;
+                            row[idx] = (y < 0 || y >= h || xx < 0 || xx >= w) ? T(0) : src(c, y, xx);
+                        }
+                    }
+                }
+                for (; idx < row_len; ++idx) row[idx] = T(0);
+            }
+        }
+    }
+
+    // float GEMM用的按列排布：每个卷积核位置[输入通道][核行][核列]一行，每个输出像素一列，
+    // 行长ldx（像素数补到kTileP的倍数，补的列为0）；越界处补0
+    void im2col_f32(const qnet::Tensor& in, const Layer& L, int oh, int ow, size_t ldx) {
+        const int P = oh * ow;
+        float* row = fcol.data();
+        for (int c = 0; c < in.c; ++c) {
+            const float* plane = in.plane(c);
+            for (int ky = 0; ky < L.k; ++ky) {
+                for (int kx = 0; kx < L.k; ++kx, row += ldx) {
+                    for (int oy = 0; oy < oh; ++oy) {
+                        const int y = oy * L.stride - L.pad + ky;
+                        float* dst = row + oy * ow;
+                        if (y < 0 || y >= in.h) {
+                            std::fill(dst, dst + ow, 0.0f);
+                            continue;
+                        }
+                        const float* src = plane + static_cast<size_t>(y) * in.w;
+                        for (int ox = 0; ox < ow; ++ox) {
+                            const int xx = ox * L.stride - L.pad + kx;
+                            dst[ox] = (xx < 0 || xx >= in.w) ? 0.0f : src[xx];
+                        }
+                    }
+                    std::fill(row + P, row + ldx, 0.0f);
+                }
+            }
+        }
+    }
+
+    void im2col_u8(const qnet::Tensor& in, const Layer& L, int oh, int ow) {
+        const uint8_t* d = qin.data();
+        const int h = in.h, w = in.w;
+        im2col_rows<uint8_t>([d, h, w](int c, int y, int xx) { return d[(static_cast<size_t>(c) * h + y) * w + xx]; },
+                             in.c, h, w, L, oh, ow, qcol.data(), L.kpad);
+    }
+
+    static void relu(qnet::Tensor& t) {
+        for (float& v : t.data) v = v > 0.0f ? v : 0.0f;
+    }
+
+    // 最大池化3x3步长2（不补边）
+    static void max_pool(const qnet::Tensor& in, qnet::Tensor& out) {
+        int oh = (in.h - 3) / 2 + 1, ow = (in.w - 3) / 2 + 1;
+        out.resize(in.c, oh, ow);
+        for (int c = 0; c < in.c; ++c) {
+            const float* s = in.plane(c);
+            float* d = out.plane(c);
+            for (int y = 0; y < oh; ++y) {
+                for (int x = 0; x < ow; ++x) {
+                    float m = s[(y * 2) * in.w + x * 2];
+                    for (int dy = 0; dy < 3; ++dy) {
+                        for (int dx = 0; dx < 3; ++dx) m = std::max(m, s[(y * 2 + dy) * in.w + x * 2 + dx]);
+                    }
+                    d[y * ow + x] = m;
+                }
+            }
+        }
+    }
+
+    // 平均池化2x2步长2（下采样残差支路）
+    static void avg_pool2(const qnet::Tensor& in, qnet::Tensor& out) {
+        int oh = (in.h - 2) / 2 + 1, ow = (in.w - 2) / 2 + 1;
+        out.resize(in.c, oh, ow);
+        for (int c = 0; c < in.c; ++c) {
+            const float* s = in.plane(c);
+            float* d = out.plane(c);
+            for (int y = 0; y < oh; ++y) {
+                for (int x = 0; x < ow; ++x) {
+                    const float* p = s + (y * 2) * in.w + x * 2;
+                    d[y * ow + x] = 0.25f * (p[0] + p[1] + p[in.w] + p[in.w + 1]);
+                }
+            }
+        }
+    }
+
+    // out = a + b；尺寸不同时按dlib add_prev的规则取各维最大值，缺失部分按0计
+    static void add_padded(const qnet::Tensor& a, const qnet::Tensor& b, qnet::Tensor& out) {
+        out.resize(std::max(a.c, b.c), std::max(a.h, b.h), std::max(a.w, b.w));
+        for (int c = 0; c < out.c; ++c) {
+            float* d = out.plane(c);
+            for (int y = 0; y < out.h; ++y) {
+                for (int x = 0; x < out.w; ++x) {
+                    float v = 0.0f;
+                    if (c < a.c && y < a.h && x < a.w) v += a.plane(c)[y * a.w + x];
+                    if (c < b.c && y < b.h && x < b.w) v += b.plane(c)[y * b.w + x];
+                    d[y * out.w + x] = v;
+                }
+            }
+        }
+    }
+
+    void run(const uint8_t* rgb, float* descriptor, bool int8, bool calib) {
+        // 输入：RGB三个平面的原始像素（归一化已折进首层）
+        x.resize(3, kInputSize, kInputSize);
+        const int n = kInputSize * kInputSize;
+        for (int i = 0; i < n; ++i) {
+            x.data[i] = rgb[i * 3];
+            x.data[n + i] = rgb[i * 3 + 1];
+            x.data[2 * n + i] = rgb[i * 3 + 2];
+        }
+
+        conv(0, x, t1, int8, calib);
+        relu(t1);
+        max_pool(t1, x);
+
+        int li = 1;
+        for (size_t b = 0; b < block_down.size(); ++b) {
+            conv(li++, x, t1, int8, calib);
+            relu(t1);
+            conv(li++, t1, t2, int8, calib);
+            if (block_down[b]) {
+                avg_pool2(x, pooled);
+                add_padded(t2, pooled, x);
+            } else {
+                for (size_t i = 0; i < x.data.size(); ++i) x.data[i] += t2.data[i];
+            }
+            relu(x);
+        }
+
+        // 全局平均池化 + 全连接（无偏置）
+        float feat[kFcInputs];
+        for (int c = 0; c < kFcInputs; ++c) {
+            const float* p = x.plane(c);
+            float s = 0.0f;
+            for (int i = 0; i < x.h * x.w; ++i) s += p[i];
+            feat[c] = s / (x.h * x.w);
+        }
+        for (int o = 0; o < kDescriptorDim; ++o) descriptor[o] = 0.0f;
+        for (int i = 0; i < kFcInputs; ++i) {
+            const float* w = fc + static_cast<size_t>(i) * kDescriptorDim;
+            for (int o = 0; o < kDescriptorDim; ++o) descriptor[o] += feat[i] * w[o];
+        }
+    }
+};
+
+#endif // QUANTIZED_FACE_NET_H
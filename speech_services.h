@@ -0,0 +1,231 @@
+#ifndef SPEECH_SERVICES_H
+#define SPEECH_SERVICES_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "memory_types.h"
+
+// 语音交互的外部服务接口：录音、语音识别（ASR）、大模型对话（LLM）、语音合成播报（TTS）
+// 具体实现（本地模型、云端API）由调用方提供；文件末尾的桩实现只按配置的耗时睡眠，用于测试和基准
+// 所有接口都可能在InteractionPipeline的工作线程上调用，同一实例不会被并发调用
+
+// 一段录音（PCM 16位单声道）；实现也可以只给出文件路径
+struct AudioClip {
+    std::vector<int16_t> samples;
+    int sample_rate;
+    std::string path;
+    AudioClip() : sample_rate(16000) {}
+};
+
+class AudioRecorder {
+public:
+    virtual ~AudioRecorder() {}
+    // 阻塞到录音结束（定长或检测到说话结束）
+    virtual bool record(AudioClip& clip) = 0;
+};
+
+class SpeechRecognizer {
+public:
+    virtual ~SpeechRecognizer() {}
+    virtual bool transcribe(const AudioClip& clip, std::string& text) = 0;
+};
+
+// 一次对话请求；image在照片写入后得到路径（空字符串表示没有照片），
+// 实现应在真正需要上传图片时才get()，让JPEG编码与建立连接、发送文本并行
+struct ChatRequest {
+    std::string uid;
+    std::string user_text;
+    std::string scene_tag;
+    std::vector<ConversationMem> context;  // 按时间倒序的历史记忆
+    std::shared_future<std::string> image;
+};
+
+class ChatModel {
+public:
+    virtual ~ChatModel() {}
+    // 流式生成：每收到一段增量文本调用一次on_delta（返回false时尽快中止）；answer为完整回复
+    // 不支持流式的实现可以在结束时用完整回复调用一次on_delta
+    virtual bool chat(const ChatRequest& request, const std::function<bool(const std::string&)>& on_delta,
+                      std::string& answer) = 0;
+};
+
+class SpeechSynthesizer {
+public:
+    virtual ~SpeechSynthesizer() {}
+    // 合成并播放一段文本，阻塞到播放结束；第一个音频块送进声卡时调用on_first_audio（可为空）
+    virtual bool speak(const std::string& text, const std::function<void()>& on_first_audio) = 0;
+};
+
+// 流式回复按句切分：遇到句末标点（。！？；…及换行、英文.!?;）切出一句；
+// 一句过长（超过max_bytes字节）时在逗号处提前切，让TTS尽早开始
+class SentenceSplitter {
+public:
+    explicit SentenceSplitter(size_t max_bytes = 60) : max_len(max_bytes) {}
+
+    // 追加增量文本，切出的完整句子追加到sentences
+    void push(const std::string& delta, std::vector<std::string>& sentences) {
+        buffer += delta;
+        size_t start = 0, i = 0;
+        while (i < buffer.size()) {
+            size_t len = 0;
+            bool comma = false;
+            if (match_end(buffer, i, len, comma) && (!comma || i + len - start >= max_len)) {
+                emit(buffer.substr(start, i + len - start), sentences);
+                start = i + len;
+                i = start;
+            } else {
+                i += len ? len : 1;
+            }
+        }
+        buffer.erase(0, start);
+    }
+
+    // 回复结束：剩余文本作为最后一句
+    void finish(std::vector<std::string>& sentences) {
+        emit(buffer, sentences);
+        buffer.clear();
+    }
+
+private:
+    size_t max_len;
+    std::string buffer;
+
+    static bool match_end(const std::string& s, size_t i, size_t& len, bool& comma) {
+        static const char* const kEnds[] = {"。", "！", "？", "；", "…", "～"};
+        static const char* const kCommas[] = {"，", "、"};
+        const char c = s[i];
+        len = 1;
+        comma = false;
+        if (c == '\n' || c == '!' || c == '?' || c == ';') return true;
+        if (c == '.') return i + 1 < s.size() && s[i + 1] == ' ';  // 小数点、缩写中的点不切；末尾的点等下一段
+        if (c == ',') {
+            comma = true;
+            return true;
+        }
+        for (const char* p : kEnds) {
+            if (s.compare(i, 3, p) == 0) {
+                len = 3;
+                return true;
+            }
+        }
+        for (const char* p : kCommas) {
+            if (s.compare(i, 3, p) == 0) {
+                len = 3;
+                comma = true;
+                return true;
+            }
+        }
+        // 其余多字节字符整体跳过，不在UTF-8字符中间切
+        const unsigned char u = static_cast<unsigned char>(c);
+        len = u >= 0xF0 ? 4 : u >= 0xE0 ? 3 : u >= 0xC0 ? 2 : 1;
+        return false;
+    }
+
+    static void emit(const std::string& text, std::vector<std::string>& sentences) {
+        size_t b = text.find_first_not_of(" \n\t");
+        if (b == std::string::npos) return;
+        size_t e = text.find_last_not_of(" \n\t");
+        sentences.push_back(text.substr(b, e - b + 1));
+    }
+};
+
+// ---- 桩实现：不依赖声卡和网络，按配置的耗时睡眠 ----
+
+inline void stub_sleep_ms(double ms) {
+    if (ms > 0) std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(ms * 1000.0)));
+}
+
+class StubRecorder : public AudioRecorder {
+public:
+    explicit StubRecorder(double record_ms = 3000.0) : duration_ms(record_ms) {}
+    bool record(AudioClip& clip) override {
+        stub_sleep_ms(duration_ms);
+        clip.samples.assign(static_cast<size_t>(clip.sample_rate * duration_ms / 1000.0), 0);
+        return true;
+    }
+
+private:
+    double duration_ms;
+};
+
+class StubRecognizer : public SpeechRecognizer {
+public:
+    StubRecognizer(double latency_ms = 300.0, const std::string& reply_text = "你好，机器人，今天我们读什么绘本？")
+        : latency(latency_ms), text_(reply_text) {}
+    bool transcribe(const AudioClip&, std::string& text) override {
+        stub_sleep_ms(latency);
+        text = text_;
+        return true;
+    }
+
+private:
+    double latency;
+    std::string text_;
+};
+
+// 模拟流式大模型：connect_ms建立连接并发送文本，之后取图片（等待照片写完），
+// 再经first_token_ms出第一段，之后每段间隔token_ms；每段chunk_chars个字符
+class StubChatModel : public ChatModel {
+public:
+    StubChatModel(double connect_ms = 150.0, double first_token_ms = 600.0, double token_ms = 40.0,
+                  const std::string& reply = "我们来读《小熊过河》吧！小熊要过河，可是桥断了。你觉得它会想什么办法呢？",
+                  size_t chunk_chars = 2)
+        : connect(connect_ms), first_token(first_token_ms), per_token(token_ms), reply_(reply),
+          chunk(chunk_chars ? chunk_chars : 1) {}
+
+    bool chat(const ChatRequest& request, const std::function<bool(const std::string&)>& on_delta,
+              std::string& answer) override {
+        stub_sleep_ms(connect);
+        if (request.image.valid()) request.image.get();
+        stub_sleep_ms(first_token);
+        answer.clear();
+        size_t i = 0;
+        while (i < reply_.size()) {
+            size_t end = i;
+            for (size_t n = 0; n < chunk && end < reply_.size(); ++n) end += utf8_len(reply_[end]);
+            std::string delta = reply_.substr(i, end - i);
+            answer += delta;
+            i = end;
+            if (on_delta && !on_delta(delta)) return false;
+            if (i < reply_.size()) stub_sleep_ms(per_token);
+        }
+        return true;
+    }
+
+private:
+    double connect, first_token, per_token;
+    std::string reply_;
+    size_t chunk;
+
+    static size_t utf8_len(char c) {
+        const unsigned char u = static_cast<unsigned char>(c);
+        return u >= 0xF0 ? 4 : u >= 0xE0 ? 3 : u >= 0xC0 ? 2 : 1;
+    }
+};
+
+// 模拟TTS：first_chunk_ms后出第一个音频块，整段播放时长按每字符char_ms计
+class StubSynthesizer : public SpeechSynthesizer {
+public:
+    StubSynthesizer(double first_chunk_ms = 200.0, double char_ms = 60.0) : first_chunk(first_chunk_ms), per_char(char_ms) {}
+
+    bool speak(const std::string& text, const std::function<void()>& on_first_audio) override {
+        stub_sleep_ms(first_chunk);
+        if (on_first_audio) on_first_audio();
+        size_t chars = 0;
+        for (char c : text) chars += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        stub_sleep_ms(per_char * chars);
+        return true;
+    }
+
+private:
+    double first_chunk, per_char;
+};
+
+#endif // SPEECH_SERVICES_H
@@ -0,0 +1,130 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 小型固定线程池：任务按提交顺序执行；析构时执行完已提交的任务再退出
+// 任务内不抛异常（与全项目一致，失败通过返回值/结果字段传递）
+class TaskPool {
+public:
+    explicit TaskPool(size_t threads) : stop(false) {
+        if (threads == 0) threads = 1;
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back(&TaskPool::run, this);
+    }
+
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop = true;
+        }
+        cv_.notify_all();
+        for (std::thread& t : workers) t.join();
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks;
+    bool stop;
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// 一次性任务图：节点的前驱全部完成后才提交到线程池，工作线程不为等待依赖而阻塞
+// 用法：add若干节点（依赖只能指向已添加的节点，因而不会成环），run()阻塞到全部节点完成；每个图只run一次
+// 节点内部若要等待其他节点的流式输出（如TTS等大模型的句子），线程池大小需不小于同时在等待的节点数加一
+class TaskGraph {
+public:
+    typedef size_t Node;
+
+    explicit TaskGraph(TaskPool& pool) : pool_(pool), unfinished(0) {}
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    Node add(std::function<void()> fn, std::initializer_list<Node> deps = {}) {
+        const Node id = nodes.size();
+        nodes.emplace_back(new Item(std::move(fn)));
+        for (Node dep : deps) {
+            if (dep >= id) continue;
+            nodes[dep]->next.push_back(id);
+            ++nodes[id]->deps;
+        }
+        return id;
+    }
+
+    void run() {
+        unfinished = nodes.size();
+        for (auto& item : nodes) item->remaining.store(item->deps, std::memory_order_relaxed);
+        for (Node id = 0; id < nodes.size(); ++id) {
+            if (nodes[id]->deps == 0) launch(id);
+        }
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [this] { return unfinished == 0; });
+    }
+
+private:
+    struct Item {
+        std::function<void()> fn;
+        std::vector<Node> next;
+        int deps;
+        std::atomic<int> remaining;
+        explicit Item(std::function<void()> f) : fn(std::move(f)), deps(0), remaining(0) {}
+    };
+
+    TaskPool& pool_;
+    std::vector<std::unique_ptr<Item>> nodes;
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    size_t unfinished;
+
+    void launch(Node id) {
+        pool_.post([this, id] {
+            Item& item = *nodes[id];
+            item.fn();
+            for (Node n : item.next) {
+                // acq_rel：后继节点能看到所有前驱写入的结果
+                if (nodes[n]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) launch(n);
+            }
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (--unfinished == 0) done_cv.notify_all();
+        });
+    }
+};
+
+#endif // TASK_GRAPH_H
@@ -0,0 +1,111 @@
+#ifndef TEXT_SEGMENT_H
+#define TEXT_SEGMENT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// 全文检索用的轻量分词：FTS5自带的unicode61不切分中文，这里把中文连续段切成单字+二元组，
+// 英文/数字按单词切分并转小写，结果以空格连接后交给unicode61建索引
+
+// 解码一个UTF-8字符，返回码点并前移p；非法字节按单字节跳过
+inline uint32_t utf8_next(const std::string& s, size_t& p) {
+    unsigned char c = static_cast<unsigned char>(s[p]);
+    int len = 1;
+    uint32_t cp = c;
+    if (c >= 0xf0) { len = 4; cp = c & 0x07; }
+    else if (c >= 0xe0) { len = 3; cp = c & 0x0f; }
+    else if (c >= 0xc0) { len = 2; cp = c & 0x1f; }
+    if (p + len > s.size()) len = 1;
+    for (int i = 1; i < len; ++i) {
+        unsigned char cc = static_cast<unsigned char>(s[p + i]);
+        if ((cc & 0xc0) != 0x80) { len = 1; cp = c; break; }
+        cp = (cp << 6) | (cc & 0x3f);
+    }
+    p += len;
+    return cp;
+}
+
+inline bool is_cjk(uint32_t cp) {
+    return (cp >= 0x3400 && cp <= 0x9fff) || (cp >= 0xf900 && cp <= 0xfaff) ||
+           (cp >= 0x3040 && cp <= 0x30ff) || (cp >= 0x20000 && cp <= 0x2ffff);
+}
+
+inline bool is_word_char(uint32_t cp) {
+    return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+}
+
+// 切分为检索词：中文按"二元组、单字"的顺序输出
+inline void segment_terms(const std::string& text, std::vector<std::string>& terms) {
+    std::string word;
+    size_t prev_start = std::string::npos;  // 上一个中文字符的起始字节
+    size_t p = 0;
+    while (p < text.size()) {
+        size_t start = p;
+        uint32_t cp = utf8_next(text, p);
+        if (is_cjk(cp)) {
+            if (!word.empty()) { terms.push_back(word); word.clear(); }
+            if (prev_start != std::string::npos) {
+                terms.push_back(text.substr(prev_start, p - prev_start));  // 二元组
+            }
+            terms.push_back(text.substr(start, p - start));
+            prev_start = start;
+        } else {
+            prev_start = std::string::npos;
+            if (is_word_char(cp)) {
+                word.push_back(static_cast<char>(cp >= 'A' && cp <= 'Z' ? cp + 32 : cp));
+            } else if (!word.empty()) {
+                terms.push_back(word);
+                word.clear();
+            }
+        }
+    }
+    if (!word.empty()) terms.push_back(word);
+}
+
+// 生成写入FTS的文本（空格分隔的检索词）
+inline std::string segment_for_index(const std::string& text) {
+    std::vector<std::string> terms;
+    segment_terms(text, terms);
+    std::string out;
+    for (const std::string& t : terms) {
+        if (!out.empty()) out.push_back(' ');
+        out += t;
+    }
+    return out;
+}
+
+// 生成查询词：中文优先用二元组，只有单个汉字的片段才退化为单字
+inline std::vector<std::string> segment_for_query(const std::string& text) {
+    std::vector<std::string> terms;
+    segment_terms(text, terms);
+    std::vector<std::string> result;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        const std::string& t = terms[i];
+        size_t q = 0;
+        bool single_cjk = !t.empty() && is_cjk(utf8_next(t, q)) && q == t.size();
+        if (single_cjk) {
+            // 单字仅在前后都不构成二元组时保留
+            bool prev_bigram = i > 0 && terms[i - 1].size() > t.size() && terms[i - 1].find(t) != std::string::npos;
+            bool next_bigram = i + 1 < terms.size() && terms[i + 1].size() > t.size() &&
+                               terms[i + 1].compare(0, t.size(), t) == 0;
+            if (prev_bigram || next_bigram) continue;
+        }
+        result.push_back(t);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// UTF-8字符数（用于上下文字数预算）
+inline size_t utf8_length(const std::string& s) {
+    size_t n = 0;
+    for (unsigned char c : s) {
+        if ((c & 0xc0) != 0x80) ++n;
+    }
+    return n;
+}
+
+#endif // TEXT_SEGMENT_H
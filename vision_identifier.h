@@ -0,0 +1,49 @@
+#ifndef VISION_IDENTIFIER_H
+#define VISION_IDENTIFIER_H
+
+#include <future>
+#include <string>
+
+#include "interaction_pipeline.h"
+#include "memory_db.h"
+#include "vision_module.h"
+
+// InteractionPipeline的视觉一侧：取最新一帧提特征查UID，同一帧拍照（与特征对应同一画面）
+// 拍照只把像素入队，编码和写盘由VisionModule的后台存图线程完成；
+// dedup为true时先按画面指纹查同一用户的相似旧照片，找到则直接复用其路径
+class VisionUserIdentifier : public UserIdentifier {
+public:
+    VisionUserIdentifier(VisionModule& vision, MemoryDB& db, bool capture = true, bool dedup = true)
+        : vision_(vision), db_(db), capture_(capture), dedup_(dedup) {}
+
+    bool identify(IdentifiedUser& user) override {
+        user = IdentifiedUser();
+        FrameRing::Ref frame = vision_.acquireFrame();
+        if (!frame) return false;
+        FaceDescriptor descriptor;
+        if (!vision_.getFaceDescriptor(*frame, descriptor)) return false;
+        user.uid = db_.getUserUID(descriptor);
+        if (user.uid.empty()) return false;
+        if (!capture_) return true;
+
+        std::string reused;
+        if (dedup_ && vision_.imageHash(*frame, user.image_hash) &&
+            db_.findDuplicateImage(user.uid, user.image_hash, reused)) {
+            std::promise<std::string> ready;
+            ready.set_value(reused);
+            user.image = ready.get_future().share();
+            user.image_reused = true;
+        } else {
+            user.image = vision_.captureImageAsync(*frame).share();
+        }
+        return true;
+    }
+
+private:
+    VisionModule& vision_;
+    MemoryDB& db_;
+    bool capture_;
+    bool dedup_;
+};
+
+#endif // VISION_IDENTIFIER_H
@@ -1,17 +1,21 @@
 #include "vision_module.h"
+#include "face_gallery.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 
 // 构造函数（修正保存路径为当前用户目录）
 VisionModule::VisionModule(int cam_id, const std::string& save_path) 
-    : camera_id(cam_id), save_path(save_path), 
-      face_detector(dlib::get_frontal_face_detector()) {
-    cap.open(camera_id);
-    if (!cap.isOpened()) {
+    : source(open_camera_source(cam_id, 640, 480)), camera_id(cam_id), save_path(save_path), image_writer(save_path),
+      face_detector(dlib::get_frontal_face_detector()), landmark_mode(LandmarkMode::Points68), frames(4),
+      capture_stop(false),
+      tracking_enabled(false), track_active(false), frames_since_detect(0), tracking_stats(), watch_stats(),
+      detect_stats(), part_remaining(0) {
+    if (!source->isOpened()) {
         std::cerr << "摄像头打开失败！请检查ID：" << camera_id << std::endl;
         return;
     }
-
-    cap.set(cv::CAP_PROP_FRAME_WIDTH, 640);
-    cap.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
+    std::cout << "摄像头已打开：" << source->name() << std::endl;
 
     // 确保保存目录存在
     struct stat st;
@@ -20,116 +24,1149 @@ VisionModule::VisionModule(int cam_id, const std::string& save_path)
     }
 }
 
-VisionModule::~VisionModule() {
-    if (cap.isOpened()) {
-        cap.release();
+VisionModule::VisionModule(std::unique_ptr<FrameSource> frame_source, const std::string& save_path)
+    : source(std::move(frame_source)), camera_id(-1), save_path(save_path), image_writer(save_path),
+      face_detector(dlib::get_frontal_face_detector()), landmark_mode(LandmarkMode::Points68), frames(4),
+      capture_stop(false),
+      tracking_enabled(false), track_active(false), frames_since_detect(0), tracking_stats(), watch_stats(),
+      detect_stats(), part_remaining(0) {
+    if (source && !source->isOpened()) {
+        std::cerr << "画面来源打开失败：" << source->name() << std::endl;
+    }
+
+    struct stat st;
+    if (stat(save_path.c_str(), &st) != 0) {
+        mkdir(save_path.c_str(), 0777);
     }
 }
 
-// 初始化（修正模型路径为当前用户目录）
+VisionModule::~VisionModule() {
+    stop_capture();
+    source.reset();
+    image_writer.shutdown();  // 已拍的照片写完再退出
+}
+
+void VisionModule::setLandmarkMode(LandmarkMode mode, const std::string& model_path) {
+    landmark_mode = mode;
+    landmark_path = model_path;
+}
+
+// 初始化：加载关键点和识别模型（路径见VisionModelPaths），.mrm文件只做映射
 bool VisionModule::init() {
-    // 请替换为你的模型实际路径！
-    std::string landmark_model = "/home/addshark/shape_predictor_68_face_landmarks.dat";
-    std::string rec_model = "/home/addshark/dlib_face_recognition_resnet_model_v1.dat";
+    std::string landmark_model = landmark_path;
+    if (landmark_model.empty()) {
+        landmark_model = landmark_mode == LandmarkMode::Points5 ? model_paths.landmarks5 : model_paths.landmarks68;
+    }
+    const std::string& rec_model = model_paths.recognition;
 
-    try {
-        dlib::deserialize(landmark_model) >> shape_predictor;
-        dlib::deserialize(rec_model) >> face_rec_model;
-    } catch (std::exception& e) {
-        std::cerr << "模型加载失败：" << e.what() << std::endl;
-        std::cerr << "请检查模型文件路径！" << std::endl;
+    auto t0 = std::chrono::steady_clock::now();
+    mapped_landmarks = MappedShapePredictor();
+    unsigned long parts = 0;
+    if (model_file::is_model_file(landmark_model)) {
+        if (!mapped_landmarks.load(landmark_model)) {
+            std::cerr << "关键点模型加载失败（.mrm文件无效）：" << landmark_model << std::endl;
+            return false;
+        }
+        parts = mapped_landmarks.numParts();
+    } else {
+        try {
+            dlib::deserialize(landmark_model) >> shape_predictor;
+        } catch (std::exception& e) {
+            std::cerr << "模型加载失败：" << e.what() << std::endl;
+            std::cerr << "请检查模型文件路径！" << std::endl;
+            return false;
+        }
+        parts = shape_predictor.num_parts();
+    }
+    if (model_file::is_model_file(rec_model)) {
+        if (!face_rec_model.load_mapped(rec_model)) {
+            std::cerr << "识别模型加载失败（.mrm文件无效）：" << rec_model << std::endl;
+            return false;
+        }
+    } else {
+        try {
+            dlib::deserialize(rec_model) >> face_rec_model;
+        } catch (std::exception& e) {
+            std::cerr << "模型加载失败：" << e.what() << std::endl;
+            std::cerr << "请检查模型文件路径！" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "模型加载耗时 "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()
+              << " ms" << std::endl;
+
+    unsigned long expected = landmark_mode == LandmarkMode::Points5 ? 5 : 68;
+    if (parts != expected) {
+        std::cerr << "关键点模型与所选模式不符：" << landmark_model << "为" << parts
+                  << "点模型，应为" << expected << "点" << std::endl;
         return false;
     }
 
+    arena.reserve(kArenaFaces, parts);
+
+    // 模型就绪后启动采集线程
+    if (source && source->isOpened() && !capture_thread.joinable()) {
+        capture_stop = false;
+        capture_thread = std::thread(&VisionModule::capture_loop, this);
+    }
     return true;
 }
 
-// 拍摄图片
-std::string VisionModule::captureImage() {
-    if (!cap.isOpened()) {
-        std::cerr << "摄像头未打开！" << std::endl;
-        return "";
+bool VisionModule::enableQuantizedInference(const std::string& calib_path) {
+    if (!face_rec_model.enable_quantized_backend(calib_path)) {
+        std::cerr << "int8推理后端启用失败（模型未加载或校准文件无效）：" << calib_path << std::endl;
+        return false;
     }
+    return true;
+}
 
-    cv::Mat frame;
-    cap >> frame;
-    cap >> frame; // 连续读2帧避免模糊
-    if (frame.empty()) {
-        std::cerr << "摄像头读取画面失败！" << std::endl;
-        return "";
+// 采集线程：画面直接读入帧环的空闲槽位（V4L2下槽位直接引用驱动缓冲）
+void VisionModule::capture_loop() {
+    while (!capture_stop.load()) {
+        Frame* slot = frames.beginWrite();
+        if (!slot) {
+            // 所有槽位都被消费者持有，稍后重试（驱动缓冲满时由驱动丢帧）
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        bool ok;
+        {
+            METRIC_TIME(CameraGrab);
+            ok = source->read(*slot);
+        }
+        if (!ok) {
+            if (source->finished()) break;  // 回放结束
+            std::cerr << "摄像头读取画面失败！" << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        frames.commitWrite(now_us);
+        METRIC_COUNT(FramesCaptured, 1);
     }
+}
+
+void VisionModule::stop_capture() {
+    if (!capture_thread.joinable()) return;
+    capture_stop = true;
+    capture_thread.join();
+}
 
-    // 生成唯一文件名
-    time_t now = time(nullptr);
-    std::string img_name = "img_" + std::to_string(now) + ".jpg";
-    std::string img_path = save_path + "/" + img_name;
+FrameRing::Ref VisionModule::acquireFrame(uint64_t frame_id, int timeout_ms) {
+    if (!capture_thread.joinable()) {
+        std::cerr << "摄像头采集未启动！" << std::endl;
+        return FrameRing::Ref();
+    }
+    FrameRing::Ref frame = frame_id ? frames.get(frame_id) : frames.latest(0, timeout_ms);
+    if (!frame) {
+        std::cerr << "未取到画面！" << std::endl;
+    }
+    return frame;
+}
 
-    if (!cv::imwrite(img_path, frame)) {
-        std::cerr << "图片保存失败！路径：" << img_path << std::endl;
-        return "";
+// 拍摄图片：交给后台存图线程（颜色转换、JPEG编码、写盘都不在调用线程上）
+std::future<std::string> VisionModule::captureImageAsync() {
+    FrameRing::Ref frame = acquireFrame();
+    if (!frame) {
+        std::promise<std::string> failed;
+        failed.set_value("");
+        return failed.get_future();
     }
-    std::cout << "图片保存路径：" << img_path << std::endl;
+    return captureImageAsync(*frame);
+}
 
+std::future<std::string> VisionModule::captureImageAsync(const Frame& frame) {
+    return image_writer.submit(frame);  // 入队时已拷贝像素，返回后帧可以释放
+}
+
+std::string VisionModule::captureImage() {
+    FrameRing::Ref frame = acquireFrame();
+    if (!frame) return "";
+    return captureImage(*frame);
+}
+
+std::string VisionModule::captureImage(const Frame& frame) {
+    std::string img_path = captureImageAsync(frame).get();
+    if (!img_path.empty()) std::cout << "图片保存路径：" << img_path << std::endl;
     return img_path;
 }
 
-// 提取人脸特征（参数类型已匹配，无需修改）
-std::string VisionModule::getFaceFeature() {
-    if (!cap.isOpened()) {
-        std::cerr << "摄像头未打开！" << std::endl;
-        return "unknown_face";
+bool VisionModule::imageHash(const Frame& frame, uint64_t& hash) {
+    cv::Mat gray;
+    if (frame.format == PixelFormat::MJPEG) {
+        if (!frame.raw.empty()) gray = cv::imdecode(frame.raw, cv::IMREAD_REDUCED_GRAYSCALE_4);
+    } else {
+        frame_to_gray(frame, gray);
+    }
+    if (gray.empty()) return false;
+    hash = dhash64(gray.ptr<uint8_t>(), gray.cols, gray.rows, gray.step);
+    return true;
+}
+
+// 提取人脸特征（定长float数组，无字符串格式化）
+bool VisionModule::getFaceDescriptor(FaceDescriptor& descriptor) {
+    FrameRing::Ref frame = acquireFrame();
+    if (!frame) return false;
+    if (tracking_enabled) {
+        TrackedFace face;
+        if (!trackFace(*frame, face)) return false;
+        descriptor = face.descriptor;
+        return true;
     }
+    return getFaceDescriptor(*frame, descriptor);
+}
 
-    cv::Mat frame;
-    cap >> frame;
-    cap >> frame;
-    if (frame.empty()) {
-        std::cerr << "摄像头读取画面失败！" << std::endl;
-        return "unknown_face";
+namespace {
+
+// .mrm关键点模型：像素灰度和关键点取整与dlib::shape_predictor一致；结果原地写入，工作缓冲取自arena
+struct mapped_landmarks_ref {
+    const MappedShapePredictor& predictor;
+    FrameArena& arena;
+
+    template <typename image_type>
+    void operator()(const image_type& img, const dlib::rectangle& rect, dlib::full_object_detection& shape) const {
+        dlib::const_image_view<image_type> view(img);
+        std::vector<float>& coords = arena.landmark_coords;
+        predictor.predict(view.nc(), view.nr(),
+                          [&view](long x, long y) { return static_cast<float>(dlib::get_pixel_intensity(view[y][x])); },
+                          rect.left(), rect.top(), rect.right(), rect.bottom(), coords, arena.landmark_scratch);
+        FrameArena::assign_shape(shape, rect, predictor.numParts());
+        for (unsigned long i = 0; i < shape.num_parts(); ++i) {
+            shape.part(i) = dlib::point(dlib::dpoint(coords[2 * i], coords[2 * i + 1]));
+        }
     }
+};
+
+// .dat关键点模型：dlib只提供按值返回的接口，每张脸一次分配
+struct dlib_landmarks_ref {
+    const dlib::shape_predictor& predictor;
+
+    template <typename image_type>
+    void operator()(const image_type& img, const dlib::rectangle& rect, dlib::full_object_detection& shape) const {
+        shape = predictor(img, rect);
+    }
+};
+
+// 检测人脸（need_detect时整图检测，否则用arena.rects中已有的框）并在原图上定位关键点，写入arena.shapes
+// （first_only时只取第一张）；predictor为dlib_landmarks_ref或mapped_landmarks_ref
+template <typename image_type, typename predictor_type>
+void detect_shapes(const image_type& img, dlib::frontal_face_detector& detector, bool need_detect,
+                   const predictor_type& predictor, bool first_only, FrameArena& arena) {
+    std::vector<dlib::rectangle>& faces = arena.rects;
+    if (need_detect) {
+        METRIC_TIME(FaceDetect);
+        faces = detector(img);
+    }
+    METRIC_COUNT(FacesDetected, faces.size());
+    if (first_only && faces.size() > 1) faces.resize(1);
+    arena.fit(arena.shapes, faces.size());
+    METRIC_TIME(ShapePredict);
+    for (size_t i = 0; i < faces.size(); ++i) {
+        predictor(img, faces[i], arena.shapes[i]);
+    }
+}
+
+// 检测器copy一份并限制金字塔层数（并行检测时每段一个）
+dlib::frontal_face_detector limit_pyramid_levels(const dlib::frontal_face_detector& base, unsigned long levels) {
+    dlib::frontal_face_detector::image_scanner_type scanner = base.get_scanner();
+    scanner.set_max_pyramid_levels(levels);
+    std::vector<dlib::frontal_face_detector::feature_vector_type> w;
+    for (unsigned long i = 0; i < base.num_detectors(); ++i) w.push_back(base.get_w(i));
+    return dlib::frontal_face_detector(scanner, base.get_overlap_tester(), w);
+}
+
+const double kPyramidRatio = 5.0 / 6.0;  // frontal_face_detector使用pyramid_down<6>
+const int kDetectWindow = 80;           // HOG检测窗口边长
+
+// 相关滤波跟踪器的输入：BGR帧直接包装，其余格式取亮度（写入复用的gray）
+template <typename Fn>
+bool with_tracking_image(const Frame& frame, cv::Mat& gray, Fn fn) {
+    if (frame.format == PixelFormat::BGR) {
+        if (frame.image.empty()) return false;
+        fn(dlib::cv_image<dlib::bgr_pixel>(frame.image));
+        return true;
+    }
+    if (!frame_to_gray(frame, gray)) return false;
+    fn(dlib::cv_image<unsigned char>(gray));
+    return true;
+}
+
+cv::Rect to_cv_rect(const dlib::rectangle& r) {
+    return cv::Rect(r.left(), r.top(), r.width(), r.height());
+}
 
-    // cv_image转换（现在参数类型匹配）
-    dlib::cv_image<dlib::bgr_pixel> dlib_frame(frame);
-    std::vector<dlib::rectangle> faces = face_detector(dlib_frame);
-    if (faces.empty()) {
+cv::Rect to_cv_rect(const dlib::drectangle& r) {
+    return cv::Rect(cv::Point(cvRound(r.left()), cvRound(r.top())),
+                    cv::Point(cvRound(r.right()) + 1, cvRound(r.bottom()) + 1));
+}
+
+// 对齐人脸块在原图中覆盖的区域：旋转矩形的外接框，四周留2像素插值余量
+cv::Rect chip_source_region(const dlib::full_object_detection& shape) {
+    dlib::chip_details chip = dlib::get_face_chip_details(shape, 150, 0.25);
+    dlib::dpoint c = dlib::center(chip.rect);
+    double hw = chip.rect.width() / 2.0, hh = chip.rect.height() / 2.0;
+    double cs = std::abs(std::cos(chip.angle)), sn = std::abs(std::sin(chip.angle));
+    double ex = hw * cs + hh * sn, ey = hw * sn + hh * cs;
+    int x0 = static_cast<int>(std::floor(c.x() - ex)) - 2;
+    int y0 = static_cast<int>(std::floor(c.y() - ey)) - 2;
+    int x1 = static_cast<int>(std::ceil(c.x() + ex)) + 2;
+    int y1 = static_cast<int>(std::ceil(c.y() + ey)) + 2;
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+// 关键点平移到子图坐标系（原地写入out，点数不变时不分配）
+void translate_shape(const dlib::full_object_detection& shape, long dx, long dy, dlib::full_object_detection& out) {
+    FrameArena::assign_shape(out, dlib::translate_rect(shape.get_rect(), -dx, -dy), shape.num_parts());
+    for (unsigned long i = 0; i < shape.num_parts(); ++i) {
+        out.part(i) = shape.part(i) - dlib::point(dx, dy);
+    }
+}
+
+} // namespace
+
+// ---- 加速检测 ----
+
+void VisionModule::setDetectOptions(const FaceDetectOptions& options) {
+    detect_options = options;
+    part_detectors.clear();
+    part_levels.clear();
+    part_found.clear();
+    part_images.clear();
+    part_start.clear();
+    part_size = cv::Size();
+    last_face_box = cv::Rect();
+    // 线程在设置时建好，逐帧只投递任务，不再每帧创建/回收线程
+    if (options.parallel_levels > 1) {
+        if (!level_pool || static_cast<int>(level_pool->size()) != options.parallel_levels - 1) {
+            level_pool.reset(new TaskPool(options.parallel_levels - 1));
+        }
+    } else {
+        level_pool.reset();
+    }
+}
+
+bool VisionModule::fast_detect() const {
+    return detect_options.downscale > 1.0 || detect_options.min_face_size > kDetectWindow ||
+           detect_options.use_roi || detect_options.parallel_levels > 1;
+}
+
+// 提示区域（上次人脸 ∪ 运动区域）外扩后检测，区域内无人脸时按设置回退整帧
+void VisionModule::detect_rects(const Frame& frame, const cv::Mat& full_gray, std::vector<dlib::rectangle>& rects) {
+    METRIC_TIME(FaceDetect);
+    auto t0 = std::chrono::steady_clock::now();
+    cv::Size size = full_gray.empty() ? frame_size(frame) : full_gray.size();
+    const cv::Rect whole(0, 0, size.width, size.height);
+    cv::Rect roi = whole;
+    if (detect_options.use_roi) {
+        cv::Rect hint = last_face_box.area() > 0 ? last_face_box : motion_roi;
+        if (last_face_box.area() > 0 && motion_roi.area() > 0) hint |= motion_roi;
+        if (hint.area() > 0) {
+            int mx = static_cast<int>(hint.width * detect_options.roi_margin);
+            int my = static_cast<int>(hint.height * detect_options.roi_margin);
+            roi = cv::Rect(hint.x - mx, hint.y - my, hint.width + 2 * mx, hint.height + 2 * my) & whole;
+            if (roi.area() <= 0) roi = whole;
+        }
+    }
+
+    detect_region(frame, full_gray, roi, rects);
+    if (roi != whole) {
+        ++detect_stats.roi_runs;
+        if (rects.empty() && detect_options.roi_fallback) {
+            ++detect_stats.fallbacks;
+            detect_region(frame, full_gray, whole, rects);
+        }
+    }
+    ++detect_stats.runs;
+    detect_stats.total_ms +=
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// 在roi内检测：只把roi转成灰度，按downscale/min_face_size缩小后送检测器，结果换算回原图坐标
+void VisionModule::detect_region(const Frame& frame, const cv::Mat& full_gray, const cv::Rect& roi,
+                                 std::vector<dlib::rectangle>& rects) {
+    rects.clear();
+    // ROI逐帧变化：灰度和缩小图都写在容量复用的缓冲的左上角（buffer_view），不随尺寸重新分配
+    cv::Mat region;
+    if (full_gray.empty()) {
+        region = buffer_view(detect_gray, roi.size(), CV_8UC1);
+        cv::cvtColor(frame.image(roi), region, cv::COLOR_BGR2GRAY);
+    } else {
+        region = full_gray(roi);
+    }
+
+    double scale = 1.0 / std::max(1.0, detect_options.downscale);
+    if (detect_options.min_face_size > kDetectWindow) {
+        scale = std::min(scale, static_cast<double>(kDetectWindow) / detect_options.min_face_size);
+    }
+    if (scale < 1.0) {
+        // 输出尺寸按cv::resize由fx/fy推算的规则预先取好，resize见尺寸一致就直接写入，采样与原先相同
+        cv::Mat small = buffer_view(detect_small, cv::Size(cvRound(region.cols * scale), cvRound(region.rows * scale)),
+                                    CV_8UC1);
+        cv::resize(region, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        region = small;
+    }
+    // 缩小后的图比检测窗口还小时无法检测
+    if (region.cols < kDetectWindow || region.rows < kDetectWindow) return;
+
+    std::vector<dlib::rectangle>& found = arena.found;
+    detect_pyramid(region, found);
+    for (const dlib::rectangle& r : found) {
+        rects.push_back(dlib::rectangle(static_cast<long>(r.left() / scale) + roi.x,
+                                        static_cast<long>(r.top() / scale) + roi.y,
+                                        static_cast<long>((r.right() + 1) / scale) - 1 + roi.x,
+                                        static_cast<long>((r.bottom() + 1) / scale) - 1 + roi.y));
+    }
+}
+
+// 金字塔检测；parallel_levels > 1时按每层面积（逐层乘(5/6)^2）把金字塔切成面积相近的几段，
+// 每段在预先缩小到起始层的图上只扫描本段的层数，各线程用各自的检测器，结果按置信度合并去重
+// 第0段在调用线程上跑，其余段投递到level_pool的常驻线程
+// 检测结果、各段的缩小图和合并缓冲都逐帧复用；检测图尺寸变化（ROI）时只重建层数变了的那几段检测器
+void VisionModule::detect_pyramid(const cv::Mat& gray, std::vector<dlib::rectangle>& rects) {
+    const int parts = detect_options.parallel_levels;
+    std::vector<dlib::rect_detection>& detections = arena.detections;
+    if (parts <= 1 || !level_pool) {
+        detections.clear();
+        face_detector(dlib::cv_image<unsigned char>(gray), detections);
+        rects.clear();
+        for (const dlib::rect_detection& d : detections) rects.push_back(d.rect);
+        return;
+    }
+
+    if (gray.size() != part_size) {
+        // 按dlib的规则计算层数：层的宽高都不小于最小层尺寸
+        const dlib::frontal_face_detector::image_scanner_type& scanner = face_detector.get_scanner();
+        std::vector<double>& area = part_area;
+        area.clear();
+        double w = gray.cols, h = gray.rows;
+        while (w >= scanner.get_min_pyramid_layer_width() && h >= scanner.get_min_pyramid_layer_height() &&
+               area.size() < scanner.get_max_pyramid_levels()) {
+            area.push_back(w * h);
+            w = std::floor(w * kPyramidRatio);
+            h = std::floor(h * kPyramidRatio);
+        }
+        double total = 0.0;
+        for (double a : area) total += a;
+
+        part_start.clear();
+        double acc = 0.0;
+        for (size_t level = 0; level < area.size(); ++level) {
+            if (part_start.empty() || (acc >= total * part_start.size() / parts &&
+                                       static_cast<int>(part_start.size()) < parts)) {
+                part_start.push_back(static_cast<int>(level));
+            }
+            acc += area[level];
+        }
+        if (part_detectors.size() < part_start.size()) {
+            part_detectors.resize(part_start.size());
+            part_levels.resize(part_start.size(), 0);
+            part_found.resize(part_start.size());
+            part_images.resize(part_start.size());
+        }
+        for (size_t j = 0; j < part_start.size(); ++j) {
+            int end = j + 1 < part_start.size() ? part_start[j + 1] : static_cast<int>(area.size());
+            if (part_levels[j] != end - part_start[j]) {
+                part_levels[j] = end - part_start[j];
+                part_detectors[j] = limit_pyramid_levels(face_detector, part_levels[j]);
+            }
+        }
+        part_size = gray.size();
+    }
+
+    const size_t n = part_start.size();
+    part_gray = gray;
+    {
+        std::lock_guard<std::mutex> lock(part_mutex);
+        part_remaining = n > 0 ? n - 1 : 0;
+    }
+    // 任务只捕获this和段号（两个指针大小），std::function可内联存放，投递时不为任务对象分配
+    for (size_t j = 1; j < n; ++j) {
+        level_pool->post([this, j] {
+            detect_part(j);
+            std::lock_guard<std::mutex> lock(part_mutex);
+            if (--part_remaining == 0) part_cv.notify_one();
+        });
+    }
+    if (n > 0) detect_part(0);
+    {
+        std::unique_lock<std::mutex> lock(part_mutex);
+        part_cv.wait(lock, [this] { return part_remaining == 0; });
+    }
+    part_gray.release();
+
+    // 段与段交界处同一张脸可能被检出两次，按置信度从高到低去重
+    detections.clear();
+    for (size_t j = 0; j < n; ++j) detections.insert(detections.end(), part_found[j].begin(), part_found[j].end());
+    std::sort(detections.begin(), detections.end(), [](const dlib::rect_detection& a, const dlib::rect_detection& b) {
+        return a.detection_confidence > b.detection_confidence;
+    });
+    const dlib::test_box_overlap& overlaps = face_detector.get_overlap_tester();
+    rects.clear();
+    for (const dlib::rect_detection& d : detections) {
+        bool duplicate = false;
+        for (const dlib::rectangle& kept : rects) {
+            if (overlaps(kept, d.rect)) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate) rects.push_back(d.rect);
+    }
+}
+
+// 金字塔的第j段：缩小到起始层（写入该段复用的缓冲）后检测，结果换算回part_gray坐标
+void VisionModule::detect_part(size_t j) {
+    const double scale = std::pow(kPyramidRatio, part_start[j]);
+    cv::Mat img = part_gray;
+    if (part_start[j] > 0) {
+        // 输出尺寸按cv::resize由fx/fy推算的规则预先取好，resize见尺寸一致就直接写入缓冲
+        img = buffer_view(part_images[j], cv::Size(cvRound(part_gray.cols * scale), cvRound(part_gray.rows * scale)),
+                          CV_8UC1);
+        cv::resize(part_gray, img, cv::Size(), scale, scale, cv::INTER_AREA);
+    }
+    std::vector<dlib::rect_detection>& found = part_found[j];
+    found.clear();
+    part_detectors[j](dlib::cv_image<unsigned char>(img), found);
+    for (dlib::rect_detection& d : found) {
+        d.rect = dlib::rectangle(static_cast<long>(d.rect.left() / scale), static_cast<long>(d.rect.top() / scale),
+                                 static_cast<long>((d.rect.right() + 1) / scale) - 1,
+                                 static_cast<long>((d.rect.bottom() + 1) / scale) - 1);
+    }
+}
+
+// 检测和关键点：BGR帧直接包装OpenCV缓冲；YUYV/MJPEG帧只取亮度，不做整帧颜色转换
+// 开启加速检测时检测在缩小/裁剪后的灰度图上进行，关键点仍在原图上定位
+// 结果在arena.shapes中，检测框、灰度等中间结果也都用arena的缓冲
+bool VisionModule::detect_faces(const Frame& frame, bool first_only) {
+    std::vector<dlib::full_object_detection>& shapes = arena.shapes;
+    arena.fit(shapes, 0);
+    const bool fast = fast_detect();
+    std::vector<dlib::rectangle>& rects = arena.rects;
+    rects.clear();
+    auto locate = [&](const auto& img) {
+        if (mapped_landmarks.isLoaded()) {
+            detect_shapes(img, face_detector, !fast, mapped_landmarks_ref{mapped_landmarks, arena}, first_only, arena);
+        } else {
+            detect_shapes(img, face_detector, !fast, dlib_landmarks_ref{shape_predictor}, first_only, arena);
+        }
+    };
+    if (frame.format == PixelFormat::BGR) {
+        if (frame.image.empty()) {
+            std::cerr << "画面为空，无法提取特征！" << std::endl;
+            return false;
+        }
+        if (fast) detect_rects(frame, cv::Mat(), rects);
+        locate(dlib::cv_image<dlib::bgr_pixel>(frame.image));
+    } else {
+        cv::Mat& gray = arena.gray;
+        if (!frame_to_gray(frame, gray)) {
+            std::cerr << "画面为空，无法提取特征！" << std::endl;
+            return false;
+        }
+        if (fast) detect_rects(frame, gray, rects);
+        locate(dlib::cv_image<unsigned char>(gray));
+    }
+
+    last_face_box = cv::Rect();
+    for (const auto& shape : shapes) {
+        cv::Rect box = to_cv_rect(shape.get_rect());
+        last_face_box = last_face_box.area() > 0 ? (last_face_box | box) : box;
+    }
+    if (shapes.empty()) {
         std::cerr << "未检测到人脸！" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 所有人脸一次批量计算特征：只把人脸块覆盖的区域（多张脸取外接框）转为彩色；特征写入arena.descriptors
+bool VisionModule::describe_faces(const Frame& frame, const std::vector<dlib::full_object_detection>& shapes) {
+    std::vector<dlib::matrix<float, 0, 1>>& descriptors = arena.descriptors;
+    cv::Rect bounds;
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        bounds = (i == 0) ? chip_source_region(shapes[i]) : (bounds | chip_source_region(shapes[i]));
+    }
+    cv::Mat region;  // BGR帧为原缓冲上的子矩阵，其余格式指向arena.region
+    cv::Point offset;
+    if (!frame_region_bgr(frame, bounds, region, offset, &arena.region)) {
+        std::cerr << "人脸区域超出画面！" << std::endl;
+        return false;
+    }
+
+    std::vector<dlib::full_object_detection>& local_shapes = arena.local_shapes;
+    arena.fit(local_shapes, shapes.size());
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        translate_shape(shapes[i], offset.x, offset.y, local_shapes[i]);
+    }
+    arena.fit(descriptors, shapes.size());
+    dlib::cv_image<dlib::bgr_pixel> dlib_region(region);
+    {
+        METRIC_TIME(FaceDescriptor);
+        face_rec_model.compute_face_descriptors(dlib_region, local_shapes, descriptors, 1);
+    }
+    METRIC_COUNT(DescriptorsComputed, descriptors.size());
+    if (descriptors.size() != shapes.size()) {
+        std::cerr << "人脸对齐失败：不支持的关键点数" << shapes[0].num_parts() << std::endl;
+        return false;
+    }
+    for (const auto& d : descriptors) {
+        if (d.size() != kFaceDescriptorDim) {
+            std::cerr << "人脸特征维度异常：" << d.size() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VisionModule::getFaceDescriptor(const Frame& frame, FaceDescriptor& descriptor) {
+    FrameArena::FrameScope scope(arena);
+    if (!detect_faces(frame, true) || !describe_faces(frame, arena.shapes)) {
+        return false;
+    }
+    const dlib::matrix<float, 0, 1>& d = arena.descriptors[0];
+    std::copy(&d(0), &d(0) + kFaceDescriptorDim, descriptor.begin());
+    return true;
+}
+
+// 多人脸：一帧中所有人脸的检测框和特征
+size_t VisionModule::getFaceDescriptors(std::vector<DetectedFace>& faces) {
+    faces.clear();
+    FrameRing::Ref frame = acquireFrame();
+    if (!frame) return 0;
+    return getFaceDescriptors(*frame, faces);
+}
+
+// faces的容量由调用方跨帧复用（DetectedFace是定长的，resize不再分配）
+size_t VisionModule::getFaceDescriptors(const Frame& frame, std::vector<DetectedFace>& faces) {
+    FrameArena::FrameScope scope(arena);
+    faces.clear();
+    const std::vector<dlib::full_object_detection>& shapes = arena.shapes;
+    const std::vector<dlib::matrix<float, 0, 1>>& descriptors = arena.descriptors;
+    if (!detect_faces(frame, false) || !describe_faces(frame, shapes)) {
+        return 0;
+    }
+    faces.resize(shapes.size());
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        const dlib::rectangle& r = shapes[i].get_rect();
+        faces[i].box = cv::Rect(r.left(), r.top(), r.width(), r.height());
+        std::copy(&descriptors[i](0), &descriptors[i](0) + kFaceDescriptorDim, faces[i].descriptor.begin());
+    }
+    return faces.size();
+}
+
+bool VisionModule::checkDescriptorPath(const Frame& frame, float& max_abs_diff) {
+    if (!detect_faces(frame, true) || !describe_faces(frame, arena.shapes)) {
+        return false;
+    }
+    const std::vector<dlib::full_object_detection>& shapes = arena.shapes;
+    const std::vector<dlib::matrix<float, 0, 1>>& fast = arena.descriptors;
+
+    cv::Mat bgr;
+    if (!frame_to_bgr(frame, bgr)) return false;
+    dlib::matrix<dlib::rgb_pixel> full, chip;
+    dlib::assign_image(full, dlib::cv_image<dlib::bgr_pixel>(bgr));
+    dlib::extract_image_chip(full, dlib::get_face_chip_details(shapes[0], 150, 0.25), chip);
+    dlib::matrix<float, 0, 1> reference = face_rec_model.reference_descriptor(chip);
+
+    max_abs_diff = dlib::max(dlib::abs(reference - fast[0]));
+    return true;
+}
+
+// ---- 跟踪模式 ----
+
+void VisionModule::enableTracking(const TrackingOptions& options) {
+    tracking_options = options;
+    tracking_enabled = true;
+    resetTracking();
+}
+
+void VisionModule::disableTracking() {
+    tracking_enabled = false;
+    resetTracking();
+}
+
+void VisionModule::resetTracking() {
+    track_active = false;
+    frames_since_detect = 0;
+    uint64_t track_id = track.track_id;
+    track = TrackedFace();
+    track.track_id = track_id;
+}
+
+void VisionModule::setTrackedUid(const std::string& uid) {
+    if (track_active) track.uid = uid;
+}
+
+bool VisionModule::trackFace(TrackedFace& face) {
+    FrameRing::Ref frame = acquireFrame();
+    if (!frame) return false;
+    return trackFace(*frame, face);
+}
+
+// 重新检测：优先取与上一跟踪框重叠最多的人脸（没有重叠时取最大的），只对这一张脸提特征
+bool VisionModule::redetect_track(const Frame& frame) {
+    const std::vector<dlib::full_object_detection>& shapes = arena.shapes;
+    if (!detect_faces(frame, false)) {
+        track_active = false;
+        return false;
+    }
+    size_t best = 0;
+    double best_score = -1.0;
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        cv::Rect box = to_cv_rect(shapes[i].get_rect());
+        double overlap = track_active ? (box & track.box).area() : 0.0;
+        double score = overlap > 0 ? 1e12 + overlap : box.area();
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    std::vector<dlib::full_object_detection>& chosen = arena.chosen;
+    arena.fit(chosen, 1);
+    chosen[0] = shapes[best];  // 点数相同，拷贝赋值复用已有存储
+    if (!describe_faces(frame, chosen)) {
+        track_active = false;
+        return false;
+    }
+
+    FaceDescriptor descriptor;
+    const dlib::matrix<float, 0, 1>& d = arena.descriptors[0];
+    std::copy(&d(0), &d(0) + kFaceDescriptorDim, descriptor.begin());
+    const float same = tracking_options.same_person_distance;
+    bool same_person = track_active &&
+        l2_distance_sq(descriptor.data(), track.descriptor.data(), kFaceDescriptorDim) < same * same;
+    if (!same_person) {
+        if (track_active) ++tracking_stats.identity_changes;
+        ++track.track_id;
+        track.uid.clear();
+    }
+
+    const dlib::rectangle& rect = chosen[0].get_rect();
+    if (!with_tracking_image(frame, arena.gray, [&](const auto& img) { tracker.start_track(img, rect); })) {
+        track_active = false;
+        return false;
+    }
+    track.box = to_cv_rect(rect);
+    track.descriptor = descriptor;
+    track.confidence = 0.0;
+    track.refreshed = true;
+    track_active = true;
+    frames_since_detect = 0;
+    ++tracking_stats.detections;
+    return true;
+}
+
+bool VisionModule::trackFace(const Frame& frame, TrackedFace& face) {
+    FrameArena::FrameScope scope(arena);
+    if (track_active && frame.id != 0 && frame.id == track.frame_id) {
+        face = track;  // 同一帧重复查询
+        return true;
+    }
+
+    bool tracked = false;
+    if (track_active && (tracking_options.redetect_interval <= 0 ||
+                         frames_since_detect < tracking_options.redetect_interval)) {
+        double psr = 0.0;
+        if (with_tracking_image(frame, arena.gray, [&](const auto& img) {
+                METRIC_TIME(FaceTrack);
+                psr = tracker.update(img);
+            })) {
+            cv::Rect box = to_cv_rect(tracker.get_position());
+            cv::Size size = frame_size(frame);
+            cv::Rect visible = box & cv::Rect(0, 0, size.width, size.height);
+            // 置信度低或人脸大半移出画面视为跟丢
+            if (psr >= tracking_options.min_confidence && visible.area() * 2 >= box.area()) {
+                track.box = visible;
+                track.confidence = psr;
+                track.refreshed = false;
+                ++frames_since_detect;
+                ++tracking_stats.tracked_frames;
+                tracked = true;
+            } else {
+                ++tracking_stats.losses;
+            }
+        }
+    }
+
+    if (!tracked && !redetect_track(frame)) {
+        resetTracking();
+        return false;
+    }
+    track.frame_id = frame.id;
+    face = track;
+    return true;
+}
+
+// ---- 持续监视 ----
+
+size_t VisionModule::watch(const Frame& frame, std::vector<DetectedFace>& faces) {
+    FrameArena::FrameScope scope(arena);
+    faces.clear();
+    if (!motion_gate.update(frame)) {
+        METRIC_COUNT(FramesGated, 1);
+        return 0;
+    }
+    if (!motion_gate.motionRegion(motion_roi)) motion_roi = cv::Rect();
+
+    ++watch_stats.detector_runs;
+    size_t n = getFaceDescriptors(frame, faces);
+    if (n == 0) ++watch_stats.detector_empty;
+    watch_stats.described_faces += n;
+    motion_gate.notePresence(n > 0);
+    return n;
+}
+
+WatchStats VisionModule::watchStats() const {
+    WatchStats stats = watch_stats;
+    stats.gate = motion_gate.stats();
+    return stats;
+}
+
+// 提取人脸特征并转换为字符串（兼容旧接口）
+std::string VisionModule::getFaceFeature() {
+    FaceDescriptor descriptor;
+    if (!getFaceDescriptor(descriptor)) {
         return "unknown_face";
     }
 
-    dlib::full_object_detection shape = shape_predictor(dlib_frame, faces[0]);
-    // 现在可以直接传入dlib_frame（cv_image类型）
-    dlib::matrix<float, 0, 1> face_descriptor = face_rec_model.compute_face_descriptor(dlib_frame, shape, 1);
-    
-    // 转换为字符串
-    std::ostringstream oss;
-    for (int i = 0; i < face_descriptor.size(); ++i) {
-        if (i > 0) oss << ",";
-        oss << face_descriptor(i);
+    // 与ostream默认格式（%g，6位有效数字）相同，按上限一次预留，不经过ostringstream
+    std::string feature;
+    feature.reserve(kFaceDescriptorDim * 14);
+    char buf[32];
+    for (int i = 0; i < kFaceDescriptorDim; ++i) {
+        int n = std::snprintf(buf, sizeof(buf), i > 0 ? ",%g" : "%g", descriptor[i]);
+        feature.append(buf, n);
     }
-    
-    return oss.str();
+    return feature;
 }
 
-// 测试主函数
-int main() {
-    VisionModule vm(0, "/home/addshark/Desktop/addshark/MemoryRobot/images");
-    if (!vm.init()) {
+// ---- 测试程序（链接到其他程序时定义MEMORYROBOT_NO_TEST_MAIN去掉） ----
+#ifndef MEMORYROBOT_NO_TEST_MAIN
+
+// 测试程序的命令行选项
+struct SmokeOptions {
+    std::string video, images;
+    bool int8 = false;
+    std::string calib;
+    bool track = false, watch = false;
+    bool check_descriptor = false;
+    FaceDetectOptions detect;
+    bool landmarks5 = false;
+    std::string model5;
+    std::string bench68, bench5;
+    VisionModelPaths models;
+    ImageWriterOptions writer;
+    std::string metrics_path;
+    int metrics_interval = 10;
+};
+
+static bool setup_module(VisionModule& vm, const SmokeOptions& opt) {
+    vm.setModelPaths(opt.models);
+    vm.setImageWriterOptions(opt.writer);
+    if (opt.landmarks5) vm.setLandmarkMode(LandmarkMode::Points5, opt.model5);
+    if (!vm.init() || (opt.int8 && !vm.enableQuantizedInference(opt.calib))) {
         std::cerr << "VisionModule初始化失败！" << std::endl;
+        return false;
+    }
+    vm.setDetectOptions(opt.detect);
+    return true;
+}
+
+// 直接采样的人脸块与dlib参考流程的特征最大允许误差（浮点误差；int8后端另有量化误差）
+static float descriptor_tolerance(const SmokeOptions& opt) { return opt.int8 ? 0.05f : 1e-4f; }
+
+// 特征校验：回放来源的每一帧都与dlib参考流程比对，任何一帧超出容差即失败；无摄像头也能跑
+static int run_descriptor_check(std::unique_ptr<FrameSource> replay, const SmokeOptions& opt) {
+    if (!replay->isOpened()) {
+        std::cerr << "回放来源打开失败：" << replay->name() << std::endl;
         return 1;
     }
+    VisionModule vm(std::unique_ptr<FrameSource>(), "/home/addshark/Desktop/addshark/MemoryRobot/images");
+    if (!setup_module(vm, opt)) return 1;
+    const float tolerance = descriptor_tolerance(opt);
 
-    std::string img_path = vm.captureImage();
-    if (img_path.empty()) {
-        std::cerr << "图片拍摄失败！" << std::endl;
+    Frame frame;
+    size_t frames = 0, checked = 0, failed = 0;
+    float worst = 0.0f;
+    while (replay->read(frame)) {
+        frame.id = ++frames;
+        float max_diff = 0.0f;
+        if (!vm.checkDescriptorPath(frame, max_diff)) continue;  // 无人脸的帧不参与校验
+        ++checked;
+        worst = std::max(worst, max_diff);
+        if (max_diff > tolerance) {
+            std::cerr << "特征校验失败：第" << frames << "帧与参考流程最大误差" << max_diff << std::endl;
+            ++failed;
+        }
+    }
+    if (checked == 0) {
+        std::cerr << "特征校验失败：回放中没有可校验的人脸" << std::endl;
+        return 1;
+    }
+    if (failed > 0) return 1;
+    std::cout << "特征校验通过（" << checked << "/" << frames << "帧，与参考流程最大误差" << worst << "，容差"
+              << tolerance << "）" << std::endl;
+    return 0;
+}
+
+// 回放模式：逐帧提取特征，统计吞吐（输入固定，结果可重复，无需摄像头）
+static int run_replay(std::unique_ptr<FrameSource> replay, const SmokeOptions& opt) {
+    if (!replay->isOpened()) {
+        std::cerr << "回放来源打开失败：" << replay->name() << std::endl;
+        return 1;
+    }
+    std::string name = replay->name();
+    VisionModule vm(std::unique_ptr<FrameSource>(), "/home/addshark/Desktop/addshark/MemoryRobot/images");
+    if (!setup_module(vm, opt)) return 1;
+    const bool track = opt.track, watch = opt.watch;
+    if (track) vm.enableTracking();
+
+    Frame frame;
+    std::vector<DetectedFace> detected;
+    TrackedFace tracked;
+    size_t frames = 0, faces = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    while (replay->read(frame)) {
+        frame.id = ++frames;  // 回放帧不经过帧环，按顺序编号
+        if (track) {
+            faces += vm.trackFace(frame, tracked) ? 1 : 0;
+        } else if (watch) {
+            faces += vm.watch(frame, detected);
+        } else {
+            faces += vm.getFaceDescriptors(frame, detected);
+        }
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "回放 " << name << "：" << frames << "帧，" << faces << "张人脸，耗时"
+              << sec << "秒（" << (sec > 0 ? frames / sec : 0.0) << " fps，每张人脸"
+              << (faces > 0 ? sec * 1000.0 / faces : 0.0) << " ms）" << std::endl;
+    DetectStats ds = vm.detectStats();
+    std::cout << "检测：" << ds.runs << " 次，平均 " << (ds.runs > 0 ? ds.total_ms / ds.runs : 0.0)
+              << " ms（ROI内 " << ds.roi_runs << " 次，回退整帧 " << ds.fallbacks << " 次）" << std::endl;
+    if (track) {
+        TrackingStats st = vm.trackingStats();
+        std::cout << "跟踪：完整检测 " << st.detections << " 次，仅跟踪 " << st.tracked_frames << " 帧，跟丢 "
+                  << st.losses << " 次，换人 " << st.identity_changes << " 次" << std::endl;
+    }
+    if (watch) {
+        WatchStats st = vm.watchStats();
+        std::cout << "监视：门控放行 " << st.gate.passed << " 帧、跳过 " << st.gate.skipped << " 帧（触发 "
+                  << st.gate.triggers << " 次），检测器运行 " << st.detector_runs << " 帧、其中无人脸 "
+                  << st.detector_empty << " 帧，提取特征 " << st.described_faces << " 张" << std::endl;
+    }
+    return 0;
+}
+
+// 关键点模型对比：同一批检测框分别用68点和5点模型对齐，比较加载耗时、定位耗时，
+// 以及两种对齐得到的特征之间的距离（距离越小，换用5点模型对识别结果的影响越小）
+static int run_landmark_bench(std::unique_ptr<FrameSource> replay, const std::string& model68,
+                              const std::string& model5, const std::string& rec_model) {
+    if (!replay->isOpened()) {
+        std::cerr << "回放来源打开失败：" << replay->name() << std::endl;
+        return 1;
+    }
+    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+    dlib::shape_predictor sp68, sp5;
+    dlib::face_recognition_model_v1 rec;
+    double load68_ms = 0.0, load5_ms = 0.0;
+    try {
+        auto t0 = std::chrono::steady_clock::now();
+        dlib::deserialize(model68) >> sp68;
+        auto t1 = std::chrono::steady_clock::now();
+        dlib::deserialize(model5) >> sp5;
+        auto t2 = std::chrono::steady_clock::now();
+        load68_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        load5_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        dlib::deserialize(rec_model) >> rec;
+    } catch (std::exception& e) {
+        std::cerr << "模型加载失败：" << e.what() << std::endl;
+        return 1;
+    }
+    if (sp68.num_parts() != 68 || sp5.num_parts() != 5) {
+        std::cerr << "关键点模型点数不符（应为68点和5点）" << std::endl;
+        return 1;
+    }
+
+    Frame frame;
+    cv::Mat bgr;
+    size_t faces = 0, far = 0;
+    double align68_us = 0.0, align5_us = 0.0, sum_dist = 0.0;
+    float max_dist = 0.0f;
+    while (replay->read(frame)) {
+        if (!frame_to_bgr(frame, bgr)) continue;
+        dlib::cv_image<dlib::bgr_pixel> img(bgr);
+        for (const dlib::rectangle& face : detector(img)) {
+            auto t0 = std::chrono::steady_clock::now();
+            dlib::full_object_detection s68 = sp68(img, face);
+            auto t1 = std::chrono::steady_clock::now();
+            dlib::full_object_detection s5 = sp5(img, face);
+            auto t2 = std::chrono::steady_clock::now();
+            align68_us += std::chrono::duration<double, std::micro>(t1 - t0).count();
+            align5_us += std::chrono::duration<double, std::micro>(t2 - t1).count();
+
+            float d = dlib::length(rec.compute_face_descriptor(img, s68) - rec.compute_face_descriptor(img, s5));
+            sum_dist += d;
+            max_dist = std::max(max_dist, d);
+            if (d >= 0.3f) ++far;  // 超过匹配阈值0.6的一半，可能改变临界样本的判定
+            ++faces;
+        }
+    }
+    if (faces == 0) {
+        std::cerr << "回放中未检测到人脸" << std::endl;
         return 1;
     }
 
-    std::string face_feature = vm.getFaceFeature();
-    if (face_feature == "unknown_face") {
+    struct stat st68, st5;
+    double mb68 = stat(model68.c_str(), &st68) == 0 ? st68.st_size / 1048576.0 : 0.0;
+    double mb5 = stat(model5.c_str(), &st5) == 0 ? st5.st_size / 1048576.0 : 0.0;
+    std::cout << "68点：模型 " << mb68 << " MB，加载 " << load68_ms << " ms，每张人脸定位 " << align68_us / faces
+              << " us" << std::endl;
+    std::cout << "5点： 模型 " << mb5 << " MB，加载 " << load5_ms << " ms，每张人脸定位 " << align5_us / faces
+              << " us" << std::endl;
+    std::cout << "两种对齐的特征距离（" << faces << "张人脸）：平均 " << sum_dist / faces << "，最大 " << max_dist
+              << "，不小于0.3的 " << far << " 张" << std::endl;
+    return 0;
+}
+
+// 测试主函数
+// 用法：vision_module [--video 文件 | --images 目录] [--int8 [--calib 校准文件]] [--track | --watch]
+//                    [--downscale 倍数] [--min-face 像素] [--roi] [--parallel 段数]
+//                    [--landmarks5 [5点模型]] [--landmark-bench 68点模型 5点模型]
+//                    [--model-68 文件] [--model-5 文件] [--rec-model 文件] [--jpeg-quality 质量] [--thumb 宽度]
+//                    [--metrics 文件 [--metrics-interval 秒]] [--check-descriptor]
+// --landmarks5改用5点关键点模型；--landmark-bench在回放来源上对比两种关键点模型的速度和特征差异
+// --model-*指定模型文件，可以是dlib的.dat或model_convert_tool转换的.mrm
+// --check-descriptor在回放来源的每一帧上比对特征与dlib参考流程，超出容差时返回非0
+// --metrics定期把各阶段耗时分布写入文件（.json结尾为JSON，否则为Prometheus文本格式），退出时再写一次
+// 不带来源参数时使用摄像头；回放时--track改用跟踪模式（同一人脸不逐帧检测和提特征），
+// --watch改用持续监视（运动门控跳过无变化的帧）
+int main(int argc, char** argv) {
+    SmokeOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--video" && i + 1 < argc) {
+            opt.video = argv[++i];
+        } else if (arg == "--images" && i + 1 < argc) {
+            opt.images = argv[++i];
+        } else if (arg == "--int8") {
+            opt.int8 = true;
+        } else if (arg == "--calib" && i + 1 < argc) {
+            opt.calib = argv[++i];
+        } else if (arg == "--track") {
+            opt.track = true;
+        } else if (arg == "--watch") {
+            opt.watch = true;
+        } else if (arg == "--check-descriptor") {
+            opt.check_descriptor = true;
+        } else if (arg == "--downscale" && i + 1 < argc) {
+            opt.detect.downscale = std::atof(argv[++i]);
+        } else if (arg == "--min-face" && i + 1 < argc) {
+            opt.detect.min_face_size = std::atoi(argv[++i]);
+        } else if (arg == "--roi") {
+            opt.detect.use_roi = true;
+        } else if (arg == "--parallel" && i + 1 < argc) {
+            opt.detect.parallel_levels = std::atoi(argv[++i]);
+        } else if (arg == "--landmarks5") {
+            opt.landmarks5 = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') opt.model5 = argv[++i];
+        } else if (arg == "--landmark-bench" && i + 2 < argc) {
+            opt.bench68 = argv[++i];
+            opt.bench5 = argv[++i];
+        } else if (arg == "--model-68" && i + 1 < argc) {
+            opt.models.landmarks68 = argv[++i];
+        } else if (arg == "--model-5" && i + 1 < argc) {
+            opt.models.landmarks5 = argv[++i];
+        } else if (arg == "--rec-model" && i + 1 < argc) {
+            opt.models.recognition = argv[++i];
+        } else if (arg == "--jpeg-quality" && i + 1 < argc) {
+            opt.writer.jpeg_quality = std::atoi(argv[++i]);
+        } else if (arg == "--thumb" && i + 1 < argc) {
+            opt.writer.thumbnail_width = std::atoi(argv[++i]);
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            opt.metrics_path = argv[++i];
+        } else if (arg == "--metrics-interval" && i + 1 < argc) {
+            opt.metrics_interval = std::atoi(argv[++i]);
+        }
+    }
+
+    metrics::MetricsExporter exporter;
+    if (!opt.metrics_path.empty()) {
+        const std::string& mp = opt.metrics_path;
+        bool json = mp.size() >= 5 && mp.compare(mp.size() - 5, 5, ".json") == 0;
+        if (!exporter.start(mp, json ? metrics::ExportFormat::Json : metrics::ExportFormat::Prometheus,
+                            opt.metrics_interval)) {
+            std::cerr << "指标导出未启用（编译时关闭了指标或参数无效）" << std::endl;
+        }
+    }
+
+    std::unique_ptr<FrameSource> replay;
+    if (!opt.video.empty()) replay.reset(new VideoFileSource(opt.video));
+    if (!opt.images.empty()) replay.reset(new ImageDirSource(opt.images));
+    if (!opt.bench68.empty()) {
+        if (!replay) {
+            std::cerr << "--landmark-bench需要配合--video或--images使用" << std::endl;
+            return 1;
+        }
+        return run_landmark_bench(std::move(replay), opt.bench68, opt.bench5, opt.models.recognition);
+    }
+    if (opt.check_descriptor) {
+        if (!replay) {
+            std::cerr << "--check-descriptor需要配合--video或--images使用" << std::endl;
+            return 1;
+        }
+        return run_descriptor_check(std::move(replay), opt);
+    }
+    if (replay) return run_replay(std::move(replay), opt);
+
+    VisionModule vm(0, "/home/addshark/Desktop/addshark/MemoryRobot/images");
+    if (!setup_module(vm, opt)) return 1;
+
+    // 同一帧既保存照片又提取特征：存图在后台进行，与特征提取并行
+    FrameRing::Ref frame = vm.acquireFrame();
+    if (!frame) return 1;
+    auto shutter = std::chrono::steady_clock::now();
+    std::future<std::string> saved = vm.captureImageAsync(*frame);
+    std::cout << "拍照返回耗时 "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shutter).count()
+              << " ms" << std::endl;
+
+    FaceDescriptor descriptor;
+    if (!vm.getFaceDescriptor(*frame, descriptor)) {
         std::cerr << "人脸特征提取失败！" << std::endl;
         return 1;
     }
-    std::cout << "人脸特征（前10维）：" << face_feature.substr(0, 50) << "..." << std::endl;
+    std::cout << "人脸特征（前10维）：";
+    for (int i = 0; i < 10; ++i) {
+        std::cout << descriptor[i] << (i < 9 ? "," : "...");
+    }
+    std::cout << std::endl;
+
+    // 同一帧的多人脸批量特征，第一张脸应与单人脸结果一致
+    std::vector<DetectedFace> faces;
+    size_t n = vm.getFaceDescriptors(*frame, faces);
+    std::cout << "画面中人脸数：" << n << std::endl;
+
+    // 直接采样的人脸块与dlib参考流程应得到相同特征（回放来源上的逐帧校验见--check-descriptor）
+    float max_diff = 0.0f;
+    const float tolerance = descriptor_tolerance(opt);
+    if (!vm.checkDescriptorPath(*frame, max_diff) || max_diff > tolerance) {
+        std::cerr << "特征校验失败：与参考流程最大误差" << max_diff << std::endl;
+        return 1;
+    }
+    std::cout << "特征校验通过（与参考流程最大误差" << max_diff << "）" << std::endl;
+
+    std::string img_path = saved.get();
+    if (img_path.empty()) {
+        std::cerr << "图片拍摄失败！" << std::endl;
+        return 1;
+    }
+    vm.flushImages();
+    ImageWriterStats ws = vm.imageWriterStats();
+    std::cout << "图片保存路径：" << img_path << "（编码 " << ws.encode_ms << " ms，写盘 " << ws.write_ms
+              << " ms，fsync " << ws.fsyncs << " 次）" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
+#endif // MEMORYROBOT_NO_TEST_MAIN
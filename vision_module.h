@@ -9,6 +9,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <future>
 
 // 2. OpenCV头文件
 #include <opencv2/opencv.hpp>
@@ -25,24 +28,230 @@
 
 // 引入自定义人脸模型头文件（当前目录）
 #include "face_recognition_model_v1.h"
+#include "face_descriptor.h"
+#include "frame_arena.h"
+#include "frame_ring.h"
+#include "frame_source.h"
+#include "image_dedup.h"
+#include "image_writer.h"
+#include "mapped_shape_predictor.h"
+#include "metrics.h"
+#include "motion_gate.h"
+#include "task_graph.h"
+
+// 关键点模型：68点为原始模型；5点模型（shape_predictor_5_face_landmarks.dat）约为其1/10大小，
+// 加载和定位都快得多，对齐后的特征与68点路径略有差异
+enum class LandmarkMode {
+    Points68,
+    Points5
+};
+
+// 模型文件路径：dlib原始.dat或model_convert_tool转换的.mrm均可（按文件头识别）
+// .mrm直接mmap使用，启动时不反序列化，权重按需从页缓存调入，多个进程共享
+struct VisionModelPaths {
+    std::string landmarks68;
+    std::string landmarks5;
+    std::string recognition;
+    VisionModelPaths()
+        : landmarks68("/home/addshark/shape_predictor_68_face_landmarks.dat"),
+          landmarks5("/home/addshark/shape_predictor_5_face_landmarks.dat"),
+          recognition("/home/addshark/dlib_face_recognition_resnet_model_v1.dat") {}
+};
+
+// 画面中一张人脸的检测结果
+struct DetectedFace {
+    cv::Rect box;               // 检测框（原图坐标）
+    FaceDescriptor descriptor;
+};
+
+// 跟踪模式参数：检测+特征提取一次后用相关滤波跟踪器跟随人脸，跟丢或每redetect_interval帧重新检测
+struct TrackingOptions {
+    int redetect_interval;     // 连续跟踪多少帧后强制重新检测（0为只在跟丢时检测）
+    double min_confidence;     // 跟踪置信度（correlation_tracker的PSR）低于此值视为跟丢
+    float same_person_distance;  // 重新检测后特征距离小于此值视为同一人，保留UID
+    TrackingOptions() : redetect_interval(30), min_confidence(7.0), same_person_distance(0.6f) {}
+};
+
+// 跟踪中的人脸：跟踪期间特征和UID直接复用
+struct TrackedFace {
+    uint64_t track_id;         // 每换一个人加1
+    uint64_t frame_id;
+    cv::Rect box;
+    FaceDescriptor descriptor;
+    std::string uid;           // 由调用方识别后通过setTrackedUid写入；为空表示尚未识别
+    double confidence;         // 本帧跟踪置信度（重新检测的帧为0）
+    bool refreshed;            // 本帧是否重新做了检测和特征提取
+    TrackedFace() : track_id(0), frame_id(0), descriptor(), confidence(0.0), refreshed(false) {}
+};
+
+struct TrackingStats {
+    uint64_t detections;       // 完整检测+特征提取次数
+    uint64_t tracked_frames;   // 只做跟踪的帧数
+    uint64_t losses;           // 跟丢次数
+    uint64_t identity_changes; // 重新检测后发现换了人的次数
+};
+
+// 人脸检测加速参数（默认值等价于整帧、全金字塔的原始检测）
+struct FaceDetectOptions {
+    double downscale;      // 检测前把画面缩小的倍数（1为不缩小）
+    int min_face_size;     // 最小人脸边长（原图像素）；大于检测窗口80时按比例缩小画面，相当于去掉最细的金字塔层
+    bool use_roi;          // 只在提示区域（上次检测到的人脸、运动区域）内检测
+    double roi_margin;     // 提示区域四周外扩的比例（相对区域边长）
+    bool roi_fallback;     // 提示区域内没有人脸时再整帧检测一次
+    int parallel_levels;   // 金字塔拆成几段在多个线程上并行检测（1为不并行）
+    FaceDetectOptions()
+        : downscale(1.0), min_face_size(0), use_roi(false), roi_margin(0.5), roi_fallback(true),
+          parallel_levels(1) {}
+};
+
+struct DetectStats {
+    uint64_t runs;        // 检测次数
+    uint64_t roi_runs;    // 只在提示区域内检测的次数
+    uint64_t fallbacks;   // 提示区域内无人脸、改为整帧检测的次数
+    double total_ms;      // 检测（不含关键点）累计耗时
+};
+
+// 持续监视各阶段的处理/跳过计数
+struct WatchStats {
+    MotionGateStats gate;      // 运动门控：放行/跳过的帧数
+    uint64_t detector_runs;    // 检测器实际运行的帧数
+    uint64_t detector_empty;   // 运行了检测器但无人脸的帧数
+    uint64_t described_faces;  // 提取了特征的人脸数
+};
 
 class VisionModule {
 private:
-    cv::VideoCapture cap;
+    std::unique_ptr<FrameSource> source;  // 画面来源（摄像头或回放）
     int camera_id;          
     std::string save_path;  
+    AsyncImageWriter image_writer;  // 拍照的编码和写盘在后台线程完成
 
     // dlib核心对象
     dlib::frontal_face_detector face_detector;
     dlib::shape_predictor shape_predictor;
+    MappedShapePredictor mapped_landmarks;  // 关键点模型为.mrm时使用，shape_predictor为空
+    LandmarkMode landmark_mode;
+    std::string landmark_path;  // 为空时按landmark_mode取model_paths中的路径
+    VisionModelPaths model_paths;
     dlib::face_recognition_model_v1 face_rec_model;
 
+    // 后台采集线程持续把画面写入帧环，拍照和特征提取只取帧、不等摄像头
+    FrameRing frames;
+    std::thread capture_thread;
+    std::atomic<bool> capture_stop;
+    void capture_loop();
+    void stop_capture();
+
+    // 跟踪模式状态
+    bool tracking_enabled;
+    TrackingOptions tracking_options;
+    dlib::correlation_tracker tracker;
+    bool track_active;
+    int frames_since_detect;
+    TrackedFace track;
+    TrackingStats tracking_stats;
+    bool redetect_track(const Frame& frame);
+
+    // 持续监视：运动门控 -> 检测 -> 特征
+    MotionGate motion_gate;
+    WatchStats watch_stats;
+
+    // 加速检测（FaceDetectOptions）
+    FaceDetectOptions detect_options;
+    DetectStats detect_stats;
+    cv::Rect last_face_box;   // 上次检测到的人脸外接框（ROI提示）
+    cv::Rect motion_roi;      // 运动门控给出的变化区域（ROI提示）
+    cv::Mat detect_gray, detect_small;
+    std::vector<dlib::frontal_face_detector> part_detectors;  // 并行检测时每段一个（检测器不可并发调用）
+    std::vector<int> part_levels;                              // part_detectors[j]扫描的层数
+    std::vector<int> part_start;                               // 当前检测图尺寸下每段起始金字塔层
+    std::vector<double> part_area;                             // 计算分段用的每层面积
+    cv::Size part_size;                                        // part_start对应的检测图尺寸
+    std::vector<std::vector<dlib::rect_detection>> part_found; // 每段的检测结果（各段任务只写自己那一项）
+    std::vector<cv::Mat> part_images;                          // 每段缩小到起始层的检测图（容量复用）
+    cv::Mat part_gray;                                         // 本帧的检测图（供各段任务读取）
+    std::mutex part_mutex;
+    std::condition_variable part_cv;
+    size_t part_remaining;                                     // 尚未完成的段数（part_mutex保护）
+    std::unique_ptr<TaskPool> level_pool;  // 并行检测的常驻线程（parallel_levels-1个，第0段在调用线程上跑）
+    bool fast_detect() const;
+    void detect_rects(const Frame& frame, const cv::Mat& full_gray, std::vector<dlib::rectangle>& rects);
+    void detect_region(const Frame& frame, const cv::Mat& full_gray, const cv::Rect& roi,
+                       std::vector<dlib::rectangle>& rects);
+    void detect_pyramid(const cv::Mat& gray, std::vector<dlib::rectangle>& rects);
+    void detect_part(size_t j);
+
+    // 每帧的工作缓冲（检测框、关键点、特征、灰度/彩色转换），稳态下不再分配，见frame_arena.h
+    static const size_t kArenaFaces = 8;  // 预留的人脸数（更多时按需扩容，之后同样复用）
+    FrameArena arena;
+    bool detect_faces(const Frame& frame, bool first_only);  // 结果在arena.shapes
+    bool describe_faces(const Frame& frame, const std::vector<dlib::full_object_detection>& shapes);  // 结果在arena.descriptors
+
 public:
     VisionModule(int cam_id = 0, const std::string& save_path = "/home/addshark/Desktop/addshark/MemoryRobot/images");
+    // 使用指定画面来源（如视频文件/图片目录回放）；source为空时不启动采集线程，只处理调用方传入的帧
+    VisionModule(std::unique_ptr<FrameSource> source,
+                 const std::string& save_path = "/home/addshark/Desktop/addshark/MemoryRobot/images");
     ~VisionModule();
+    // 选择关键点模型（init前调用）；model_path为空时用model_paths中该模式的路径
+    void setLandmarkMode(LandmarkMode mode, const std::string& model_path = "");
+    LandmarkMode landmarkMode() const { return landmark_mode; }
+    // 模型路径（init前调用）
+    void setModelPaths(const VisionModelPaths& paths) { model_paths = paths; }
+    const VisionModelPaths& modelPaths() const { return model_paths; }
     bool init();
+    // 切换到int8推理后端（init之后调用）；calib_path为空时按层动态量化，见quantized_face_net.h
+    bool enableQuantizedInference(const std::string& calib_path = "");
+
+    // 取最新一帧（frame_id非0时取指定帧，已被覆盖则返回空）；持有期间该帧不会被覆盖
+    FrameRing::Ref acquireFrame(uint64_t frame_id = 0, int timeout_ms = 1000);
+
+    // 拍照：像素拷贝入队后立即返回，future在文件写入后得到路径（失败为空字符串）
+    std::future<std::string> captureImageAsync();                    // 保存最新一帧
+    std::future<std::string> captureImageAsync(const Frame& frame);  // 保存指定帧（与特征提取用同一帧）
+    // 兼容旧接口：等待写入完成后返回路径
     std::string captureImage();
-    std::string getFaceFeature();
+    std::string captureImage(const Frame& frame);
+    // 存图参数（首次拍照前设置）；flushImages等待已拍照片全部fsync
+    void setImageWriterOptions(const ImageWriterOptions& options) { image_writer.setOptions(options); }
+    ImageWriterStats imageWriterStats() const { return image_writer.stats(); }
+    void flushImages() { image_writer.flush(); }
+    // 画面的64位dHash（照片去重用，见MemoryDB::findDuplicateImage）；MJPEG帧只按1/4尺寸解码亮度
+    bool imageHash(const Frame& frame, uint64_t& hash);
+    bool getFaceDescriptor(FaceDescriptor& descriptor);  // 定长特征，直接交给MemoryDB::getUserUID（跟踪模式下复用跟踪的特征）
+    bool getFaceDescriptor(const Frame& frame, FaceDescriptor& descriptor);
+    // 多人脸：检测画面中所有人脸，特征在一次批量前向中算出；返回人脸数
+    size_t getFaceDescriptors(std::vector<DetectedFace>& faces);
+    size_t getFaceDescriptors(const Frame& frame, std::vector<DetectedFace>& faces);
+    // 校验：本模块的特征路径与dlib参考流程（整帧拷贝为matrix<rgb_pixel>再裁剪）对比，输出最大逐维误差
+    // （.mrm识别模型的参考特征由同一套权重的float实现给出）
+    bool checkDescriptorPath(const Frame& frame, float& max_abs_diff);
+    std::string getFaceFeature();  // 兼容旧接口：逗号分隔的文本特征
+
+    // 跟踪模式：开启后getFaceDescriptor/getFaceFeature改走trackFace，稳定跟踪时不再检测和提特征
+    void enableTracking(const TrackingOptions& options = TrackingOptions());
+    void disableTracking();
+    // 跟踪最新一帧（或指定帧）中的人脸；画面中无人脸时返回false
+    bool trackFace(TrackedFace& face);
+    bool trackFace(const Frame& frame, TrackedFace& face);
+    // 记录当前跟踪对象的UID，跟踪不断期间trackFace直接返回
+    void setTrackedUid(const std::string& uid);
+    void resetTracking();
+    TrackingStats trackingStats() const { return tracking_stats; }
+
+    // 检测加速参数（缩小、最小人脸、ROI提示、金字塔并行）
+    void setDetectOptions(const FaceDetectOptions& options);
+    DetectStats detectStats() const { return detect_stats; }
+
+    // 持续监视入口：画面无变化（且近期无人）时直接返回0，不运行检测器；否则检测所有人脸并提特征
+    size_t watch(const Frame& frame, std::vector<DetectedFace>& faces);
+    void setMotionGateOptions(const MotionGateOptions& options) { motion_gate.setOptions(options); }
+    WatchStats watchStats() const;
+
+    // 每帧堆分配统计（getFaceDescriptor/getFaceDescriptors/trackFace/watch各算一帧）；
+    // 程序未开启alloc_counter.h的计数时只有帧数
+    FrameArenaStats arenaStats() const { return arena.stats(); }
+    void resetArenaStats() { arena.resetStats(); }
 };
 
 #endif // VISION_MODULE_H
\ No newline at end of file